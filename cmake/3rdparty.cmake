@@ -1,10 +1,12 @@
-find_package(OpenGL REQUIRED)
+if (BUILD_GUI)
+  find_package(OpenGL REQUIRED)
 
-if (CMAKE_SYSTEM_NAME STREQUAL "Linux")
-  find_package(X11 REQUIRED)
+  if (CMAKE_SYSTEM_NAME STREQUAL "Linux")
+    find_package(X11 REQUIRED)
 
-  if (NOT X11_Xi_FOUND)
-    message(FATAL_ERROR " X11 Xi library is required")
+    if (NOT X11_Xi_FOUND)
+      message(FATAL_ERROR " X11 Xi library is required")
+    endif ()
   endif ()
 endif ()
 
@@ -19,15 +21,26 @@ if (USE_OPENMP)
   find_package(OpenMP REQUIRED)
 endif ()
 
+# Setup threads
+find_package(Threads REQUIRED)
+
 # Setup OpenCL
 if (USE_OPENCL)
   message(STATUS "Using OpenCL for calculations")
   find_package(OpenCL REQUIRED)
 endif ()
 
-include(cmake/glad.cmake)
-include(cmake/glfw.cmake)
-include(cmake/hmm.cmake)
-include(cmake/imgui.cmake)
+# Setup MPI
+if (USE_MPI)
+  message(STATUS "Using MPI for distributed calculations")
+  find_package(MPI REQUIRED COMPONENTS CXX)
+endif ()
+
+if (BUILD_GUI)
+  include(cmake/glad.cmake)
+  include(cmake/glfw.cmake)
+  include(cmake/hmm.cmake)
+  include(cmake/imgui.cmake)
+endif ()
 include(cmake/inih.cmake)
 include(cmake/plog.cmake)
@@ -7,9 +7,8 @@ class ContourPlot;
  ****************************************************************************/
 class ContourFill : public ContourPlot {
 public:
-    ContourFill() = default;
-    
-    bool Update(matrix_t* points, const HMM_Vec4& area, double t);
+    ContourFill() : ContourPlot(true) { }
+
     void Render(const HMM_Mat4& mvp,
                 double zoom,
                 const HMM_Vec2& offset,
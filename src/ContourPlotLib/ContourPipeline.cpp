@@ -0,0 +1,155 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "GraphicsUtils.h"
+#include "GraphicsLogger.h"
+#include "GraphicsResource.h"
+#include "StreamBuffer.h"
+#include "ContourPlot.h"
+#include "ContourLine.h"
+#include "ContourFill.h"
+#include "ContourPipeline.h"
+
+// Pending, meshing, ready and uploading frames
+constexpr size_t FramesCount = 4;
+
+ContourPipeline::~ContourPipeline() {
+    Release();
+}
+
+bool ContourPipeline::Init(ContourLine* lines, ContourFill* fill) {
+    Release();
+
+    lines_ = lines;
+    fill_ = fill;
+
+    frames_.clear();
+    freeFrames_.clear();
+    for (size_t i = 0; i < FramesCount; i++) {
+        frames_.push_back(std::make_unique<frame_t>());
+        freeFrames_.push_back(frames_.back().get());
+    }
+
+    pending_ = nullptr;
+    ready_ = nullptr;
+    droppedFrames_ = 0;
+
+    stop_ = false;
+    worker_ = std::thread(&ContourPipeline::Run, this);
+
+    return true;
+}
+
+void ContourPipeline::Release() {
+    if (!worker_.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+
+    worker_.join();
+}
+
+void ContourPipeline::Submit(const matrix_t* points, const HMM_Vec4& area, double t, bool withFill) {
+    frame_t* frame = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_) {
+            // The worker didn't get to the previous frame, replace it
+            frame = pending_;
+            pending_ = nullptr;
+            droppedFrames_++;
+        }
+        else if (!freeFrames_.empty()) {
+            frame = freeFrames_.back();
+            freeFrames_.pop_back();
+        }
+    }
+
+    if (!frame) {
+        LOGE << "No free frames in contour pipeline";
+        return;
+    }
+
+    if (!frame->points ||
+        frame->points->rows != points->rows || frame->points->cols != points->cols) {
+        frame->points = MatrixGuard_t(matrix_allocate(points->rows, points->cols), matrix_free);
+    }
+    matrix_copy(frame->points.get(), points);
+
+    frame->area = area;
+    frame->threshold = t;
+    frame->withFill = withFill;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = frame;
+    }
+    cond_.notify_one();
+}
+
+bool ContourPipeline::Upload() {
+    frame_t* frame = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frame = ready_;
+        ready_ = nullptr;
+    }
+
+    if (!frame) {
+        return false;
+    }
+
+    lines_->Upload(frame->lines);
+    if (frame->withFill) {
+        fill_->Upload(frame->fill);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        freeFrames_.push_back(frame);
+    }
+
+    return true;
+}
+
+size_t ContourPipeline::GetDroppedFrames() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return droppedFrames_;
+}
+
+void ContourPipeline::Run() {
+    while (true) {
+        frame_t* frame = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this]() { return stop_ || pending_ != nullptr; });
+            if (stop_) {
+                break;
+            }
+            frame = pending_;
+            pending_ = nullptr;
+        }
+
+        lines_->Build(frame->points.get(), frame->area, frame->threshold, frame->lines);
+        if (frame->withFill) {
+            fill_->Build(frame->points.get(), frame->area, frame->threshold, frame->fill);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ready_) {
+                // The previous meshes weren't uploaded in time, replace them
+                freeFrames_.push_back(ready_);
+                droppedFrames_++;
+            }
+            ready_ = frame;
+        }
+    }
+}
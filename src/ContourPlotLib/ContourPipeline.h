@@ -0,0 +1,55 @@
+#pragma once
+
+class ContourLine;
+class ContourFill;
+
+/*****************************************************************************
+ * ContourPipeline - builds contour meshes on a worker thread
+ *
+ * The field submitted for step N is copied into a frame and meshed by
+ * the worker while the caller simulates step N+1. The OpenGL thread only
+ * uploads finished meshes. Both queues hold a single frame, so a frame that
+ * wasn't picked up in time is replaced by a newer one and dropped.
+ ****************************************************************************/
+class ContourPipeline {
+public:
+    ContourPipeline() = default;
+    ~ContourPipeline();
+
+    bool Init(ContourLine* lines, ContourFill* fill);
+    void Release();
+
+    void Submit(const matrix_t* points, const HMM_Vec4& area, double t, bool withFill);
+    bool Upload();
+
+    size_t GetDroppedFrames() const;
+
+private:
+    struct frame_t {
+        MatrixGuard_t points;
+        HMM_Vec4 area = { 0.0, 0.0, 0.0, 0.0 };
+        double threshold = 0.0;
+        bool withFill = false;
+
+        contour_mesh_t lines;
+        contour_mesh_t fill;
+    };
+
+    void Run();
+
+private:
+    ContourLine* lines_ = nullptr;
+    ContourFill* fill_ = nullptr;
+
+    std::thread worker_;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stop_ = false;
+
+    std::vector<std::unique_ptr<frame_t>> frames_;
+    std::vector<frame_t*> freeFrames_;
+    frame_t* pending_ = nullptr; // Submitted and waiting for the worker
+    frame_t* ready_ = nullptr; // Meshed and waiting for the upload
+
+    size_t droppedFrames_ = 0;
+};
@@ -2,36 +2,328 @@
 #include "Matrix.h"
 #include "GraphicsUtils.h"
 #include "GraphicsLogger.h"
+#include "GraphicsResource.h"
+#include "StreamBuffer.h"
 #include "ContourPlot.h"
 
-SquareFlags operator|(SquareFlags lhs, SquareFlags rhs) {
-    return static_cast<SquareFlags>(static_cast<int>(lhs) | static_cast<int>(rhs));
+/*
+ * Points of a square that vertices of the cases refer to. Corners are named by
+ * their offsets in the grid, crossings of the level are named by the values
+ * of the side
+ */
+enum SquarePoint : uint8_t {
+    C00, C10, C11, C01,
+    E01, E12, E32, E03
+};
+
+/*
+ * Vertices of a case, two per segment of a line and three per triangle of a fill
+ */
+struct square_case_t {
+    uint8_t linesCount;
+    SquarePoint lines[4];
+    uint8_t trianglesCount;
+    SquarePoint triangles[12];
+};
+
+// Saddles have two cases, the table holds the one with the center below the level
+constexpr int SaddleSouthWest = static_cast<int>(SquareFlags::SouthWest) | static_cast<int>(SquareFlags::NorthEast);
+constexpr int SaddleNorthWest = static_cast<int>(SquareFlags::NorthWest) | static_cast<int>(SquareFlags::SouthEast);
+
+static const square_case_t SquareCases[16] = {
+    // None
+    { 0, {}, 0, {} },
+    // SouthWest
+    { 2, { E03, E01 }, 3, { C00, E01, E03 } },
+    // NorthWest
+    { 2, { E01, E12 }, 3, { C10, E12, E01 } },
+    // SouthWest | NorthWest
+    { 2, { E03, E12 }, 6, { C00, E12, E03, C00, C10, E12 } },
+    // NorthEast
+    { 2, { E32, E12 }, 3, { C11, E32, E12 } },
+    // SouthWest | NorthEast
+    { 4, { E03, E01, E32, E12 }, 6, { C00, E01, E03, C11, E32, E12 } },
+    // NorthWest | NorthEast
+    { 2, { E01, E32 }, 6, { E01, C11, E32, E01, C10, C11 } },
+    // All ^ SouthEast
+    { 2, { E03, E32 }, 9, { C00, C10, E03, E03, C10, E32, C10, C11, E32 } },
+    // SouthEast
+    { 2, { E03, E32 }, 3, { C01, E03, E32 } },
+    // SouthWest | SouthEast
+    { 2, { E01, E32 }, 6, { C00, E32, C01, C00, E01, E32 } },
+    // NorthWest | SouthEast
+    { 4, { E03, E32, E01, E12 }, 6, { C01, E03, E32, C10, E12, E01 } },
+    // All ^ NorthEast
+    { 2, { E32, E12 }, 9, { C00, C10, E12, C00, E12, E32, C00, E32, C01 } },
+    // NorthEast | SouthEast
+    { 2, { E03, E12 }, 6, { E03, C11, C01, E03, E12, C11 } },
+    // All ^ NorthWest
+    { 2, { E01, E12 }, 9, { C00, E01, C01, C01, E01, E12, C01, E12, C11 } },
+    // All ^ SouthWest
+    { 2, { E03, E01 }, 9, { E01, C10, C11, E01, C11, E03, E03, C11, C01 } },
+    // All
+    { 0, {}, 6, { C00, C11, C01, C00, C10, C11 } },
+};
+
+// Saddles with the center above the level, the fill connects the opposite corners
+static const square_case_t SaddleCases[2] = {
+    // SouthWest | NorthEast
+    { 4, { E03, E32, E01, E12 }, 12, { E01, E12, E32, E01, E32, E03,
+                                       C00, E01, E03, C11, E32, E12 } },
+    // NorthWest | SouthEast
+    { 4, { E03, E01, E32, E12 }, 12, { E01, E12, E32, E01, E32, E03,
+                                       C01, E03, E32, C10, E12, E01 } },
+};
+
+// Case code of a saddle with the center above the level
+constexpr uint8_t SaddleAbove = 0x10;
+
+static inline const square_case_t& SquareCase(uint8_t code) {
+    if (code & SaddleAbove) {
+        return SaddleCases[(code & ~SaddleAbove) == SaddleSouthWest ? 0 : 1];
+    }
+    return SquareCases[code];
 }
 
-SquareFlags& operator|=(SquareFlags& lhs, SquareFlags rhs) {
-    lhs = lhs | rhs;
-    return lhs;
+void SquareCaseCodes(const float* row0, const float* row1, size_t squares, float t, uint8_t* codes) {
+    // Branchless comparisons of the whole row are vectorized
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+    for (size_t i = 0; i < squares; i++) {
+        codes[i] = static_cast<uint8_t>(
+            (static_cast<int>(row0[i] > t) << 0) |
+            (static_cast<int>(row0[i + 1] > t) << 1) |
+            (static_cast<int>(row1[i + 1] > t) << 2) |
+            (static_cast<int>(row1[i] > t) << 3));
+    }
 }
 
-SquareFlags operator^(SquareFlags lhs, SquareFlags rhs) {
-    return static_cast<SquareFlags>(static_cast<int>(lhs) ^ static_cast<int>(rhs));
+/*
+ * Linear interpolation of the level between values of a side
+ */
+static inline float ValuesRatio(float v1, float v2) {
+    return fabsf(v1 / (v1 - v2));
 }
 
-SquareFlags& operator^=(SquareFlags& lhs, SquareFlags rhs) {
-    lhs = lhs ^ rhs;
-    return lhs;
+/*
+ * Position of a point of the square with values v and the bottom left corner at (x, y)
+ */
+static HMM_Vec2 SquarePointPosition(SquarePoint point, const float* v, float x, float y, float dX, float dY) {
+    switch (point) {
+    case C00: return HMM_V2(x, y);
+    case C10: return HMM_V2(x + dX, y);
+    case C11: return HMM_V2(x + dX, y + dY);
+    case C01: return HMM_V2(x, y + dY);
+    case E01: return HMM_V2(x + dX * ValuesRatio(v[0], v[1]), y);
+    case E12: return HMM_V2(x + dX, y + dY * ValuesRatio(v[1], v[2]));
+    case E32: return HMM_V2(x + dX * ValuesRatio(v[3], v[2]), y + dY);
+    case E03: return HMM_V2(x, y + dY * ValuesRatio(v[0], v[3]));
+    }
+    return HMM_V2(x, y);
 }
 
-SquareFlags CellType(vals_t vals) {
-    return ((vals.v[0] > 0.0) ? SquareFlags::SouthWest : SquareFlags::None) |
-        ((vals.v[1] > 0.0) ? SquareFlags::NorthWest : SquareFlags::None) |
-        ((vals.v[2] > 0.0) ? SquareFlags::NorthEast : SquareFlags::None) |
-        ((vals.v[3] > 0.0) ? SquareFlags::SouthEast : SquareFlags::None);
+// Point of the grid without a vertex yet
+constexpr GLuint NoVertex = ~0u;
+
+// Squares in a row and a column of a tile. Tiles are built independently,
+// vertices on the sides between them are repeated
+constexpr int TileSize = 32;
+
+// Values of a tile per snapshot, nodes on its sides are included
+constexpr size_t TileValues = (TileSize + 1) * (TileSize + 1);
+
+// Change of a value that makes the tile to be marched again
+constexpr float TileTolerance = 1e-4f;
+
+/*
+ * Rectangle of the fill over fully covered squares [start, end) of the rows
+ * since its bottom vertices were placed. It grows while the next row has
+ * a run with the same squares
+ */
+struct fill_run_t {
+    int end; // No rectangle starts at the square if zero
+    bool extended;
+    GLuint bottomLeft, bottomRight;
+};
+
+/*
+ * Marching squares of the tile with squares [i0, i1) x [j0, j1) of the grid.
+ * Vertices are numbered from the first vertex of the tile. Runs of fully
+ * covered squares are filled with rectangles, other squares use the cases
+ */
+static void MarchTile(const matrix_t* points, const HMM_Vec4& area, float level, bool fill,
+                      int i0, int j0, int i1, int j1, vertices_t& vertices, indices_t& indices) {
+    const size_t cols = points->cols;
+    const int xdiv = points->cols - 1;
+    const int ydiv = points->rows - 1;
+
+    const float dX = (area.Y - area.X) / static_cast<float>(xdiv);
+    const float dY = (area.W - area.Z) / static_cast<float>(ydiv);
+
+    const int width = i1 - i0;
+
+    std::array<uint8_t, TileSize> codes;
+
+    // Vertices at the nodes and on the horizontal sides of the lower and the
+    // upper row of the tile, and on the vertical sides between them
+    std::array<GLuint, TileSize + 1> nodes[2], sides[2], verticalSides;
+    GLuint* bottomNodes = nodes[0].data();
+    GLuint* topNodes = nodes[1].data();
+    GLuint* bottomSides = sides[0].data();
+    GLuint* topSides = sides[1].data();
+    nodes[0].fill(NoVertex);
+    nodes[1].fill(NoVertex);
+    sides[0].fill(NoVertex);
+    sides[1].fill(NoVertex);
+
+    // Rectangles of the fill by their first square and ends of the runs
+    // that start in the current row
+    std::array<fill_run_t, TileSize> runs;
+    std::array<int, TileSize> rowRunEnds;
+    runs.fill(fill_run_t{ 0, false, NoVertex, NoVertex });
+
+    vertices.clear();
+    indices.clear();
+
+    auto nodeVertex = [&](GLuint& vertex, int i, int j) {
+        if (vertex == NoVertex) {
+            vertex = static_cast<GLuint>(vertices.size());
+            vertices.push_back(HMM_V2(area.X + static_cast<float>(i0 + i) * dX,
+                                      area.Z + static_cast<float>(j) * dY));
+        }
+        return vertex;
+    };
+
+    // Triangles of the rectangle with the top at the bottom nodes of the row j,
+    // same order as the case of a covered square
+    auto closeRun = [&](int start, int j) {
+        fill_run_t& run = runs[start];
+        const GLuint topLeft = nodeVertex(bottomNodes[start], start, j);
+        const GLuint topRight = nodeVertex(bottomNodes[run.end], run.end, j);
+        indices.insert(indices.end(), {
+            run.bottomLeft, topRight, topLeft,
+            run.bottomLeft, run.bottomRight, topRight });
+        run.end = 0;
+    };
+
+    for (int j = j0; j < j1; j++) {
+        const float* row0 = points->data + j * cols + i0;
+        const float* row1 = row0 + cols;
+
+        SquareCaseCodes(row0, row1, width, level, codes.data());
+        verticalSides.fill(NoVertex);
+        rowRunEnds.fill(0);
+
+        const float y = area.Z + static_cast<float>(j) * dY;
+
+        for (int i = 0; i < width; i++) {
+            uint8_t code = codes[i];
+            if (code == static_cast<uint8_t>(SquareFlags::None)) {
+                continue;
+            }
+
+            if (code == static_cast<uint8_t>(SquareFlags::All)) {
+                if (fill) {
+                    int end = i + 1;
+                    while (end < width && codes[end] == static_cast<uint8_t>(SquareFlags::All)) {
+                        end++;
+                    }
+
+                    if (runs[i].end == end) {
+                        runs[i].extended = true;
+                    }
+                    else {
+                        rowRunEnds[i] = end;
+                    }
+                    i = end - 1;
+                }
+                continue;
+            }
+
+            const float x = area.X + static_cast<float>(i0 + i) * dX;
+
+            const float v[4] = {
+                row0[i] - level, row0[i + 1] - level,
+                row1[i + 1] - level, row1[i] - level };
+
+            // Saddles are resolved by the value in the center
+            if ((code == SaddleSouthWest || code == SaddleNorthWest) &&
+                (v[0] + v[1] + v[2] + v[3]) / 4.0f - level > 0.0f) {
+                code |= SaddleAbove;
+            }
+
+            const square_case_t& squareCase = SquareCase(code);
+
+            GLuint* pointVertices[8] = {
+                &bottomNodes[i], &bottomNodes[i + 1], &topNodes[i + 1], &topNodes[i],
+                &bottomSides[i], &verticalSides[i + 1], &topSides[i], &verticalSides[i] };
+
+            const uint8_t count = fill ? squareCase.trianglesCount : squareCase.linesCount;
+            const SquarePoint* squarePoints = fill ? squareCase.triangles : squareCase.lines;
+            for (uint8_t k = 0; k < count; k++) {
+                GLuint& vertex = *pointVertices[squarePoints[k]];
+                if (vertex == NoVertex) {
+                    vertex = static_cast<GLuint>(vertices.size());
+                    vertices.push_back(SquarePointPosition(squarePoints[k], v, x, y, dX, dY));
+                }
+                indices.push_back(vertex);
+            }
+        }
+
+        // Rectangles that the row doesn't continue are closed below it
+        for (int i = 0; i < width; i++) {
+            fill_run_t& run = runs[i];
+            if (run.end != 0 && !run.extended) {
+                closeRun(i, j);
+            }
+            run.extended = false;
+
+            if (rowRunEnds[i] != 0) {
+                run.end = rowRunEnds[i];
+                run.bottomLeft = nodeVertex(bottomNodes[i], i, j);
+                run.bottomRight = nodeVertex(bottomNodes[run.end], run.end, j);
+            }
+        }
+
+        std::swap(bottomNodes, topNodes);
+        std::swap(bottomSides, topSides);
+        std::fill(topNodes, topNodes + (width + 1), NoVertex);
+        std::fill(topSides, topSides + width, NoVertex);
+    }
+
+    for (int i = 0; i < width; i++) {
+        if (runs[i].end != 0) {
+            closeRun(i, j1);
+        }
+    }
 }
 
-double ValuesRatio(vals_t vals, size_t i1, size_t i2) {
-    assert(/*i1 >= 0 && */i1 <= 3 && /*i2 >= 0 && */i2 <= 3);
-    return fabs(vals.v[i1] / (vals.v[i1] - vals.v[i2]));
+/*
+ * Compares nodes of the tile with the snapshot of the values it was built from
+ */
+static bool TileChanged(const matrix_t* points, float level, int i0, int j0, int i1, int j1,
+                        const float* snapshot) {
+    const int width = i1 - i0 + 1;
+
+    for (int j = j0; j <= j1; j++) {
+        const float* row = points->data + j * points->cols + i0;
+        const float* old = snapshot + (j - j0) * width;
+
+        int changed = 0;
+#ifdef USE_OPENMP
+#pragma omp simd reduction(|:changed)
+#endif
+        for (int i = 0; i < width; i++) {
+            changed |= (fabsf(row[i] - old[i]) > TileTolerance) | ((row[i] > level) != (old[i] > level));
+        }
+
+        if (changed) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 ContourPlot::~ContourPlot() {
@@ -41,6 +333,13 @@ ContourPlot::~ContourPlot() {
 bool ContourPlot::Init(GLuint p) {
     program = p;
 
+    // Initial segments fit lines of a 64x64 grid, streams grow on demand
+    if (!vertexStream.Init(64 * 64 * 2 * sizeof(HMM_Vec2)) ||
+        !indexStream.Init(64 * 64 * 4 * sizeof(GLuint))) {
+        LOGE << "Unable to initialize stream buffers for parallel contour plot";
+        return false;
+    }
+
     glGenVertexArrays(1, &vao); LOGOPENGLERROR();
     if (!vao) {
         LOGE << "Failed to create vertex array object";
@@ -48,17 +347,9 @@ bool ContourPlot::Init(GLuint p) {
     }
     glBindVertexArray(vao); LOGOPENGLERROR();
 
-    glGenBuffers(1, &vbo); LOGOPENGLERROR();
-    if (!vbo) {
-        LOGE << "Unable to initialize VBO for parallel contour plot";
-        return false;
-    }
-    glBindBuffer(GL_ARRAY_BUFFER, vbo); LOGOPENGLERROR();
-
-    GLint a_coord = glGetAttribLocation(program, "coord"); LOGOPENGLERROR();
+    a_coord = glGetAttribLocation(program, "coord"); LOGOPENGLERROR();
 
     glEnableVertexAttribArray(a_coord); LOGOPENGLERROR();
-    glVertexAttribPointer(a_coord, 2, GL_FLOAT, GL_FALSE, 0, 0); LOGOPENGLERROR();
 
     glBindVertexArray(0); LOGOPENGLERROR();
 
@@ -76,11 +367,335 @@ bool ContourPlot::Init(GLuint p) {
     return true;
 }
 
-void ContourPlot::Release() {
-    if (vbo) {
-        glDeleteBuffers(1, &vbo); LOGOPENGLERROR();
-        vbo = 0;
+bool ContourPlot::Update(const matrix_t* points, const HMM_Vec4& area, double t) {
+    threshold = t;
+
+    this->area = area;
+
+    if (!Build(points, area, t, updateMesh)) {
+        return false;
+    }
+
+    Upload(updateMesh);
+
+    return true;
+}
+
+bool ContourPlot::Build(const matrix_t* points, const HMM_Vec4& area, double t,
+                        contour_mesh_t& mesh) const {
+    const int xdiv = points->cols - 1;
+    const int ydiv = points->rows - 1;
+
+    const float level = static_cast<float>(t);
+
+    const int tilesX = (std::max(xdiv, 0) + TileSize - 1) / TileSize;
+    const int tilesY = (std::max(ydiv, 0) + TileSize - 1) / TileSize;
+    const int tiles = tilesX * tilesY;
+
+    // Every tile is marched after a change of the grid or the level
+    const bool rebuild = cache.rows != points->rows || cache.cols != points->cols ||
+        cache.threshold != t ||
+        cache.area.X != area.X || cache.area.Y != area.Y ||
+        cache.area.Z != area.Z || cache.area.W != area.W;
+    if (rebuild) {
+        cache.rows = points->rows;
+        cache.cols = points->cols;
+        cache.area = area;
+        cache.threshold = t;
+
+        cache.tiles.assign(tiles, contour_tile_t());
+        cache.values.resize(tiles * TileValues);
+        cache.vertices.resize(tiles);
+        cache.indices.resize(tiles);
+    }
+
+    const uint64_t version = ++cache.version;
+
+    // --------------------------------------------------------
+    // March tiles with changed values
+    int marched = 0;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:marched)
+#endif
+    for (int tile = 0; tile < tiles; tile++) {
+        const int i0 = (tile % tilesX) * TileSize;
+        const int j0 = (tile / tilesX) * TileSize;
+        const int i1 = std::min(i0 + TileSize, xdiv);
+        const int j1 = std::min(j0 + TileSize, ydiv);
+
+        float* snapshot = cache.values.data() + tile * TileValues;
+        if (!rebuild && !TileChanged(points, level, i0, j0, i1, j1, snapshot)) {
+            continue;
+        }
+
+        for (int j = j0; j <= j1; j++) {
+            const float* row = points->data + j * points->cols + i0;
+            std::copy(row, row + (i1 - i0 + 1), snapshot + (j - j0) * (i1 - i0 + 1));
+        }
+
+        MarchTile(points, area, level, fill, i0, j0, i1, j1, cache.vertices[tile], cache.indices[tile]);
+
+        cache.tiles[tile].vertexCount = static_cast<GLuint>(cache.vertices[tile].size());
+        cache.tiles[tile].indexCount = static_cast<GLuint>(cache.indices[tile].size());
+        cache.tiles[tile].version = version;
+        marched++;
     }
+
+    // --------------------------------------------------------
+    // Offsets of the tiles in the mesh. Tiles of the last upload and earlier
+    // are in the buffers already, meshes that were skipped are covered since
+    // their tiles are newer than the last upload too
+    const uint64_t baseVersion = uploadedVersion.load();
+
+    GLuint vertices = 0, indices = 0;
+    int copied = 0;
+    for (contour_tile_t& tile : cache.tiles) {
+        tile.firstVertex = vertices;
+        tile.firstIndex = indices;
+        if (tile.version > baseVersion) {
+            vertices += tile.vertexCount;
+            indices += tile.indexCount;
+            copied++;
+        }
+    }
+
+    mesh.tiles = cache.tiles;
+    mesh.version = version;
+    mesh.baseVersion = baseVersion;
+    mesh.vertices.resize(vertices);
+    mesh.indices.resize(indices);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (int tile = 0; tile < tiles; tile++) {
+        if (cache.tiles[tile].version <= baseVersion) {
+            continue;
+        }
+        std::copy(cache.vertices[tile].begin(), cache.vertices[tile].end(),
+            mesh.vertices.begin() + cache.tiles[tile].firstVertex);
+        std::copy(cache.indices[tile].begin(), cache.indices[tile].end(),
+            mesh.indices.begin() + cache.tiles[tile].firstIndex);
+    }
+
+    LOGD << "Created parallel " << (fill ? "filled" : "line") << " contour with "
+         << mesh.indices.size() / (fill ? 3 : 2) << (fill ? " triangles and " : " lines and ")
+         << mesh.vertices.size() << " vertices, " << marched << " of " << tiles << " tiles marched, "
+         << copied << " copied";
+
+    return true;
+}
+
+void ContourPlot::Upload(const contour_mesh_t& mesh) {
+    if (!mesh.tiles.empty()) {
+        UploadTiles(mesh);
+        return;
+    }
+
+    tiled = false;
+
+    HMM_Vec2* vertices = nullptr;
+    GLuint* indices = nullptr;
+    if (!MapStreams(mesh.vertices.size(), mesh.indices.size(), &vertices, &indices) || !vertices) {
+        return;
+    }
+
+    memcpy(vertices, mesh.vertices.data(), sizeof(mesh.vertices[0]) * mesh.vertices.size());
+    if (indices) {
+        memcpy(indices, mesh.indices.data(), sizeof(mesh.indices[0]) * mesh.indices.size());
+    }
+
+    UnmapStreams();
+}
+
+void ContourPlot::UploadTiles(const contour_mesh_t& mesh) {
+    tiled = true;
+
+    // --------------------------------------------------------
+    // Ranges of the tiles are laid out again with spare room when a tile
+    // doesn't fit. Tiles that aren't in the mesh are copied from the previous
+    // buffers, the rest are written below
+    bool layout = tileSlots.size() != mesh.tiles.size();
+    for (size_t tile = 0; !layout && tile < mesh.tiles.size(); tile++) {
+        layout = mesh.tiles[tile].vertexCount > tileSlots[tile].vertexCapacity ||
+            mesh.tiles[tile].indexCount > tileSlots[tile].indexCapacity;
+    }
+
+    if (layout) {
+        std::vector<tile_slot_t> oldSlots;
+        oldSlots.swap(tileSlots);
+        GraphicsUtils::unique_buffer oldVertexBuffer, oldIndexBuffer;
+        oldVertexBuffer.swap(tileVertexBuffer);
+        oldIndexBuffer.swap(tileIndexBuffer);
+
+        tileSlots.resize(mesh.tiles.size());
+
+        GLuint vertices = 0, indices = 0;
+        for (size_t tile = 0; tile < mesh.tiles.size(); tile++) {
+            tile_slot_t& slot = tileSlots[tile];
+            slot.firstVertex = vertices;
+            slot.vertexCapacity = mesh.tiles[tile].vertexCount * 5 / 4 + TileSize;
+            slot.firstIndex = indices;
+            slot.indexCapacity = mesh.tiles[tile].indexCount * 5 / 4 + TileSize * (fill ? 6 : 2);
+            slot.version = 0;
+
+            vertices += slot.vertexCapacity;
+            indices += slot.indexCapacity;
+        }
+
+        glGenBuffers(1, tileVertexBuffer.put()); LOGOPENGLERROR();
+        glGenBuffers(1, tileIndexBuffer.put()); LOGOPENGLERROR();
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, static_cast<GLuint>(tileVertexBuffer)); LOGOPENGLERROR();
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(HMM_Vec2) * vertices, nullptr, GL_DYNAMIC_DRAW); LOGOPENGLERROR();
+        if (oldVertexBuffer && oldSlots.size() == tileSlots.size()) {
+            glBindBuffer(GL_COPY_READ_BUFFER, static_cast<GLuint>(oldVertexBuffer)); LOGOPENGLERROR();
+            for (size_t tile = 0; tile < mesh.tiles.size(); tile++) {
+                if (oldSlots[tile].version == mesh.tiles[tile].version && mesh.tiles[tile].vertexCount > 0) {
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        sizeof(HMM_Vec2) * oldSlots[tile].firstVertex, sizeof(HMM_Vec2) * tileSlots[tile].firstVertex,
+                        sizeof(HMM_Vec2) * mesh.tiles[tile].vertexCount); LOGOPENGLERROR();
+                }
+            }
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, static_cast<GLuint>(tileIndexBuffer)); LOGOPENGLERROR();
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * indices, nullptr, GL_DYNAMIC_DRAW); LOGOPENGLERROR();
+        if (oldIndexBuffer && oldSlots.size() == tileSlots.size()) {
+            glBindBuffer(GL_COPY_READ_BUFFER, static_cast<GLuint>(oldIndexBuffer)); LOGOPENGLERROR();
+            for (size_t tile = 0; tile < mesh.tiles.size(); tile++) {
+                if (oldSlots[tile].version == mesh.tiles[tile].version && mesh.tiles[tile].indexCount > 0) {
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        sizeof(GLuint) * oldSlots[tile].firstIndex, sizeof(GLuint) * tileSlots[tile].firstIndex,
+                        sizeof(GLuint) * mesh.tiles[tile].indexCount); LOGOPENGLERROR();
+                    tileSlots[tile].version = oldSlots[tile].version;
+                }
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, 0); LOGOPENGLERROR();
+        }
+
+        LOGD << "Laid out " << mesh.tiles.size() << " contour tiles";
+    }
+
+    // --------------------------------------------------------
+    // Changed tiles
+    glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(tileVertexBuffer)); LOGOPENGLERROR();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, static_cast<GLuint>(tileIndexBuffer)); LOGOPENGLERROR();
+
+    tileCounts.clear();
+    tileIndexOffsets.clear();
+    tileBaseVertices.clear();
+
+    for (size_t tile = 0; tile < mesh.tiles.size(); tile++) {
+        const contour_tile_t& meshTile = mesh.tiles[tile];
+        tile_slot_t& slot = tileSlots[tile];
+
+        if (slot.version != meshTile.version && meshTile.version > mesh.baseVersion && meshTile.indexCount > 0) {
+            glBufferSubData(GL_ARRAY_BUFFER, sizeof(HMM_Vec2) * slot.firstVertex,
+                sizeof(HMM_Vec2) * meshTile.vertexCount,
+                mesh.vertices.data() + meshTile.firstVertex); LOGOPENGLERROR();
+            glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * slot.firstIndex,
+                sizeof(GLuint) * meshTile.indexCount,
+                mesh.indices.data() + meshTile.firstIndex); LOGOPENGLERROR();
+        }
+        slot.version = meshTile.version;
+
+        if (meshTile.indexCount > 0) {
+            tileCounts.push_back(static_cast<GLsizei>(meshTile.indexCount));
+            tileIndexOffsets.push_back(reinterpret_cast<const void*>(sizeof(GLuint) * slot.firstIndex));
+            tileBaseVertices.push_back(static_cast<GLint>(slot.firstVertex));
+        }
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0); LOGOPENGLERROR();
+
+    BindBuffers(static_cast<GLuint>(tileVertexBuffer), static_cast<GLuint>(tileIndexBuffer));
+
+    uploadedVersion = mesh.version;
+}
+
+bool ContourPlot::MapStreams(size_t vertices, size_t indices, HMM_Vec2** vertexData, GLuint** indexData) {
+    vbo_count = 0;
+    ebo_count = 0;
+
+    if (vertices == 0) {
+        return true;
+    }
+
+    *vertexData = static_cast<HMM_Vec2*>(vertexStream.Map(sizeof(HMM_Vec2) * vertices));
+    if (!*vertexData) {
+        return false;
+    }
+
+    if (indices > 0) {
+        *indexData = static_cast<GLuint*>(indexStream.Map(sizeof(GLuint) * indices));
+        if (!*indexData) {
+            vertexStream.Unmap();
+            return false;
+        }
+    }
+
+    vbo_count = vertices;
+    ebo_count = indices;
+
+    return true;
+}
+
+void ContourPlot::UnmapStreams() {
+    vertexOffset = vertexStream.Unmap();
+    if (ebo_count > 0) {
+        indexOffset = indexStream.Unmap();
+    }
+
+    // Streams may have been recreated to fit the data
+    BindBuffers(vertexStream.GetBuffer(), indexStream.GetBuffer());
+}
+
+void ContourPlot::BindBuffers(GLuint vertexBuffer, GLuint indexBuffer) {
+    glBindVertexArray(vao); LOGOPENGLERROR();
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer); LOGOPENGLERROR();
+    glVertexAttribPointer(a_coord, 2, GL_FLOAT, GL_FALSE, 0, 0); LOGOPENGLERROR();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer); LOGOPENGLERROR();
+    glBindVertexArray(0); LOGOPENGLERROR();
+}
+
+void ContourPlot::Draw(GLenum mode) {
+    if (tiled) {
+        if (!tileCounts.empty()) {
+            glMultiDrawElementsBaseVertex(mode, tileCounts.data(), GL_UNSIGNED_INT,
+                tileIndexOffsets.data(), static_cast<GLsizei>(tileCounts.size()),
+                tileBaseVertices.data()); LOGOPENGLERROR();
+        }
+        return;
+    }
+
+    if (vbo_count == 0) {
+        return;
+    }
+
+    const GLint baseVertex = static_cast<GLint>(vertexOffset / sizeof(HMM_Vec2));
+
+    if (ebo_count > 0) {
+        glDrawElementsBaseVertex(mode, ebo_count, GL_UNSIGNED_INT,
+            reinterpret_cast<const void*>(indexOffset), baseVertex); LOGOPENGLERROR();
+        indexStream.Fence();
+    }
+    else {
+        glDrawArrays(mode, baseVertex, vbo_count); LOGOPENGLERROR();
+    }
+    vertexStream.Fence();
+}
+
+void ContourPlot::Release() {
+    vertexStream.Release();
+    indexStream.Release();
+
+    tileVertexBuffer.reset();
+    tileIndexBuffer.reset();
+    tileSlots.clear();
+    uploadedVersion = 0;
+    tiled = false;
     if (vao) {
         glDeleteVertexArrays(1, &vao); LOGOPENGLERROR();
         vao = 0;
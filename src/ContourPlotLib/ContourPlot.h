@@ -1,69 +1,97 @@
 #pragma once
 
 /*
- * Flags for corners of a marching square
+ * Flags for corners of a marching square above the level. Sum of the flags
+ * is the case code of the square. Numeration of the values is clock-wise
+ * from the bottom left corner of a square:
+ * (1)---(2)
+ *  |     |
+ *  |     |
+ * (0)---(3)
  */
 enum class SquareFlags : int {
     None = 0,
 
-    SouthWest = (1 << 1),
-    NorthWest = (1 << 2),
-    NorthEast = (1 << 3),
-    SouthEast = (1 << 4),
+    SouthWest = (1 << 0), // (0)
+    NorthWest = (1 << 1), // (1)
+    NorthEast = (1 << 2), // (2)
+    SouthEast = (1 << 3), // (3)
 
     All = (SouthEast | NorthEast | NorthWest | SouthWest)
 };
 
-SquareFlags operator|(SquareFlags lhs, SquareFlags rhs);
-SquareFlags& operator|=(SquareFlags& lhs, SquareFlags rhs);
-SquareFlags operator^(SquareFlags lhs, SquareFlags rhs);
-SquareFlags& operator^=(SquareFlags& lhs, SquareFlags rhs);
-
 /*
- * Structure with values of a marching cube.
- * Numeration is clock-wise from the bottom left corner of a square:
- * (1)---(2)
- *  |     |
- *  |     |
- * (0)---(3)
+ * Case codes of the squares between two rows of the grid
  */
-struct vals_t {
-    double v[4];
-};
+void SquareCaseCodes(const float* row0, const float* row1, size_t squares, float t, uint8_t* codes);
 
-/*
- * Structure with coordinate and size of a marching square
- */
-struct discrete_t {
-    double x;
-    double y;
-    double sx;
-    double sy;
-};
+using vertices_t = std::vector<HMM_Vec2>;
+using indices_t = std::vector<GLuint>;
 
 /*
- * Calculate marching square flags from its values
+ * Range of a tile in a contour mesh. Indices of a tile are numbered from its
+ * first vertex, version changes every time the tile is marched again. Only
+ * tiles with a version above the base version of the mesh have a range
  */
-SquareFlags CellType(vals_t vals);
+struct contour_tile_t {
+    GLuint firstVertex = 0;
+    GLuint vertexCount = 0;
+    GLuint firstIndex = 0;
+    GLuint indexCount = 0;
+    uint64_t version = 0;
+};
 
 /*
- * Linear interpolation between values of nodes i1 and i2 of a marching square
+ * Geometry of a contour plot. Line plots store two indices per segment,
+ * filled plots store three indices per triangle. Crossings of the level and
+ * corners of the grid are vertices shared by the squares around them.
+ * A mesh without tiles has indices of the whole mesh, a mesh without
+ * indices is drawn from its vertices in order. A tiled mesh only has the
+ * geometry of tiles that changed since the mesh of its base version was
+ * uploaded.
  */
-double ValuesRatio(vals_t vals, size_t i1, size_t i2);
-
-using triangles_t = std::vector<HMM_Vec2>;
-using lines_t = std::vector<HMM_Vec4>;
+struct contour_mesh_t {
+    vertices_t vertices;
+    indices_t indices;
+    std::vector<contour_tile_t> tiles;
+    uint64_t version = 0;
+    uint64_t baseVersion = 0;
+};
 
 /*****************************************************************************
  * Contour Plot base class
  ****************************************************************************/
 class ContourPlot {
 public:
-    ContourPlot() = default;
+    explicit ContourPlot(bool fill) : fill(fill) { }
     virtual ~ContourPlot();
 
     bool Init(GLuint p);
-    virtual bool Update(matrix_t* /*points*/, const HMM_Vec4& /*area*/, double /*t*/) { return false; }
+
+    /*
+     * Build the geometry of a plot and upload changed tiles. Must be called
+     * from the thread that owns the OpenGL context.
+     */
+    bool Update(const matrix_t* points, const HMM_Vec4& area, double t);
+
+    /*
+     * Build the geometry of a plot into the mesh. Tiles of the grid with
+     * values close to the previous build are taken from the cache of the plot,
+     * and only tiles that changed since the last upload are copied to the mesh.
+     * Doesn't use OpenGL, so it can be called from a worker thread, but only
+     * from one thread at a time.
+     */
+    bool Build(const matrix_t* points, const HMM_Vec4& area, double t, contour_mesh_t& mesh) const;
+
+    /*
+     * Transfer a mesh to buffers of the plot. Tiles that differ from the last
+     * upload are written to their ranges of the buffers. Meshes are uploaded
+     * in the order they were built, and some of them may be skipped. Meshes without tiles
+     * go to the stream buffers. Must be called from the thread that owns the
+     * OpenGL context.
+     */
+    void Upload(const contour_mesh_t& mesh);
+
     virtual void Render(const HMM_Mat4& /*mvp*/, double /*zoom*/, const HMM_Vec2& /*offset*/,
         const FloatColor& /*c*/) { }
 
@@ -71,14 +99,75 @@ public:
     void Resize(int width, int height);
 
 protected:
+    void UploadTiles(const contour_mesh_t& mesh);
+
+    // Maps ranges of the stream buffers for vertices and indices
+    bool MapStreams(size_t vertices, size_t indices, HMM_Vec2** vertexData, GLuint** indexData);
+    void UnmapStreams();
+
+    void BindBuffers(GLuint vertexBuffer, GLuint indexBuffer);
+    void Draw(GLenum mode);
+
+    const bool fill;
+
     int w = 0, h = 0;
     HMM_Vec4 area = { 0.0, 0.0, 0.0, 0.0 };
 
     double threshold = 0.0;
 
+    // Workspace of Update
+    contour_mesh_t updateMesh;
+
+    /*
+     * Geometry of tiles from the previous build with values of the grid it was
+     * built from. Only tiles with changed values are marched again
+     */
+    struct tile_cache_t {
+        size_t rows = 0, cols = 0;
+        HMM_Vec4 area = { 0.0, 0.0, 0.0, 0.0 };
+        double threshold = 0.0;
+
+        uint64_t version = 0;
+        std::vector<contour_tile_t> tiles;
+        std::vector<float> values;
+        std::vector<vertices_t> vertices;
+        std::vector<indices_t> indices;
+    };
+    mutable tile_cache_t cache;
+
+    // Version of the last uploaded mesh, meshes built after it skip the tiles
+    // the buffers already have. Written by Upload and read by Build on a worker
+    std::atomic<uint64_t> uploadedVersion{0};
+
     int vbo_count = 0;
+    int ebo_count = 0;
     GLuint vao = 0;
-    GLuint vbo = 0;
+    GLint a_coord = -1;
+
+    // Meshes without tiles are at offsets in the streams
+    StreamBuffer vertexStream;
+    StreamBuffer indexStream;
+    size_t vertexOffset = 0;
+    size_t indexOffset = 0;
+
+    // Ranges of tiles in the buffers with versions of the uploaded geometry
+    struct tile_slot_t {
+        GLuint firstVertex = 0;
+        GLuint vertexCapacity = 0;
+        GLuint firstIndex = 0;
+        GLuint indexCapacity = 0;
+        uint64_t version = 0;
+    };
+    std::vector<tile_slot_t> tileSlots;
+    GraphicsUtils::unique_buffer tileVertexBuffer;
+    GraphicsUtils::unique_buffer tileIndexBuffer;
+
+    // Draws of non-empty tiles
+    bool tiled = false;
+    std::vector<GLsizei> tileCounts;
+    std::vector<const void*> tileIndexOffsets;
+    std::vector<GLint> tileBaseVertices;
+
     GLuint program = 0;
     GLint u_mvp = -1, u_zoom = -1, u_ofs = -1, u_res = -1, u_color = -1;
 };
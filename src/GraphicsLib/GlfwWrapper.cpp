@@ -6,10 +6,14 @@ GlfwWrapper::~GlfwWrapper() {
     Release();
 }
 
-int GlfwWrapper::Init(const std::string& title, int width, int height) {
+int GlfwWrapper::Init(const std::string& title, int width, int height, bool headless) {
     glfwSetErrorCallback(GlfwWrapper::ErrorCallback);
 
-    if (glfwPlatformSupported(GLFW_PLATFORM_X11) &&
+    if (headless && glfwPlatformSupported(GLFW_PLATFORM_NULL)) {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+        LOGI << "Use null platform without display";
+    }
+    else if (glfwPlatformSupported(GLFW_PLATFORM_X11) &&
             glfwPlatformSupported(GLFW_PLATFORM_WAYLAND)) {
         // Prefer X11 instead of Wayland if both are available
         glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_X11);
@@ -21,15 +25,40 @@ int GlfwWrapper::Init(const std::string& title, int width, int height) {
         return -1;
     }
 
-    LOGI << "Init window context with OpenGL 3.3";
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // Required on Mac
 
     glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, headless ? GLFW_FALSE : GLFW_TRUE);
+
+    // Native API of the null platform is OSMesa, which current Mesa doesn't ship,
+    // so a headless context is created with EGL first
+    std::vector<int> contextApis = { GLFW_NATIVE_CONTEXT_API };
+    if (headless) {
+        contextApis.insert(contextApis.begin(), GLFW_EGL_CONTEXT_API);
+    }
+
+    // OpenGL 4.3 adds compute shaders, rendering itself only needs 3.3
+    for (int contextApi : contextApis) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApi);
+
+        for (const auto& version : { std::make_pair(4, 3), std::make_pair(3, 3) }) {
+            LOGI << "Init window context with OpenGL " << version.first << "." << version.second <<
+                (contextApi == GLFW_EGL_CONTEXT_API ? " through EGL" : "");
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version.first);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version.second);
+
+            window_ = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
+            if (window_ != nullptr) {
+                break;
+            }
+        }
+
+        if (window_ != nullptr) {
+            break;
+        }
+    }
 
-    window_ = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
     if (window_ == nullptr) {
         LOGE << "Cannot create OpenGL 3.3 context";
         return -1;
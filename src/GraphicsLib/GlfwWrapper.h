@@ -4,7 +4,9 @@ struct GlfwWrapper {
     GlfwWrapper() = default;
     ~GlfwWrapper();
     
-    int Init(const std::string& title, int width, int height);
+    // Headless window is hidden and uses the null platform when it is available,
+    // so software drivers get a context without a display
+    int Init(const std::string& title, int width, int height, bool headless = false);
     void Release();
     
     GLFWwindow* GetWindow() const;
@@ -143,3 +143,62 @@ error:
 
     return 0;
 }
+
+GLuint Shader::CreateComputeProgramFromSource(const std::string& compute_shader) {
+#ifdef GL_VERSION_4_3
+    LOGD << "Compute Shader   : " << compute_shader.length() << " symbols";
+
+    GLint result = 0;
+    GLuint cShader = 0;
+    GLuint sProgram = 0;
+
+    const GLchar* computeSource = compute_shader.c_str();
+
+    cShader = glCreateShader(GL_COMPUTE_SHADER); LOGOPENGLERROR();
+    if (!cShader) {
+        LOGE << "Unable to Create Compute Shader";
+        goto error;
+    }
+
+    glShaderSource(cShader, 1, &computeSource, NULL); LOGOPENGLERROR();
+    glCompileShader(cShader); LOGOPENGLERROR();
+    glGetShaderiv(cShader, GL_COMPILE_STATUS, &result); LOGOPENGLERROR();
+    if (!result) {
+        LOGE << "Compute Shader Error : " << GetShaderInfo(cShader);
+        goto error;
+    }
+
+    sProgram = glCreateProgram(); LOGOPENGLERROR();
+    if (!sProgram) {
+        LOGE << "Unable to Create Program";
+        goto error;
+    }
+
+    glAttachShader(sProgram, cShader); LOGOPENGLERROR();
+
+    glLinkProgram(sProgram); LOGOPENGLERROR();
+
+    glGetProgramiv(sProgram, GL_LINK_STATUS, &result); LOGOPENGLERROR();
+    if (!result) {
+        LOGE << "Linking Shader Error : " << GetProgramInfo(sProgram);
+        goto error;
+    }
+
+    glDeleteShader(cShader); LOGOPENGLERROR();
+
+    return sProgram;
+
+error:
+    if (cShader) {
+        glDeleteShader(cShader);
+    }
+
+    glDeleteProgram(sProgram);
+
+    return 0;
+#else
+    (void)compute_shader;
+    LOGE << "Compute shaders are not supported by the OpenGL loader";
+    return 0;
+#endif
+}
@@ -5,4 +5,6 @@ namespace Shader {
             const std::string& vertex_shader, const std::string& fragment_shader);
     GLuint CreateProgramFromSource(
             const std::string& vertex_shader, const std::string& fragment_shader);
+    // Requires OpenGL 4.3 context
+    GLuint CreateComputeProgramFromSource(const std::string& compute_shader);
 }
@@ -0,0 +1,148 @@
+#include "stdafx.h"
+#include "GraphicsUtils.h"
+#include "GraphicsLogger.h"
+#include "GraphicsResource.h"
+#include "StreamBuffer.h"
+
+// Segments start at offsets suitable for any vertex data and mapping
+constexpr size_t SegmentAlignment = 64;
+
+// Timeout of a single wait for a fence in nanoseconds
+constexpr GLuint64 FenceTimeout = 1000000;
+
+StreamBuffer::~StreamBuffer() {
+    Release();
+}
+
+bool StreamBuffer::Init(size_t segmentSize) {
+    orphaning = false;
+    return Create(segmentSize);
+}
+
+void StreamBuffer::Release() {
+    for (GLsync& fence : fences) {
+        if (fence) {
+            glDeleteSync(fence); LOGOPENGLERROR();
+            fence = nullptr;
+        }
+    }
+
+    // Deletion of the buffer unmaps the persistent storage
+    persistent = nullptr;
+    buffer.reset();
+
+    segmentSize = 0;
+    segment = 0;
+}
+
+bool StreamBuffer::Create(size_t newSegmentSize) {
+    Release();
+
+    segmentSize = (newSegmentSize + SegmentAlignment - 1) / SegmentAlignment * SegmentAlignment;
+    const GLsizeiptr capacity = static_cast<GLsizeiptr>(Segments * segmentSize);
+
+    glGenBuffers(1, buffer.put()); LOGOPENGLERROR();
+    if (!buffer) {
+        LOGE << "Failed to create stream buffer";
+        return false;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, GetBuffer()); LOGOPENGLERROR();
+
+#ifdef GL_VERSION_4_4
+    if (GLAD_GL_VERSION_4_4 && !orphaning) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, nullptr, flags); LOGOPENGLERROR();
+        persistent = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags); LOGOPENGLERROR();
+        if (!persistent) {
+            LOGW << "Failed to map stream buffer persistently, buffer will be orphaned";
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0); LOGOPENGLERROR();
+            orphaning = true;
+            return Create(newSegmentSize);
+        }
+    }
+#endif
+
+    if (!persistent) {
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STREAM_DRAW); LOGOPENGLERROR();
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0); LOGOPENGLERROR();
+
+    // The first Map() starts from the beginning of the buffer
+    segment = Segments - 1;
+
+    return true;
+}
+
+void* StreamBuffer::Map(size_t size) {
+    if (size > segmentSize) {
+        // Draws still use the old buffer until they are finished
+        if (!Create(std::max(size, 2 * segmentSize))) {
+            return nullptr;
+        }
+    }
+
+    segment = (segment + 1) % Segments;
+    const size_t offset = segment * segmentSize;
+
+    if (persistent) {
+        GLsync& fence = fences[segment];
+        if (fence) {
+            GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            GLenum status = GL_TIMEOUT_EXPIRED;
+            while (status == GL_TIMEOUT_EXPIRED) {
+                status = glClientWaitSync(fence, flags, FenceTimeout); LOGOPENGLERROR();
+                flags = 0;
+            }
+            if (status == GL_WAIT_FAILED) {
+                LOGE << "Failed to wait for draws from stream buffer";
+            }
+
+            glDeleteSync(fence); LOGOPENGLERROR();
+            fence = nullptr;
+        }
+
+        return static_cast<char*>(persistent) + offset;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, GetBuffer()); LOGOPENGLERROR();
+
+    if (segment == 0) {
+        // Draws of the previous round keep the old storage
+        glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(Segments * segmentSize),
+            nullptr, GL_STREAM_DRAW); LOGOPENGLERROR();
+    }
+
+    void* data = glMapBufferRange(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(offset),
+        static_cast<GLsizeiptr>(size),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT); LOGOPENGLERROR();
+    if (!data) {
+        LOGE << "Failed to map stream buffer";
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0); LOGOPENGLERROR();
+
+    return data;
+}
+
+size_t StreamBuffer::Unmap() {
+    if (!persistent) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, GetBuffer()); LOGOPENGLERROR();
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER); LOGOPENGLERROR();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0); LOGOPENGLERROR();
+    }
+
+    return segment * segmentSize;
+}
+
+void StreamBuffer::Fence() {
+    if (!persistent) {
+        return;
+    }
+
+    GLsync& fence = fences[segment];
+    if (fence) {
+        glDeleteSync(fence); LOGOPENGLERROR();
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); LOGOPENGLERROR();
+}
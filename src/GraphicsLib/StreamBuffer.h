@@ -0,0 +1,51 @@
+#pragma once
+
+/*****************************************************************************
+ * StreamBuffer - buffer object for data that is replaced every frame
+ *
+ * The buffer is a ring of segments and every Map() writes the next one.
+ * With OpenGL 4.4 the storage is immutable and mapped persistently, a segment
+ * is reused once the fence after the draws that read it is signaled.
+ * Otherwise the buffer is orphaned when the ring wraps and segments are
+ * mapped without synchronization.
+ ****************************************************************************/
+class StreamBuffer {
+public:
+    StreamBuffer() = default;
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    bool Init(size_t segmentSize);
+    void Release();
+
+    GLuint GetBuffer() const { return static_cast<GLuint>(buffer); }
+    bool IsPersistent() const { return persistent != nullptr; }
+
+    // Next segment for writing of a positive size in bytes. The storage grows
+    // when the data doesn't fit, so the buffer object may change after the call
+    void* Map(size_t size);
+    // Finishes writing, returns offset of the segment in the buffer
+    size_t Unmap();
+
+    // Marks the end of draws that read the current segment
+    void Fence();
+
+private:
+    bool Create(size_t newSegmentSize);
+
+private:
+    static constexpr size_t Segments = 3;
+
+    GraphicsUtils::unique_buffer buffer;
+    size_t segmentSize = 0;
+    size_t segment = 0;
+
+    // Persistently mapped storage and fences of its segments
+    void* persistent = nullptr;
+    std::array<GLsync, Segments> fences = {};
+
+    // Persistent mapping failed once, only orphaning is used
+    bool orphaning = false;
+};
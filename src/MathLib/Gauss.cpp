@@ -10,7 +10,7 @@ float gfunc(float x, float sigma) {
     return expf(-0.5 * x * x / s);
 }
 
-static size_t normalize_index(int p, size_t i_size, KernelMode mode) {
+size_t normalize_index(int p, size_t i_size, KernelMode mode) {
     int n = p;
     int size = static_cast<int>(i_size);
 
@@ -80,6 +80,12 @@ void kernel_free(kernel_t* k) {
 }
 
 kernel_t* kernel_create(float sigma, KernelMode mode) {
+    // Sigma of a negative or zero k or m is NaN or infinite
+    if (!std::isfinite(sigma) || sigma <= 0.0f) {
+        LOGE << "kernel invalid sigma error";
+        return nullptr;
+    }
+
     int lw = (int)(4.0 * sigma + 0.5);
     int k_size = lw * 2 + 1;
     if (k_size <= 0) {
@@ -88,6 +94,7 @@ kernel_t* kernel_create(float sigma, KernelMode mode) {
     }
     
     kernel_t* k = kernel_alloc(k_size);
+    k->sigma = sigma;
     k->mode = mode;
 
     float s = 1.0;
@@ -15,6 +15,8 @@ struct kernel_t {
 
 using KernelGuard_t = std::unique_ptr<kernel_t, std::function<void(kernel_t*)>>;
 
+size_t normalize_index(int p, size_t i_size, KernelMode mode);
+
 kernel_t* kernel_alloc(size_t size);
 void kernel_free(kernel_t* k);
 
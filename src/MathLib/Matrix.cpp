@@ -20,7 +20,11 @@ matrix_t* matrix_allocate(size_t rows, size_t cols) {
     m->rows = rows;
     m->cols = cols;
     m->dataSize = rows * cols;
-    m->data = new float[m->dataSize];
+
+    constexpr size_t CacheLineSize = 64;
+    size_t bytes = ((sizeof(float) * m->dataSize + CacheLineSize - 1) / CacheLineSize) * CacheLineSize;
+    m->data = static_cast<float*>(::operator new[](std::max(bytes, CacheLineSize),
+        std::align_val_t(MatrixDataAlignment)));
     return m;
 }
 
@@ -28,7 +32,7 @@ void matrix_free(matrix_t* m) {
     assert(m);
     assert(m->data);
     if (m->data) {
-        delete[] m->data;
+        ::operator delete[](m->data, std::align_val_t(MatrixDataAlignment));
     }
     delete m;
 }
@@ -48,6 +52,23 @@ matrix_t* matrix_set(matrix_t* a, size_t row, size_t col, double val) {
     return a;
 }
 
+matrix_t* matrix_copy(matrix_t* dst, const matrix_t* src) {
+    assert(dst);
+    assert(dst->data);
+    assert(src);
+    assert(src->data);
+    if (dst->rows != src->rows) {
+        LOGE << "Matrix ROWS Error";
+        return dst;
+    }
+    if (dst->cols != src->cols) {
+        LOGE << "Matrix COLUMNS Error";
+        return dst;
+    }
+    memcpy(dst->data, src->data, sizeof(float) * src->dataSize);
+    return dst;
+}
+
 /*****************************************************************************
  * Matrix algebra
  ****************************************************************************/
@@ -7,12 +7,17 @@ struct matrix_t {
     float* data;
 };
 
+// Data of matrices starts at a page boundary and spans whole cache lines, so
+// OpenCL buffers can be created over it without copies
+constexpr size_t MatrixDataAlignment = 4096;
+
 using MatrixGuard_t = std::unique_ptr<matrix_t, std::function<void(matrix_t*)>>;
 
 matrix_t* matrix_allocate(size_t rows, size_t cols);
 void matrix_free(matrix_t* m);
 
 matrix_t* matrix_set(matrix_t* a, size_t row, size_t col, double val);
+matrix_t* matrix_copy(matrix_t* dst, const matrix_t* src);
 
 matrix_t* matrix_scalar_set(matrix_t* a, double h);
 matrix_t* matrix_scalar_add(matrix_t* a, double h);
@@ -2,7 +2,10 @@
 
 #include <plog/Log.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <new>
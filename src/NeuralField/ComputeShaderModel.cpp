@@ -0,0 +1,628 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "GraphicsLogger.h"
+#include "GraphicsResource.h"
+#include "Shader.h"
+#include "NeuralFieldModel.h"
+#include "ComputeShaderModel.h"
+
+#ifdef GL_VERSION_4_3
+
+// Side of square work-groups of the shaders
+constexpr GLuint ComputeGroupSize = 16;
+
+// Steps before the measurement, they include lazy compilation in the driver
+static const int BenchmarkWarmupSteps = 2;
+
+/*
+ * Work-group layout and border handling shared by the shaders, same as
+ * normalize_index on CPU
+ */
+static const std::string ShaderHeaderSource = R"glsl(#version 430 core
+
+layout(local_size_x = )glsl" + std::to_string(ComputeGroupSize) + ", local_size_y = " +
+    std::to_string(ComputeGroupSize) + R"glsl() in;
+
+#define MODE_WRAP 0
+#define MODE_REFLECT 1
+#define MODE_MIRROR 2
+
+int normalize_index(int n, int size, int mode)
+{
+    switch (mode) {
+    case MODE_WRAP:
+        if (n < 0) {
+            n = size - ((-n) % size);
+        }
+        if (n >= size) {
+            n %= size;
+        }
+        break;
+
+    case MODE_REFLECT:
+        while (n < 0 || n >= size) {
+            if (n == -1) {
+                n = 0;
+            }
+            if (n < -1) {
+                n = 1;
+            }
+            if (n == size) {
+                n = size - 2;
+            }
+            if (n > size) {
+                n = size - 3;
+            }
+        }
+        break;
+
+    case MODE_MIRROR:
+        while (n < 0 || n >= size) {
+            if (n < 0) {
+                n = -n;
+            }
+            if (n == size) {
+                n = 2 * size - n - 1;
+            }
+            if (n > size) {
+                n = 2 * size - n;
+            }
+        }
+        break;
+    }
+
+    return n;
+}
+
+float heaviside(float v)
+{
+    return (v > 0.0) ? 1.0 : 0.0;
+}
+)glsl";
+
+/*
+ * Horizontal step shader. Heaviside of activity is blurred along rows with
+ * both kernels, taps are summed in the same order as in kernel_apply_to_matrix
+ */
+static const std::string HorizontalStepShaderSource = ShaderHeaderSource + R"glsl(
+layout(std430, binding = 0) readonly buffer ActivityBuffer { float activity[]; };
+layout(std430, binding = 1) readonly buffer ExcitementKernelBuffer { float excitementKernel[]; };
+layout(std430, binding = 2) readonly buffer InhibitionKernelBuffer { float inhibitionKernel[]; };
+layout(std430, binding = 3) writeonly buffer ExcitementBuffer { float excitement[]; };
+layout(std430, binding = 4) writeonly buffer InhibitionBuffer { float inhibition[]; };
+
+uniform int n;
+uniform int mode;
+uniform int excitementSize;
+uniform int inhibitionSize;
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= n || p.y >= n) {
+        return;
+    }
+
+    int row = p.y * n;
+
+    precise float e = 0.0;
+    for (int k = 0; k < excitementSize; k++) {
+        int col = normalize_index(p.x + k - excitementSize / 2, n, mode);
+        e += heaviside(activity[row + col]) * excitementKernel[k];
+    }
+
+    precise float i = 0.0;
+    for (int k = 0; k < inhibitionSize; k++) {
+        int col = normalize_index(p.x + k - inhibitionSize / 2, n, mode);
+        i += heaviside(activity[row + col]) * inhibitionKernel[k];
+    }
+
+    excitement[row + p.x] = e;
+    inhibition[row + p.x] = i;
+}
+)glsl";
+
+/*
+ * Vertical step shader. Columns of both horizontal passes are blurred and
+ * summed into the new activity
+ */
+static const std::string VerticalStepShaderSource = ShaderHeaderSource + R"glsl(
+layout(std430, binding = 0) readonly buffer ExcitementBuffer { float excitement[]; };
+layout(std430, binding = 1) readonly buffer InhibitionBuffer { float inhibition[]; };
+layout(std430, binding = 2) readonly buffer ExcitementKernelBuffer { float excitementKernel[]; };
+layout(std430, binding = 3) readonly buffer InhibitionKernelBuffer { float inhibitionKernel[]; };
+layout(std430, binding = 4) readonly buffer StimulusBuffer { float stimulus[]; };
+layout(std430, binding = 5) writeonly buffer ActivityBuffer { float activity[]; };
+
+uniform int n;
+uniform int mode;
+uniform int excitementSize;
+uniform int inhibitionSize;
+uniform float h;
+uniform float pik;
+uniform float pim;
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= n || p.y >= n) {
+        return;
+    }
+
+    precise float e = 0.0;
+    for (int k = 0; k < excitementSize; k++) {
+        int row = normalize_index(p.y + k - excitementSize / 2, n, mode);
+        e += excitement[row * n + p.x] * excitementKernel[k];
+    }
+
+    precise float i = 0.0;
+    for (int k = 0; k < inhibitionSize; k++) {
+        int row = normalize_index(p.y + k - inhibitionSize / 2, n, mode);
+        i += inhibition[row * n + p.x] * inhibitionKernel[k];
+    }
+
+    int idx = p.y * n + p.x;
+    precise float a = h + e * pik - i * pim + stimulus[idx];
+    activity[idx] = a;
+}
+)glsl";
+
+/*
+ * Texture pass shader. One direction of the texture blur, the first pass
+ * takes Heaviside of activity
+ */
+static const std::string TexturePassShaderSource = ShaderHeaderSource + R"glsl(
+layout(std430, binding = 0) readonly buffer SourceBuffer { float src[]; };
+layout(std430, binding = 1) readonly buffer KernelBuffer { float blurKernel[]; };
+layout(std430, binding = 2) writeonly buffer DestinationBuffer { float dst[]; };
+
+uniform int n;
+uniform int mode;
+uniform int kernelSize;
+uniform int vertical;
+uniform int threshold;
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= n || p.y >= n) {
+        return;
+    }
+
+    precise float d = 0.0;
+    for (int k = 0; k < kernelSize; k++) {
+        float v;
+        if (vertical != 0) {
+            v = src[normalize_index(p.y + k - kernelSize / 2, n, mode) * n + p.x];
+        }
+        else {
+            v = src[p.y * n + normalize_index(p.x + k - kernelSize / 2, n, mode)];
+        }
+        if (threshold != 0) {
+            v = heaviside(v);
+        }
+        d += v * blurKernel[k];
+    }
+
+    dst[p.y * n + p.x] = d;
+}
+)glsl";
+
+static bool CreateStorageBuffer(GraphicsUtils::unique_buffer& buffer, size_t bytes) {
+    glGenBuffers(1, buffer.put()); LOGOPENGLERROR();
+    if (!buffer) {
+        return false;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(buffer)); LOGOPENGLERROR();
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY); LOGOPENGLERROR();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); LOGOPENGLERROR();
+
+    return true;
+}
+
+static void UploadKernel(const GraphicsUtils::unique_buffer& buffer, const float* data, size_t size) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(buffer)); LOGOPENGLERROR();
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * size, data, GL_DYNAMIC_DRAW); LOGOPENGLERROR();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); LOGOPENGLERROR();
+}
+
+/*****************************************************************************
+ * ComputeShaderModel
+ ****************************************************************************/
+ComputeShaderModel::~ComputeShaderModel() {
+    Release();
+}
+
+bool ComputeShaderModel::IsSupported() {
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+bool ComputeShaderModel::Init(NeuralFieldModel* model) {
+    Release();
+
+    if (!IsSupported()) {
+        LOGE << "Compute shaders require OpenGL 4.3 context";
+        return false;
+    }
+
+    horizontalStepProgram.reset(Shader::CreateComputeProgramFromSource(HorizontalStepShaderSource));
+    verticalStepProgram.reset(Shader::CreateComputeProgramFromSource(VerticalStepShaderSource));
+    texturePassProgram.reset(Shader::CreateComputeProgramFromSource(TexturePassShaderSource));
+    if (!horizontalStepProgram || !verticalStepProgram || !texturePassProgram) {
+        LOGE << "Failed to create compute shaders for neural field simulation";
+        Release();
+        return false;
+    }
+
+    GLuint program = static_cast<GLuint>(horizontalStepProgram);
+    uHorizontalSize = glGetUniformLocation(program, "n"); LOGOPENGLERROR();
+    uHorizontalMode = glGetUniformLocation(program, "mode"); LOGOPENGLERROR();
+    uHorizontalExcitementSize = glGetUniformLocation(program, "excitementSize"); LOGOPENGLERROR();
+    uHorizontalInhibitionSize = glGetUniformLocation(program, "inhibitionSize"); LOGOPENGLERROR();
+
+    program = static_cast<GLuint>(verticalStepProgram);
+    uVerticalSize = glGetUniformLocation(program, "n"); LOGOPENGLERROR();
+    uVerticalMode = glGetUniformLocation(program, "mode"); LOGOPENGLERROR();
+    uVerticalExcitementSize = glGetUniformLocation(program, "excitementSize"); LOGOPENGLERROR();
+    uVerticalInhibitionSize = glGetUniformLocation(program, "inhibitionSize"); LOGOPENGLERROR();
+    uVerticalH = glGetUniformLocation(program, "h"); LOGOPENGLERROR();
+    uVerticalPiK = glGetUniformLocation(program, "pik"); LOGOPENGLERROR();
+    uVerticalPiM = glGetUniformLocation(program, "pim"); LOGOPENGLERROR();
+
+    program = static_cast<GLuint>(texturePassProgram);
+    uTextureSize = glGetUniformLocation(program, "n"); LOGOPENGLERROR();
+    uTextureMode = glGetUniformLocation(program, "mode"); LOGOPENGLERROR();
+    uTextureKernelSize = glGetUniformLocation(program, "kernelSize"); LOGOPENGLERROR();
+    uTextureVertical = glGetUniformLocation(program, "vertical"); LOGOPENGLERROR();
+    uTextureHeaviside = glGetUniformLocation(program, "threshold"); LOGOPENGLERROR();
+
+    // Model is already initialized, continue from its current state
+    model_ = model;
+    if (!UploadState()) {
+        LOGE << "Failed to upload neural field to compute shader buffers";
+        isHostActivityValid = true;
+        Release();
+        return false;
+    }
+
+    LOGI << "Successfully created compute shaders for neural field simulation";
+
+    return true;
+}
+
+void ComputeShaderModel::Release() {
+    if (model_) {
+        // Bring the state back to the host
+        GetActivity();
+        model_ = nullptr;
+    }
+
+    ReleaseBuffers();
+
+    horizontalStepProgram.reset();
+    verticalStepProgram.reset();
+    texturePassProgram.reset();
+
+    isHostActivityValid = true;
+}
+
+bool ComputeShaderModel::InitBuffers() {
+    ReleaseBuffers();
+
+    const size_t bytes = sizeof(GLfloat) * model_->size * model_->size;
+
+    // Buffers are taken with std::addressof, their operator& releases them
+    bool isCreated = true;
+    for (GraphicsUtils::unique_buffer* buffer : {
+        std::addressof(activityBuffer), std::addressof(stimulusBuffer),
+        std::addressof(excitementBuffer), std::addressof(inhibitionBuffer),
+        std::addressof(textureBuffer), std::addressof(textureTempBuffer) }) {
+        isCreated = isCreated && CreateStorageBuffer(*buffer, bytes);
+    }
+
+    // Kernels get their data on upload
+    for (GraphicsUtils::unique_buffer* buffer : {
+        std::addressof(excitementKernelBuffer), std::addressof(inhibitionKernelBuffer),
+        std::addressof(blurKernelBuffer) }) {
+        isCreated = isCreated && CreateStorageBuffer(*buffer, sizeof(GLfloat));
+    }
+
+    if (!isCreated) {
+        LOGE << "Failed to create shader storage buffers";
+        ReleaseBuffers();
+        return false;
+    }
+
+    size = model_->size;
+
+    return true;
+}
+
+void ComputeShaderModel::ReleaseBuffers() {
+    activityBuffer.reset();
+    stimulusBuffer.reset();
+    excitementBuffer.reset();
+    inhibitionBuffer.reset();
+    excitementKernelBuffer.reset();
+    inhibitionKernelBuffer.reset();
+
+    textureBuffer.reset();
+    textureTempBuffer.reset();
+    blurKernelBuffer.reset();
+
+    size = 0;
+}
+
+bool ComputeShaderModel::UploadState() {
+    if (model_->size != size && !InitBuffers()) {
+        return false;
+    }
+
+    const size_t bytes = sizeof(GLfloat) * size * size;
+
+    // Dispatched shaders finish their writes before the update
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT); LOGOPENGLERROR();
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(activityBuffer)); LOGOPENGLERROR();
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, model_->activity->data); LOGOPENGLERROR();
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(stimulusBuffer)); LOGOPENGLERROR();
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, model_->stimulus->data); LOGOPENGLERROR();
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); LOGOPENGLERROR();
+
+    // Kernels change with params of the model
+    UploadKernel(excitementKernelBuffer, model_->excitement_kernel->data, model_->excitement_kernel->size);
+    UploadKernel(inhibitionKernelBuffer, model_->inhibition_kernel->data, model_->inhibition_kernel->size);
+
+    isHostActivityValid = true;
+
+    return true;
+}
+
+void ComputeShaderModel::BindBuffers(std::initializer_list<GLuint> buffers) {
+    // Bindings follow the order of the buffers
+    GLuint binding = 0;
+    for (GLuint buffer : buffers) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding++, buffer); LOGOPENGLERROR();
+    }
+}
+
+void ComputeShaderModel::Dispatch() {
+    const GLuint groups = static_cast<GLuint>((size + ComputeGroupSize - 1) / ComputeGroupSize);
+    glDispatchCompute(groups, groups, 1); LOGOPENGLERROR();
+
+    // Next dispatch reads the results
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT); LOGOPENGLERROR();
+}
+
+void ComputeShaderModel::Stimulate(int steps) {
+    const GLint n = static_cast<GLint>(size);
+    const GLint mode = static_cast<GLint>(model_->mode);
+    const GLint excitementSize = static_cast<GLint>(model_->excitement_kernel->size);
+    const GLint inhibitionSize = static_cast<GLint>(model_->inhibition_kernel->size);
+
+    GLuint horizontal = static_cast<GLuint>(horizontalStepProgram);
+    glProgramUniform1i(horizontal, uHorizontalSize, n); LOGOPENGLERROR();
+    glProgramUniform1i(horizontal, uHorizontalMode, mode); LOGOPENGLERROR();
+    glProgramUniform1i(horizontal, uHorizontalExcitementSize, excitementSize); LOGOPENGLERROR();
+    glProgramUniform1i(horizontal, uHorizontalInhibitionSize, inhibitionSize); LOGOPENGLERROR();
+
+    GLuint vertical = static_cast<GLuint>(verticalStepProgram);
+    glProgramUniform1i(vertical, uVerticalSize, n); LOGOPENGLERROR();
+    glProgramUniform1i(vertical, uVerticalMode, mode); LOGOPENGLERROR();
+    glProgramUniform1i(vertical, uVerticalExcitementSize, excitementSize); LOGOPENGLERROR();
+    glProgramUniform1i(vertical, uVerticalInhibitionSize, inhibitionSize); LOGOPENGLERROR();
+    glProgramUniform1f(vertical, uVerticalH, static_cast<GLfloat>(model_->h)); LOGOPENGLERROR();
+    glProgramUniform1f(vertical, uVerticalPiK, static_cast<GLfloat>(model_->pi_k)); LOGOPENGLERROR();
+    glProgramUniform1f(vertical, uVerticalPiM, static_cast<GLfloat>(model_->pi_m)); LOGOPENGLERROR();
+
+    for (int i = 0; i < steps; i++) {
+        // Excitement, Inhibition = HorizontalBlur(Heaviside(Activity))
+        glUseProgram(horizontal); LOGOPENGLERROR();
+        BindBuffers({ static_cast<GLuint>(activityBuffer),
+            static_cast<GLuint>(excitementKernelBuffer), static_cast<GLuint>(inhibitionKernelBuffer),
+            static_cast<GLuint>(excitementBuffer), static_cast<GLuint>(inhibitionBuffer) });
+        Dispatch();
+
+        // Activity = h + VerticalBlur(Excitement) * piK - VerticalBlur(Inhibition) * piM + Stimulus
+        glUseProgram(vertical); LOGOPENGLERROR();
+        BindBuffers({ static_cast<GLuint>(excitementBuffer), static_cast<GLuint>(inhibitionBuffer),
+            static_cast<GLuint>(excitementKernelBuffer), static_cast<GLuint>(inhibitionKernelBuffer),
+            static_cast<GLuint>(stimulusBuffer), static_cast<GLuint>(activityBuffer) });
+        Dispatch();
+    }
+
+    glUseProgram(0); LOGOPENGLERROR();
+
+    isHostActivityValid = false;
+}
+
+void ComputeShaderModel::Finish() {
+    glFinish(); LOGOPENGLERROR();
+}
+
+void ComputeShaderModel::SetActivity(size_t x, size_t y, float a) {
+    if (y >= size || x >= size) {
+        return;
+    }
+
+    // Write a single value instead of the whole matrix
+    const GLfloat value = a;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT); LOGOPENGLERROR();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(activityBuffer)); LOGOPENGLERROR();
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * (y * size + x), sizeof(value), &value); LOGOPENGLERROR();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); LOGOPENGLERROR();
+
+    matrix_set(model_->activity.get(), y, x, a);
+}
+
+matrix_t* ComputeShaderModel::GetActivity() {
+    matrix_t* activity = model_->activity.get();
+
+    if (!isHostActivityValid) {
+        // Synchronous read of results
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT); LOGOPENGLERROR();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(activityBuffer)); LOGOPENGLERROR();
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLfloat) * activity->dataSize, activity->data); LOGOPENGLERROR();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); LOGOPENGLERROR();
+
+        isHostActivityValid = true;
+    }
+
+    return activity;
+}
+
+void ComputeShaderModel::UpdateTexture(GLuint texture, const kernel_t* blur) {
+    // Without blur a single pass with the unit kernel only takes Heaviside
+    static const GLfloat UnitKernel = 1.0f;
+    if (blur) {
+        UploadKernel(blurKernelBuffer, blur->data, blur->size);
+    }
+    else {
+        UploadKernel(blurKernelBuffer, &UnitKernel, 1);
+    }
+
+    GLuint program = static_cast<GLuint>(texturePassProgram);
+    glProgramUniform1i(program, uTextureSize, static_cast<GLint>(size)); LOGOPENGLERROR();
+    glProgramUniform1i(program, uTextureMode, static_cast<GLint>(blur ? blur->mode : MODE_WRAP)); LOGOPENGLERROR();
+    glProgramUniform1i(program, uTextureKernelSize, static_cast<GLint>(blur ? blur->size : 1)); LOGOPENGLERROR();
+
+    glUseProgram(program); LOGOPENGLERROR();
+
+    // Texture = HorizontalBlur(Heaviside(Activity))
+    glProgramUniform1i(program, uTextureVertical, 0); LOGOPENGLERROR();
+    glProgramUniform1i(program, uTextureHeaviside, 1); LOGOPENGLERROR();
+    BindBuffers({ static_cast<GLuint>(activityBuffer), static_cast<GLuint>(blurKernelBuffer),
+        static_cast<GLuint>(blur ? textureTempBuffer : textureBuffer) });
+    Dispatch();
+
+    if (blur) {
+        // Texture = VerticalBlur(Texture)
+        glProgramUniform1i(program, uTextureVertical, 1); LOGOPENGLERROR();
+        glProgramUniform1i(program, uTextureHeaviside, 0); LOGOPENGLERROR();
+        BindBuffers({ static_cast<GLuint>(textureTempBuffer), static_cast<GLuint>(blurKernelBuffer),
+            static_cast<GLuint>(textureBuffer) });
+        Dispatch();
+    }
+
+    glUseProgram(0); LOGOPENGLERROR();
+
+    // Texture is filled from the buffer on the GPU
+    glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT); LOGOPENGLERROR();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, static_cast<GLuint>(textureBuffer)); LOGOPENGLERROR();
+    glBindTexture(GL_TEXTURE_2D, texture); LOGOPENGLERROR();
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RED, GL_FLOAT, nullptr); LOGOPENGLERROR();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); LOGOPENGLERROR();
+}
+
+double BenchmarkComputeShaders(const NeuralFieldModelParams& params, int steps) {
+    double stepTime = -1.0;
+
+    if (!ComputeShaderModel::IsSupported()) {
+        return stepTime;
+    }
+
+    NeuralFieldModel model;
+    ComputeShaderModel shaders;
+    if (!model.Init(params) || !shaders.Init(&model)) {
+        LOGW << "Unable to benchmark compute shaders";
+        return stepTime;
+    }
+
+    shaders.SetActivity(model.size / 2, model.size / 2, 1.f);
+
+    shaders.Stimulate(BenchmarkWarmupSteps);
+    shaders.GetActivity();
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    shaders.Stimulate(steps);
+    shaders.GetActivity();
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+    stepTime = static_cast<double>(duration.count()) / steps;
+
+    return stepTime;
+}
+
+double CompareComputeShaders(const NeuralFieldModelParams& params, int steps) {
+    if (!ComputeShaderModel::IsSupported()) {
+        LOGE << "Context doesn't support compute shaders";
+        return -1.0;
+    }
+
+    NeuralFieldModel cpuModel, gpuModel;
+    if (!cpuModel.Init(params) || !gpuModel.Init(params)) {
+        return -1.0;
+    }
+
+    // Shaders continue from the state of the model, so it gets the same stimulus first
+    matrix_copy(gpuModel.stimulus.get(), cpuModel.stimulus.get());
+
+    ComputeShaderModel shaders;
+    if (!shaders.Init(&gpuModel)) {
+        return -1.0;
+    }
+
+    cpuModel.SetActivity(cpuModel.size / 2, cpuModel.size / 2, 1.f);
+    shaders.SetActivity(cpuModel.size / 2, cpuModel.size / 2, 1.f);
+
+    cpuModel.Stimulate(steps);
+    shaders.Stimulate(steps);
+
+    const matrix_t* cpuActivity = cpuModel.GetActivity();
+    const matrix_t* gpuActivity = shaders.GetActivity();
+
+    double maxDiff = 0.0;
+    for (size_t idx = 0; idx < cpuActivity->dataSize; idx++) {
+        maxDiff = std::max(maxDiff, static_cast<double>(fabsf(cpuActivity->data[idx] - gpuActivity->data[idx])));
+    }
+
+    return maxDiff;
+}
+
+#else
+
+ComputeShaderModel::~ComputeShaderModel() = default;
+
+// OpenGL loader is generated without compute shaders
+bool ComputeShaderModel::IsSupported() {
+    return false;
+}
+
+bool ComputeShaderModel::Init(NeuralFieldModel* /*model*/) {
+    LOGE << "Compute shaders require OpenGL 4.3 loader";
+    return false;
+}
+
+void ComputeShaderModel::Release() { }
+
+bool ComputeShaderModel::UploadState() {
+    return false;
+}
+
+void ComputeShaderModel::Stimulate(int /*steps*/) { }
+
+void ComputeShaderModel::Finish() { }
+
+void ComputeShaderModel::SetActivity(size_t /*x*/, size_t /*y*/, float /*a*/) { }
+
+matrix_t* ComputeShaderModel::GetActivity() {
+    return nullptr;
+}
+
+void ComputeShaderModel::UpdateTexture(GLuint /*texture*/, const kernel_t* /*blur*/) { }
+
+double BenchmarkComputeShaders(const NeuralFieldModelParams& /*params*/, int /*steps*/) {
+    return -1.0;
+}
+
+double CompareComputeShaders(const NeuralFieldModelParams& /*params*/, int /*steps*/) {
+    LOGE << "Compute shaders require OpenGL 4.3 loader";
+    return -1.0;
+}
+
+#endif /* GL_VERSION_4_3 */
@@ -0,0 +1,94 @@
+#pragma once
+
+/*****************************************************************************
+ * ComputeShaderModel - steps of the model in OpenGL compute shaders
+ *
+ * State of the model stays in shader storage buffers of the window context.
+ * A step is two dispatches: Heaviside with horizontal passes of both blurs,
+ * then vertical passes with the sum of the new activity. The texture of the
+ * renderer is filled from the buffers without a read back.
+ ****************************************************************************/
+class ComputeShaderModel {
+public:
+    ComputeShaderModel() = default;
+    ~ComputeShaderModel();
+
+    ComputeShaderModel(const ComputeShaderModel&) = delete;
+    ComputeShaderModel& operator=(const ComputeShaderModel&) = delete;
+
+    // Current context has OpenGL 4.3 with compute shaders
+    static bool IsSupported();
+
+    // Creates programs and continues from the state of the initialized model
+    bool Init(NeuralFieldModel* model);
+    // Brings the state back to the model
+    void Release();
+
+    bool IsEnabled() const { return model_ != nullptr; }
+
+    // Uploads the state after init or restart of the model, buffers follow its size
+    bool UploadState();
+
+    // Steps are only dispatched, activity stays on the GPU until GetActivity() is called
+    void Stimulate(int steps = 1);
+    // Waits until the dispatched steps are done
+    void Finish();
+
+    void SetActivity(size_t x, size_t y, float a);
+
+    // Activity of the model, read back only when it is out of date
+    matrix_t* GetActivity();
+
+    // Heaviside of activity with optional blur, copied to the texture through a pixel buffer
+    void UpdateTexture(GLuint texture, const kernel_t* blur);
+
+private:
+    bool InitBuffers();
+    void ReleaseBuffers();
+
+    void BindBuffers(std::initializer_list<GLuint> buffers);
+    void Dispatch();
+
+private:
+    NeuralFieldModel* model_ = nullptr;
+
+    size_t size = 0;
+
+    // Host copy of activity matches the buffer
+    bool isHostActivityValid = true;
+
+    // Heaviside and horizontal passes of both blurs
+    GraphicsUtils::unique_program horizontalStepProgram;
+    GLint uHorizontalSize = -1, uHorizontalMode = -1;
+    GLint uHorizontalExcitementSize = -1, uHorizontalInhibitionSize = -1;
+
+    // Vertical passes and the new activity
+    GraphicsUtils::unique_program verticalStepProgram;
+    GLint uVerticalSize = -1, uVerticalMode = -1;
+    GLint uVerticalExcitementSize = -1, uVerticalInhibitionSize = -1;
+    GLint uVerticalH = -1, uVerticalPiK = -1, uVerticalPiM = -1;
+
+    // Single blur pass of the texture, optionally with Heaviside of the source
+    GraphicsUtils::unique_program texturePassProgram;
+    GLint uTextureSize = -1, uTextureMode = -1, uTextureKernelSize = -1;
+    GLint uTextureVertical = -1, uTextureHeaviside = -1;
+
+    GraphicsUtils::unique_buffer activityBuffer;
+    GraphicsUtils::unique_buffer stimulusBuffer;
+    GraphicsUtils::unique_buffer excitementBuffer;
+    GraphicsUtils::unique_buffer inhibitionBuffer;
+    GraphicsUtils::unique_buffer excitementKernelBuffer;
+    GraphicsUtils::unique_buffer inhibitionKernelBuffer;
+
+    GraphicsUtils::unique_buffer textureBuffer;
+    GraphicsUtils::unique_buffer textureTempBuffer;
+    GraphicsUtils::unique_buffer blurKernelBuffer;
+};
+
+// Average time of a step in compute shaders of the current context in microseconds,
+// negative on failure. Same as BenchmarkComputeBackend for other backends
+double BenchmarkComputeShaders(const NeuralFieldModelParams& params, int steps);
+
+// Largest difference of activity after the number of steps in compute shaders of the
+// current context and on the CPU from the same state, negative on failure
+double CompareComputeShaders(const NeuralFieldModelParams& params, int steps);
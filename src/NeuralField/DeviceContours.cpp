@@ -0,0 +1,590 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "GraphicsUtils.h"
+#ifdef USE_OPENCL
+#include "ParallelUtils.h"
+#endif
+#include "NeuralFieldModel.h"
+#include "GraphicsResource.h"
+#include "StreamBuffer.h"
+#include "ContourPlot.h"
+#include "DeviceContours.h"
+
+#ifdef USE_OPENCL
+
+// Largest work-group of the contour kernels
+constexpr size_t MaxContourLocalSize = 256;
+
+static_assert(sizeof(HMM_Vec2) == 2 * sizeof(cl_float), "Vertices are copied from the device as they are");
+
+/*
+ * Cells kernel. Counts vertices of every cell when there is no output buffer,
+ * otherwise writes them at the offsets of the cells. Cases and order of the
+ * vertices are the same as in SquareCases of ContourPlot::Build. Unlike the
+ * CPU meshes, vertices are repeated for every segment and triangle without
+ * indices, and covered cells of the fill aren't merged into rectangles
+ */
+static const std::string CellsKernelName = "ContourCells";
+static const std::string CellsKernelSource = R"opencl(
+#define SW 2
+#define NW 4
+#define NE 8
+#define SE 16
+#define ALL (SW | NW | NE | SE)
+
+#define PUT(p) { if (out) { out[count] = (p); } count++; }
+
+float ratio(const float *v, int i1, int i2)
+{
+    return fabs(v[i1] / (v[i1] - v[i2]));
+}
+
+uint contour_cell(const float *v, float t, float x, float y, float sx, float sy, int fill,
+                  __global float2 *out)
+{
+    const int f = ((v[0] > 0.0f) ? SW : 0) | ((v[1] > 0.0f) ? NW : 0) |
+        ((v[2] > 0.0f) ? NE : 0) | ((v[3] > 0.0f) ? SE : 0);
+
+    // Corners of the cell
+    const float2 c00 = (float2)(x, y);
+    const float2 c10 = (float2)(x + sx, y);
+    const float2 c11 = (float2)(x + sx, y + sy);
+    const float2 c01 = (float2)(x, y + sy);
+
+    // Crossings of the level with the sides between values
+    const float2 e01 = (float2)(x + sx * ratio(v, 0, 1), y);
+    const float2 e12 = (float2)(x + sx, y + sy * ratio(v, 1, 2));
+    const float2 e32 = (float2)(x + sx * ratio(v, 3, 2), y + sy);
+    const float2 e03 = (float2)(x, y + sy * ratio(v, 0, 3));
+
+    // Saddles are resolved by the value in the center
+    const bool u = (v[0] + v[1] + v[2] + v[3]) / 4.0f - t > 0.0f;
+
+    uint count = 0;
+
+    if (!fill) {
+        if (f == SW || f == (ALL ^ SW)) {
+            PUT(e03); PUT(e01);
+        }
+        else if (f == NW || f == (ALL ^ NW)) {
+            PUT(e01); PUT(e12);
+        }
+        else if (f == NE || f == (ALL ^ NE)) {
+            PUT(e32); PUT(e12);
+        }
+        else if (f == SE || f == (ALL ^ SE)) {
+            PUT(e03); PUT(e32);
+        }
+        else if (f == (SW | NW) || f == (SE | NE)) {
+            PUT(e03); PUT(e12);
+        }
+        else if (f == (NW | NE) || f == (SW | SE)) {
+            PUT(e01); PUT(e32);
+        }
+        else if (f == (SW | NE) || f == (NW | SE)) {
+            if ((f == (SW | NE)) == u) {
+                PUT(e03); PUT(e32); PUT(e01); PUT(e12);
+            }
+            else {
+                PUT(e03); PUT(e01); PUT(e32); PUT(e12);
+            }
+        }
+        return count;
+    }
+
+    if (f == SW) {
+        PUT(c00); PUT(e01); PUT(e03);
+    }
+    else if (f == (ALL ^ SW)) {
+        PUT(e01); PUT(c10); PUT(c11);
+        PUT(e01); PUT(c11); PUT(e03);
+        PUT(e03); PUT(c11); PUT(c01);
+    }
+    else if (f == NW) {
+        PUT(c10); PUT(e12); PUT(e01);
+    }
+    else if (f == (ALL ^ NW)) {
+        PUT(c00); PUT(e01); PUT(c01);
+        PUT(c01); PUT(e01); PUT(e12);
+        PUT(c01); PUT(e12); PUT(c11);
+    }
+    else if (f == NE) {
+        PUT(c11); PUT(e32); PUT(e12);
+    }
+    else if (f == (ALL ^ NE)) {
+        PUT(c00); PUT(c10); PUT(e12);
+        PUT(c00); PUT(e12); PUT(e32);
+        PUT(c00); PUT(e32); PUT(c01);
+    }
+    else if (f == SE) {
+        PUT(c01); PUT(e03); PUT(e32);
+    }
+    else if (f == (ALL ^ SE)) {
+        PUT(c00); PUT(c10); PUT(e03);
+        PUT(e03); PUT(c10); PUT(e32);
+        PUT(c10); PUT(c11); PUT(e32);
+    }
+    else if (f == (SW | NW)) {
+        PUT(c00); PUT(e12); PUT(e03);
+        PUT(c00); PUT(c10); PUT(e12);
+    }
+    else if (f == (SE | NE)) {
+        PUT(e03); PUT(c11); PUT(c01);
+        PUT(e03); PUT(e12); PUT(c11);
+    }
+    else if (f == (NW | NE)) {
+        PUT(e01); PUT(c11); PUT(e32);
+        PUT(e01); PUT(c10); PUT(c11);
+    }
+    else if (f == (SW | SE)) {
+        PUT(c00); PUT(e32); PUT(c01);
+        PUT(c00); PUT(e01); PUT(e32);
+    }
+    else if (f == (SW | NE) || f == (NW | SE)) {
+        if (u) {
+            PUT(e01); PUT(e12); PUT(e32);
+            PUT(e01); PUT(e32); PUT(e03);
+        }
+        if (f == (SW | NE)) {
+            PUT(c00); PUT(e01); PUT(e03);
+            PUT(c11); PUT(e32); PUT(e12);
+        }
+        else {
+            PUT(c01); PUT(e03); PUT(e32);
+            PUT(c10); PUT(e12); PUT(e01);
+        }
+    }
+    else if (f == ALL) {
+        PUT(c00); PUT(c11); PUT(c01);
+        PUT(c00); PUT(c10); PUT(c11);
+    }
+
+    return count;
+}
+
+__kernel void ContourCells(__global const float *a, uint cols, uint rows, float t, int fill,
+                           float x0, float y0, float dx, float dy,
+                           __global uint *cells, __global float2 *vertices)
+{
+    const uint xdiv = cols - 1;
+    const uint ydiv = rows - 1;
+
+    const uint idx = get_global_id(0);
+    if (idx >= xdiv * ydiv) {
+        return;
+    }
+
+    const uint i = idx % xdiv;
+    const uint j = idx / xdiv;
+
+    float v[4];
+    v[0] = a[j * cols + i] - t;
+    v[1] = a[j * cols + i + 1] - t;
+    v[2] = a[(j + 1) * cols + i + 1] - t;
+    v[3] = a[(j + 1) * cols + i] - t;
+
+    const float x = x0 + (float)i * dx;
+    const float y = y0 + (float)j * dy;
+
+    if (vertices) {
+        contour_cell(v, t, x, y, dx, dy, fill, vertices + cells[idx]);
+    }
+    else {
+        cells[idx] = contour_cell(v, t, x, y, dx, dy, fill, 0);
+    }
+}
+)opencl";
+
+/*
+ * Scan kernel. Exclusive prefix sum of blocks of two elements per work-item
+ * in local memory, sums of the blocks are stored for the next level
+ */
+static const std::string ScanKernelName = "ContourScan";
+static const std::string ScanKernelSource = R"opencl(
+__kernel void ContourScan(__global uint *data, uint n, __global uint *sums, __local uint *tmp)
+{
+    const int lid = get_local_id(0);
+    const int l = get_local_size(0);
+    const uint base = get_group_id(0) * 2 * l;
+
+    tmp[lid] = (base + lid < n) ? data[base + lid] : 0;
+    tmp[lid + l] = (base + lid + l < n) ? data[base + lid + l] : 0;
+
+    // Up-sweep
+    int offset = 1;
+    for (int d = l; d > 0; d >>= 1) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d) {
+            tmp[offset * (2 * lid + 2) - 1] += tmp[offset * (2 * lid + 1) - 1];
+        }
+        offset <<= 1;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid == 0) {
+        sums[get_group_id(0)] = tmp[2 * l - 1];
+        tmp[2 * l - 1] = 0;
+    }
+
+    // Down-sweep
+    for (int d = 1; d < 2 * l; d <<= 1) {
+        offset >>= 1;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d) {
+            int i = offset * (2 * lid + 1) - 1;
+            int j = offset * (2 * lid + 2) - 1;
+            uint v = tmp[i];
+            tmp[i] = tmp[j];
+            tmp[j] += v;
+        }
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (base + lid < n) {
+        data[base + lid] = tmp[lid];
+    }
+    if (base + lid + l < n) {
+        data[base + lid + l] = tmp[lid + l];
+    }
+}
+)opencl";
+
+/*
+ * Add sums kernel. Offsets of the blocks from the next level of the scan
+ */
+static const std::string AddSumsKernelName = "ContourAddSums";
+static const std::string AddSumsKernelSource = R"opencl(
+__kernel void ContourAddSums(__global uint *data, uint n, __global const uint *sums)
+{
+    const uint lid = get_local_id(0);
+    const uint l = get_local_size(0);
+    const uint base = get_group_id(0) * 2 * l;
+    const uint s = sums[get_group_id(0)];
+
+    if (base + lid < n) {
+        data[base + lid] += s;
+    }
+    if (base + lid + l < n) {
+        data[base + lid + l] += s;
+    }
+}
+)opencl";
+
+/*****************************************************************************
+ * DeviceContours
+ ****************************************************************************/
+DeviceContours::~DeviceContours() {
+    Release();
+}
+
+bool DeviceContours::Init(NeuralFieldModel* model) {
+    Release();
+
+    model_ = model;
+
+    if (!ParallelUtils::CreateProgram(model_->context, model_->device,
+        CellsKernelName, CellsKernelSource, &cellsProgram, &cellsKernel) ||
+        !ParallelUtils::CreateProgram(model_->context, model_->device,
+        ScanKernelName, ScanKernelSource, &scanProgram, &scanKernel) ||
+        !ParallelUtils::CreateProgram(model_->context, model_->device,
+        AddSumsKernelName, AddSumsKernelSource, &addSumsProgram, &addSumsKernel)) {
+        LOGE << "Failed to create contour programs";
+        Release();
+        return false;
+    }
+
+    // --------------------------------------------------------
+    // Blocks of the scan need work-groups of a power of two
+    cl_int status = CL_SUCCESS;
+
+    size_t maxWorkGroupSize = MaxContourLocalSize;
+    for (cl_kernel kernel : { cellsKernel, scanKernel, addSumsKernel }) {
+        size_t kernelWorkGroupSize = 0;
+        status |= clGetKernelWorkGroupInfo(kernel, model_->device, CL_KERNEL_WORK_GROUP_SIZE,
+            sizeof(kernelWorkGroupSize), &kernelWorkGroupSize, nullptr);
+        maxWorkGroupSize = std::min(maxWorkGroupSize, kernelWorkGroupSize);
+    }
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to get OpenCL work-group limits : " << ParallelUtils::GetOpenCLError(status);
+        Release();
+        return false;
+    }
+
+    localSize = 1;
+    while (localSize * 2 <= maxWorkGroupSize) {
+        localSize *= 2;
+    }
+
+    return true;
+}
+
+void DeviceContours::Release() {
+    ReleaseBuffers();
+
+    for (cl_kernel* kernel : { &cellsKernel, &scanKernel, &addSumsKernel }) {
+        if (*kernel) {
+            clReleaseKernel(*kernel);
+            *kernel = 0;
+        }
+    }
+
+    for (cl_program* program : { &cellsProgram, &scanProgram, &addSumsProgram }) {
+        if (*program) {
+            clReleaseProgram(*program);
+            *program = 0;
+        }
+    }
+}
+
+bool DeviceContours::InitBuffers(size_t newCellsCount) {
+    ReleaseBuffers();
+
+    cl_int status, callStatus;
+
+    status = CL_SUCCESS;
+
+    memCells = clCreateBuffer(model_->context, CL_MEM_READ_WRITE, sizeof(cl_uint) * newCellsCount, NULL, &callStatus);
+    status |= callStatus;
+
+    const size_t blockSize = 2 * localSize;
+    size_t n = newCellsCount;
+    do {
+        levelSizes.push_back(static_cast<cl_uint>(n));
+        n = (n + blockSize - 1) / blockSize;
+
+        memBlockSums.push_back(clCreateBuffer(model_->context, CL_MEM_READ_WRITE, sizeof(cl_uint) * n, NULL, &callStatus));
+        status |= callStatus;
+    } while (n > 1);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to create OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
+        ReleaseBuffers();
+        return false;
+    }
+
+    cellsCount = newCellsCount;
+
+    return true;
+}
+
+void DeviceContours::ReleaseBuffers() {
+    for (cl_mem* mem : { &memCells, &memVertices }) {
+        if (*mem) {
+            clReleaseMemObject(*mem);
+            *mem = 0;
+        }
+    }
+
+    for (cl_mem mem : memBlockSums) {
+        if (mem) {
+            clReleaseMemObject(mem);
+        }
+    }
+    memBlockSums.clear();
+    levelSizes.clear();
+
+    cellsCount = 0;
+    verticesCapacity = 0;
+}
+
+bool DeviceContours::Build(const HMM_Vec4& area, double t, contour_mesh_t& lines, contour_mesh_t* fill) {
+    if (!IsEnabled() || !model_->IsEnabledOpenCL() || model_->size < 2) {
+        return false;
+    }
+
+    const size_t newCellsCount = (model_->size - 1) * (model_->size - 1);
+    if (newCellsCount != cellsCount && !InitBuffers(newCellsCount)) {
+        return false;
+    }
+
+    // Activity is processed on the second queue after the enqueued steps. Reads of
+    // the vertices are blocking, so the next steps can't overwrite it in the meantime
+    cl_command_queue queue = model_->GetAuxQueue();
+    if (!ParallelUtils::EnqueueWaitForQueue(queue, model_->commandQueue)) {
+        return false;
+    }
+
+    if (!BuildMesh(queue, area, t, false, lines)) {
+        return false;
+    }
+
+    if (fill && !BuildMesh(queue, area, t, true, *fill)) {
+        return false;
+    }
+
+    return true;
+}
+
+bool DeviceContours::BuildMesh(cl_command_queue queue, const HMM_Vec4& area, double t, bool fill,
+    contour_mesh_t& mesh) {
+    cl_int status;
+
+    // --------------------------------------------------------
+    // Offsets of the cells and the total number of vertices
+    cl_uint total = 0;
+    if (!EnqueueCells(queue, area, t, fill, 0) || !ScanCells(queue, &total)) {
+        return false;
+    }
+
+    // Vertices of the cells aren't shared, the mesh is drawn without indices
+    mesh.indices.clear();
+    mesh.tiles.clear();
+    mesh.vertices.resize(total);
+    if (total == 0) {
+        return true;
+    }
+
+    // --------------------------------------------------------
+    // Buffer of the vertices grows geometrically
+    if (total > verticesCapacity) {
+        if (memVertices) {
+            clReleaseMemObject(memVertices);
+            memVertices = 0;
+        }
+
+        verticesCapacity = std::max<size_t>(total, verticesCapacity * 2);
+        memVertices = clCreateBuffer(model_->context, CL_MEM_WRITE_ONLY, sizeof(HMM_Vec2) * verticesCapacity,
+            NULL, &status);
+        if (status != CL_SUCCESS) {
+            LOGE << "Failed to create OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
+            verticesCapacity = 0;
+            return false;
+        }
+    }
+
+    // --------------------------------------------------------
+    // Emit the vertices and read only them
+    if (!EnqueueCells(queue, area, t, fill, memVertices)) {
+        return false;
+    }
+
+    status = clEnqueueReadBuffer(queue, memVertices, CL_TRUE, 0, sizeof(HMM_Vec2) * total,
+        mesh.vertices.data(), 0, NULL, model_->ProfileEvent("ReadContour"));
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to read contour vertices : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    return true;
+}
+
+bool DeviceContours::EnqueueCells(cl_command_queue queue, const HMM_Vec4& area, double t, bool fill,
+    cl_mem memOut) {
+    cl_int status;
+
+    cl_uint cols = static_cast<cl_uint>(model_->size);
+    cl_uint rows = static_cast<cl_uint>(model_->size);
+    cl_float ft = static_cast<cl_float>(t);
+    cl_int fillFlag = fill ? 1 : 0;
+    cl_float x0 = area.X;
+    cl_float y0 = area.Z;
+    cl_float dx = (area.Y - area.X) / static_cast<float>(cols - 1);
+    cl_float dy = (area.W - area.Z) / static_cast<float>(rows - 1);
+
+    // Whole work-groups, extra items are skipped by the kernel
+    const size_t globalWorkSize = ((cellsCount + localSize - 1) / localSize) * localSize;
+
+    status = CL_SUCCESS;
+
+    status |= clSetKernelArg(cellsKernel, 0, sizeof(cl_mem), (void*)&model_->memActivityMatrix);
+    status |= clSetKernelArg(cellsKernel, 1, sizeof(cl_uint), (void*)&cols);
+    status |= clSetKernelArg(cellsKernel, 2, sizeof(cl_uint), (void*)&rows);
+    status |= clSetKernelArg(cellsKernel, 3, sizeof(cl_float), (void*)&ft);
+    status |= clSetKernelArg(cellsKernel, 4, sizeof(cl_int), (void*)&fillFlag);
+    status |= clSetKernelArg(cellsKernel, 5, sizeof(cl_float), (void*)&x0);
+    status |= clSetKernelArg(cellsKernel, 6, sizeof(cl_float), (void*)&y0);
+    status |= clSetKernelArg(cellsKernel, 7, sizeof(cl_float), (void*)&dx);
+    status |= clSetKernelArg(cellsKernel, 8, sizeof(cl_float), (void*)&dy);
+    status |= clSetKernelArg(cellsKernel, 9, sizeof(cl_mem), (void*)&memCells);
+    // Null buffer makes the kernel count the vertices
+    status |= clSetKernelArg(cellsKernel, 10, sizeof(cl_mem), (void*)&memOut);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    status = clEnqueueNDRangeKernel(queue, cellsKernel, 1, NULL, &globalWorkSize,
+        &localSize, 0, NULL, model_->ProfileEvent(CellsKernelName));
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    return true;
+}
+
+bool DeviceContours::ScanCells(cl_command_queue queue, cl_uint* total) {
+    cl_int status;
+
+    const size_t blockSize = 2 * localSize;
+    const size_t localBytes = sizeof(cl_uint) * blockSize;
+
+    // --------------------------------------------------------
+    // Scan blocks of every level up to the single sum of the last one
+    for (size_t level = 0; level < levelSizes.size(); level++) {
+        cl_mem data = (level == 0) ? memCells : memBlockSums[level - 1];
+        cl_uint n = levelSizes[level];
+        const size_t globalWorkSize = ((n + blockSize - 1) / blockSize) * localSize;
+
+        status = CL_SUCCESS;
+
+        status |= clSetKernelArg(scanKernel, 0, sizeof(cl_mem), (void*)&data);
+        status |= clSetKernelArg(scanKernel, 1, sizeof(cl_uint), (void*)&n);
+        status |= clSetKernelArg(scanKernel, 2, sizeof(cl_mem), (void*)&memBlockSums[level]);
+        status |= clSetKernelArg(scanKernel, 3, localBytes, NULL);
+
+        if (status != CL_SUCCESS) {
+            LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+            return false;
+        }
+
+        status = clEnqueueNDRangeKernel(queue, scanKernel, 1, NULL, &globalWorkSize,
+            &localSize, 0, NULL, model_->ProfileEvent(ScanKernelName));
+        if (status != CL_SUCCESS) {
+            LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+            return false;
+        }
+    }
+
+    // --------------------------------------------------------
+    // Offsets of the blocks are added from the top level down
+    for (size_t level = levelSizes.size() - 1; level-- > 0;) {
+        cl_mem data = (level == 0) ? memCells : memBlockSums[level - 1];
+        cl_uint n = levelSizes[level];
+        const size_t globalWorkSize = ((n + blockSize - 1) / blockSize) * localSize;
+
+        status = CL_SUCCESS;
+
+        status |= clSetKernelArg(addSumsKernel, 0, sizeof(cl_mem), (void*)&data);
+        status |= clSetKernelArg(addSumsKernel, 1, sizeof(cl_uint), (void*)&n);
+        status |= clSetKernelArg(addSumsKernel, 2, sizeof(cl_mem), (void*)&memBlockSums[level]);
+
+        if (status != CL_SUCCESS) {
+            LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+            return false;
+        }
+
+        status = clEnqueueNDRangeKernel(queue, addSumsKernel, 1, NULL, &globalWorkSize,
+            &localSize, 0, NULL, model_->ProfileEvent(AddSumsKernelName));
+        if (status != CL_SUCCESS) {
+            LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+            return false;
+        }
+    }
+
+    // --------------------------------------------------------
+    // Sum of the last level is the number of vertices
+    status = clEnqueueReadBuffer(queue, memBlockSums.back(), CL_TRUE, 0, sizeof(cl_uint), total,
+        0, NULL, model_->ProfileEvent("ReadContourCount"));
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to read number of contour vertices : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    return true;
+}
+
+#endif /* USE_OPENCL */
@@ -0,0 +1,70 @@
+#pragma once
+
+#ifdef USE_OPENCL
+
+/*****************************************************************************
+ * DeviceContours - marching squares over the activity of the model on its
+ * OpenCL device
+ *
+ * Every cell is classified and counts its vertices, an exclusive prefix sum
+ * of the counts gives offsets of the cells, and the second pass emits the
+ * vertices at the offsets. Only the number of vertices and the compacted
+ * vertices are read back instead of the whole field.
+ ****************************************************************************/
+class DeviceContours {
+public:
+    DeviceContours() = default;
+    ~DeviceContours();
+
+    DeviceContours(const DeviceContours&) = delete;
+    DeviceContours& operator=(const DeviceContours&) = delete;
+
+    // Creates programs in the OpenCL context of the model
+    bool Init(NeuralFieldModel* model);
+    void Release();
+
+    bool IsEnabled() const { return cellsKernel != 0; }
+
+    // Lines and optionally filled triangles of the current activity, same
+    // contours as ContourPlot::Build makes on the CPU, but without indices and tiles.
+    // Covered cells of the fill aren't merged into rectangles
+    bool Build(const HMM_Vec4& area, double t, contour_mesh_t& lines, contour_mesh_t* fill);
+
+private:
+    bool InitBuffers(size_t newCellsCount);
+    void ReleaseBuffers();
+
+    bool BuildMesh(cl_command_queue queue, const HMM_Vec4& area, double t, bool fill, contour_mesh_t& mesh);
+    bool EnqueueCells(cl_command_queue queue, const HMM_Vec4& area, double t, bool fill, cl_mem memOut);
+    bool ScanCells(cl_command_queue queue, cl_uint* total);
+
+private:
+    NeuralFieldModel* model_ = nullptr;
+
+    cl_program cellsProgram = 0;
+    cl_kernel cellsKernel = 0;
+
+    cl_program scanProgram = 0;
+    cl_kernel scanKernel = 0;
+
+    cl_program addSumsProgram = 0;
+    cl_kernel addSumsKernel = 0;
+
+    // Power of two that fits all kernels, every scan block has two items per work-item
+    size_t localSize = 1;
+
+    size_t cellsCount = 0;
+
+    // Vertices per cell, replaced by offsets of the cells after the scan
+    cl_mem memCells = 0;
+
+    // Elements of every level of the scan and sums of their blocks. Sums of a
+    // level are elements of the next one, the last level has a single sum
+    std::vector<cl_uint> levelSizes;
+    std::vector<cl_mem> memBlockSums;
+
+    cl_mem memVertices = 0;
+    size_t verticesCapacity = 0;
+};
+
+#endif /* USE_OPENCL */
@@ -6,14 +6,23 @@
 #include "GraphicsResource.h"
 #include "Shader.h"
 #include "NeuralFieldModel.h"
+#include "ModelConfig.h"
+#include "ComputeBackend.h"
+#include "ComputeShaderModel.h"
 #ifdef USE_OPENCL
 #include "ParallelUtils.h"
+#include "KernelProfiler.h"
 #endif
 #include "PlainTextureRenderer.h"
 #include "TextureRenderer.h"
+#include "StreamBuffer.h"
 #include "ContourPlot.h"
 #include "ContourLine.h"
 #include "ContourFill.h"
+#include "ContourPipeline.h"
+#ifdef USE_OPENCL
+#include "DeviceContours.h"
+#endif
 #include "QuadRenderer.h"
 #include "ResourceFinder.h"
 #include "NeuralFieldContext.h"
@@ -32,6 +41,8 @@ const float g_textureBlurDelta = 0.1f;
 
 const float g_UiWidth = 250.0f;
 
+const int g_MaxStepsPerFrame = 32;
+
 NeuralFieldContext::~NeuralFieldContext() {
     Release();
 }
@@ -70,33 +81,11 @@ bool NeuralFieldContext::Init(GLFWwindow* window, int argc, const char* argv[])
     // Init MVP matrices
     mvp_ = HMM_Orthographic_RH_NO(g_area.X, g_area.Y, g_area.Z, g_area.W, 1.f, -1.f);
 
-    constexpr float DefaultH = -0.1;
-    constexpr float DefaultK = 0.05;
-    constexpr float DefaultKp = 0.125;
-    constexpr float DefaultM = 0.025;
-    constexpr float DefaultMp = 0.0625;
-    constexpr int DefaultSize = 256;
-
     // Init model
     auto configFilePath = (moduleDataDir / g_configFile).string();
-    INIReader reader(configFilePath.c_str());
-    if (reader.ParseError() == 0) {
-        modelConfig_["h"] = reader.GetFloat("", "h", DefaultH);
-        modelConfig_["k"] = reader.GetFloat("", "k", DefaultK);
-        modelConfig_["Kp"] = reader.GetFloat("", "Kp", DefaultKp);
-        modelConfig_["m"] = reader.GetFloat("", "m", DefaultM);
-        modelConfig_["Mp"] = reader.GetFloat("", "Mp", DefaultMp);
-        modelConfig_["size"] = reader.GetInteger("", "size", DefaultSize);
-    }
-    else {
+    if (!LoadModelParams(configFilePath, modelConfig_)) {
         LOGE << "Unable to load Model Config from file " << configFilePath;
         LOGI << "Model will use default params instead";
-        modelConfig_["h"] = DefaultH;
-        modelConfig_["k"] = DefaultK;
-        modelConfig_["Kp"] = DefaultKp;
-        modelConfig_["m"] = DefaultM;
-        modelConfig_["Mp"] = DefaultMp;
-        modelConfig_["size"] = DefaultSize;
     }
 
     modelSize_ = static_cast<int>(modelConfig_["size"]);
@@ -110,11 +99,47 @@ bool NeuralFieldContext::Init(GLFWwindow* window, int argc, const char* argv[])
         return false;
     }
 
+    // Select compute backend, either the fastest one or the device from arguments
+    backends_ = GetComputeBackends();
+    if (ComputeShaderModel::IsSupported()) {
+        ComputeBackend shaders;
+        shaders.kind = BACKEND_COMPUTE_SHADERS;
+        shaders.name = "OpenGL: " + std::string(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+        backends_.push_back(shaders);
+    }
+
+    if (autoSelectBackend_) {
+        backendIdx_ = static_cast<int>(SelectComputeBackend(backends_, modelConfig_,
+            [](const ComputeBackend& backend, const NeuralFieldModelParams& params, int steps) {
+                return backend.kind == BACKEND_COMPUTE_SHADERS ? BenchmarkComputeShaders(params, steps) :
+                    BenchmarkComputeBackend(backend, params, steps);
+            }));
+#ifdef USE_OPENCL
+        openClPlatformNum = backends_[backendIdx_].platformNum;
+        openClDeviceNum = backends_[backendIdx_].deviceNum;
+#endif
+    }
+    else {
+        auto it = std::find_if(backends_.begin(), backends_.end(), [this](const ComputeBackend& b) {
+            if (useComputeShaders_) {
+                return b.kind == BACKEND_COMPUTE_SHADERS;
+            }
+#ifdef USE_OPENCL
+            return b.kind == BACKEND_OPENCL && b.platformNum == openClPlatformNum && b.deviceNum == openClDeviceNum;
+#else
+            return false;
+#endif
+        });
+        backendIdx_ = (it != backends_.end()) ? static_cast<int>(std::distance(backends_.begin(), it)) : 0;
+    }
+
 #ifdef USE_OPENCL
     // Init OpenCL
-    isEnabledOpenCL = InitOpenCLContext();
+    if (backends_[backendIdx_].kind == BACKEND_OPENCL) {
+        isEnabledOpenCL = InitOpenCLContext();
 
-    isEnabledOpenCL = isEnabledOpenCL && model_.InitOpenCLContext(platformId, device, context, commandQueue);
+        isEnabledOpenCL = isEnabledOpenCL && model_.InitOpenCLContext(platformId, device, context, commandQueue);
+    }
 #endif
 
     if (!model_.Init(modelConfig_)) {
@@ -142,8 +167,18 @@ bool NeuralFieldContext::Init(GLFWwindow* window, int argc, const char* argv[])
 
 #ifdef USE_OPENCL
     isEnabledOpenCL = isEnabledOpenCL && renderer_.GetEnabledOpenCL();
+    if (!isEnabledOpenCL && backends_[backendIdx_].kind == BACKEND_OPENCL) {
+        backendIdx_ = 0;
+    }
 #endif
 
+    // Init compute shaders
+    renderer_.SetComputeShaders(&computeShaders_);
+    if (backends_[backendIdx_].kind == BACKEND_COMPUTE_SHADERS && !computeShaders_.Init(&model_)) {
+        LOGI << "Unable to init compute shaders. Will use only CPU mode";
+        backendIdx_ = 0;
+    }
+
     renderer_.UpdateTexture();
 
     // Init contour lines
@@ -167,8 +202,19 @@ bool NeuralFieldContext::Init(GLFWwindow* window, int argc, const char* argv[])
         return false;
     }
 
-    contourLines_.Update(model_.activity.get(), g_area, 1.0);
-    contourFill_.Update(model_.activity.get(), g_area, 1.0);
+    contourLines_.Update(GetActivity(), g_area, 1.0);
+    contourFill_.Update(GetActivity(), g_area, 1.0);
+
+    if (!contourPipeline_.Init(&contourLines_, &contourFill_)) {
+        LOGE << "Unable to start contour pipeline";
+        return false;
+    }
+
+#ifdef USE_OPENCL
+    if (isEnabledOpenCL && !deviceContours_.Init(&model_)) {
+        LOGW << "Unable to init contours on OpenCL device, will build them on CPU";
+    }
+#endif
 
     // Initial resize
     glfwGetWindowSize(window_, &windowWidth_, &windowHeight_);
@@ -184,7 +230,16 @@ bool NeuralFieldContext::Init(GLFWwindow* window, int argc, const char* argv[])
 }
 
 void NeuralFieldContext::Release() {
+    contourPipeline_.Release();
+    computeShaders_.Release();
+
 #ifdef USE_OPENCL
+    // Buffers may use memory of the model, release them while the queue is alive
+    deviceContours_.Release();
+    if (isEnabledOpenCL) {
+        renderer_.SwitchOpenCL(false);
+        model_.ReleaseOpenCLContext();
+    }
     ReleaseOpenCLContext();
 #endif
 }
@@ -274,29 +329,24 @@ void NeuralFieldContext::RenderUi() {
         if (ImGui::RadioButton(std::get<0>(s).c_str(), &modelSize_, std::get<1>(s))) {
             modelConfig_["size"] = modelSize_;
             renderer_.InitTextures(modelSize_);
-            model_.Init(modelConfig_);
+            InitModel();
         }
     }
 
     ImGui::Separator();
 
-    static const std::map<std::string, int> g_ModelModes = {
-        {"wrap", static_cast<int>(KernelMode::MODE_WRAP)},
-        {"reflect", static_cast<int>(KernelMode::MODE_REFLECT)},
-        {"mirror", static_cast<int>(KernelMode::MODE_MIRROR)}
-    };
     firstItemFlag = true;
     ImGui::Text("Border mode:");
-    for (const auto& s : g_ModelModes) {
+    for (const auto& s : GetModelModes()) {
         if (firstItemFlag) {
             firstItemFlag = false;
         }
         else {
             ImGui::SameLine();
         }
-        if (ImGui::RadioButton(s.first.c_str(), &modelMode_, s.second)) {
+        if (ImGui::RadioButton(s.first.c_str(), &modelMode_, static_cast<int>(s.second))) {
             modelConfig_["mode"] = modelMode_;
-            model_.Init(modelConfig_);
+            InitModel();
         }
     }
 
@@ -306,22 +356,34 @@ void NeuralFieldContext::RenderUi() {
 
     if (ImGui::SliderFloat("h", &modelH_, -0.3f, 0.0f)) {
         modelConfig_["h"] = modelH_;
-        model_.Init(modelConfig_);
+        InitModel();
     }
 
     if (ImGui::SliderFloat("M", &modelM_, 0.05f, 0.07)) {
         modelConfig_["M_"] = modelM_;
-        model_.Init(modelConfig_);
+        InitModel();
     }
 
-#ifdef USE_OPENCL
+    ImGui::SliderInt("Steps per frame", &stepsPerFrame_, 1, g_MaxStepsPerFrame);
+
     ImGui::Separator();
 
-    bool bUseOpenCL = isEnabledOpenCL;
-    if (ImGui::Checkbox("Use OpenCL", &bUseOpenCL)) {
-        // Don't change the value, this is only for indication
-        bUseOpenCL = isEnabledOpenCL;
+    ImGui::Text("Compute backend:");
+
+    int newBackendIdx = backendIdx_;
+    if (ImGui::BeginCombo("##Backend", backends_[backendIdx_].name.c_str())) {
+        for (int i = 0; i < static_cast<int>(backends_.size()); i++) {
+            bool isSelected = (i == backendIdx_);
+            if (ImGui::Selectable(backends_[i].name.c_str(), isSelected)) {
+                newBackendIdx = i;
+            }
+            if (isSelected) {
+                ImGui::SetItemDefaultFocus();
+            }
+        }
+        ImGui::EndCombo();
     }
+#ifdef USE_OPENCL
     if (ImGui::IsItemHovered()) {
         std::string str = this->GetOpenCLStatus();
         ImGui::BeginTooltip();
@@ -330,8 +392,27 @@ void NeuralFieldContext::RenderUi() {
         ImGui::PopTextWrapPos();
         ImGui::EndTooltip();
     }
+
+    KernelProfiler* profiler = model_.GetProfiler();
+    if (isEnabledOpenCL && profiler && profiler->IsEnabled() &&
+        ImGui::CollapsingHeader("OpenCL Profiling")) {
+        ImGui::Text("Average times (us): queued / submitted / execution");
+        for (const auto& s : profiler->GetStats()) {
+            double n = static_cast<double>(s.count) * 1000.0;
+            ImGui::BulletText("%s x%llu: %.1f / %.1f / %.1f", s.name.c_str(),
+                static_cast<unsigned long long>(s.count),
+                s.queuedNs / n, s.submitNs / n, s.executionNs / n);
+        }
+        if (ImGui::Button("Reset Profiling")) {
+            profiler->Reset();
+        }
+    }
 #endif
 
+    if (newBackendIdx != backendIdx_) {
+        SwitchBackend(newBackendIdx);
+    }
+
     ImGui::Separator();
 
     ImGui::Text("User Guide:");
@@ -345,6 +426,7 @@ void NeuralFieldContext::RenderUi() {
 
     ImGui::Text("Iterations average (us): %ld", averageIteration_);
     ImGui::Text("FPS Counter: %.1f", fps_);
+    ImGui::Text("Dropped contour frames: %zu", contourPipeline_.GetDroppedFrames());
 
     ImGui::End();
 }
@@ -405,13 +487,21 @@ void NeuralFieldContext::SetActivity(int x, int y) {
     size_t n = static_cast<size_t>((static_cast<double>(cx) / size) * model_.size);
     size_t m = static_cast<size_t>((1.0 - static_cast<double>(cy) / size) * model_.size);
 
-    model_.SetActivity(n, m, 1.f);
+    if (computeShaders_.IsEnabled()) {
+        computeShaders_.SetActivity(n, m, 1.f);
+    }
+    else {
+        model_.SetActivity(n, m, 1.f);
+    }
 
     LOGI << "Set Activity at [" << n << "," << m << "]";
 }
 
 void NeuralFieldContext::Restart() {
     model_.Restart();
+    if (computeShaders_.IsEnabled()) {
+        computeShaders_.UploadState();
+    }
     LOGI << "Reset Model";
 }
 
@@ -435,12 +525,25 @@ void NeuralFieldContext::Update() {
     {
         auto stimulationStepStart = std::chrono::high_resolution_clock::now();
 
-        model_.Stimulate();
+        if (computeShaders_.IsEnabled()) {
+            computeShaders_.Stimulate(stepsPerFrame_);
+        }
+        else {
+            model_.Stimulate(stepsPerFrame_);
+        }
+
+        // Steps are only enqueued on the GPU, time them until they are done
+        if (computeShaders_.IsEnabled()) {
+            computeShaders_.Finish();
+        }
+        else {
+            model_.Finish();
+        }
 
         auto stimulationStepEnd = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stimulationStepEnd - stimulationStepStart);
 
-        simulationsCounter_++;
+        simulationsCounter_ += stepsPerFrame_;
         iterationsTime_ += duration.count();
     }
 
@@ -452,14 +555,33 @@ void NeuralFieldContext::Update() {
         break;
 
     case RenderMode::Contour:
-        contourLines_.Update(model_.activity.get(), g_area, ContourThreshold);
+#ifdef USE_OPENCL
+        if (UpdateDeviceContours(ContourThreshold, false)) {
+            break;
+        }
+#endif
+        contourPipeline_.Submit(GetActivity(), g_area, ContourThreshold, false);
         break;
 
     case RenderMode::Fill:
-        contourLines_.Update(model_.activity.get(), g_area, ContourThreshold);
-        contourFill_.Update(model_.activity.get(), g_area, ContourThreshold);
+#ifdef USE_OPENCL
+        if (UpdateDeviceContours(ContourThreshold, true)) {
+            break;
+        }
+#endif
+        contourPipeline_.Submit(GetActivity(), g_area, ContourThreshold, true);
         break;
     }
+
+    // Meshes of the previous steps are built while the current step is simulated
+    contourPipeline_.Upload();
+
+#ifdef USE_OPENCL
+    // Timings of the commands that have already finished
+    if (KernelProfiler* profiler = model_.GetProfiler()) {
+        profiler->Collect();
+    }
+#endif
 }
 
 void NeuralFieldContext::SetRenderMode(RenderMode mode) {
@@ -577,78 +699,72 @@ void NeuralFieldContext::Mouse(int button, int action, int /*mods*/) {
     }
 }
 
+void NeuralFieldContext::SwitchBackend(int idx) {
+    const ComputeBackend& backend = backends_[idx];
+    LOGI << "Switch compute backend to " << backend.name;
+
+    // Model keeps its state while moving between devices
+    computeShaders_.Release();
 #ifdef USE_OPENCL
-bool NeuralFieldContext::InitOpenCLContext() {
-    // --------------------------------------------------------
-    // Variables
+    deviceContours_.Release();
+    renderer_.SwitchOpenCL(false);
+    model_.ReleaseOpenCLContext();
+    ReleaseOpenCLContext();
+    isEnabledOpenCL = false;
+#endif
 
-    cl_int status{ 0 };
+    bool isSwitched = backend.kind == BACKEND_CPU;
 
-    // --------------------------------------------------------
-    // Get all platforms
-    cl_uint numPlatforms{ 0 };
-    status = clGetPlatformIDs(0, nullptr, &numPlatforms);
-    if (status != CL_SUCCESS) {
-        LOGE << "Failed to get number of platforms : " << ParallelUtils::GetOpenCLError(status);
-        return false;
+    if (backend.kind == BACKEND_COMPUTE_SHADERS) {
+        isSwitched = computeShaders_.Init(&model_);
     }
 
-    LOGI << "This system provides " << numPlatforms << " platforms";
-
-    std::vector<cl_platform_id> platformIds(numPlatforms);
-    status = clGetPlatformIDs(numPlatforms, platformIds.data(), nullptr);
-    if (status != CL_SUCCESS) {
-        LOGE << "Failed to get platform ids : " << ParallelUtils::GetOpenCLError(status);
-        return false;
-    }
+#ifdef USE_OPENCL
+    if (backend.kind == BACKEND_OPENCL) {
+        openClPlatformNum = backend.platformNum;
+        openClDeviceNum = backend.deviceNum;
+
+        isEnabledOpenCL = InitOpenCLContext() &&
+            model_.InitOpenCLContext(platformId, device, context, commandQueue) &&
+            renderer_.SwitchOpenCL(true);
+
+        if (!isEnabledOpenCL) {
+            renderer_.SwitchOpenCL(false);
+            model_.ReleaseOpenCLContext();
+            ReleaseOpenCLContext();
+        }
+        else if (!deviceContours_.Init(&model_)) {
+            LOGW << "Unable to init contours on " << backend.name << ", will build them on CPU";
+        }
 
-    // --------------------------------------------------------
-    // Check that selected platform exists
-    if (openClPlatformNum > platformIds.size()) {
-        LOGE << "Platform " << openClPlatformNum << " was not found in this system";
-        return false;
+        isSwitched = isEnabledOpenCL;
     }
+#endif
 
-    platformId = platformIds[openClPlatformNum - 1];
-
-    // --------------------------------------------------------
-    // Get all devices
-    cl_uint numDevices{ 0 };
-    status = clGetDeviceIDs(platformId, CL_DEVICE_TYPE_ALL, 0, nullptr, &numDevices);
-    if (status != CL_SUCCESS) {
-        LOGE << "Failed to get number of OpenCL deivces : " << ParallelUtils::GetOpenCLError(status);
-        return false;
+    if (!isSwitched) {
+        LOGE << "Unable to switch to " << backend.name << ", will use CPU instead";
     }
 
-    LOGI << "Platform " << openClPlatformNum << " provides " << numDevices << " devices";
+    backendIdx_ = isSwitched ? idx : 0;
+}
 
-    std::vector<cl_device_id> deviceIds(numDevices);
-    status = clGetDeviceIDs(platformId, CL_DEVICE_TYPE_ALL, numDevices, deviceIds.data(), nullptr);
-    if (status != CL_SUCCESS) {
-        LOGE << "Failed to get deivce ids : " << ParallelUtils::GetOpenCLError(status);
-        return false;
-    }
+void NeuralFieldContext::InitModel() {
+    model_.Init(modelConfig_);
 
-    // --------------------------------------------------------
-    // Check that selected device exists
-    if (openClDeviceNum > deviceIds.size()) {
-        LOGE << "OpenCL device " << openClPlatformNum << " is not found in this system";
-        return false;
+    // Compute shaders continue from the new state
+    if (computeShaders_.IsEnabled()) {
+        computeShaders_.UploadState();
     }
+}
 
-    device = deviceIds[openClDeviceNum - 1];
-
-    // Create the context
-    context = clCreateContext(0, 1, &device, NULL, NULL, &status);
-    if (status != CL_SUCCESS) {
-        LOGE << "Failed to create OpenCL context : " << ParallelUtils::GetOpenCLError(status);
-        return false;
-    }
+matrix_t* NeuralFieldContext::GetActivity() {
+    return computeShaders_.IsEnabled() ? computeShaders_.GetActivity() : model_.GetActivity();
+}
 
-    // Create a command-queue
-    commandQueue = clCreateCommandQueue(context, device, 0, &status);
-    if (status != CL_SUCCESS) {
-        LOGE << "Failed to create OpenCL command queue : " << ParallelUtils::GetOpenCLError(status);
+#ifdef USE_OPENCL
+bool NeuralFieldContext::InitOpenCLContext() {
+    if (!ParallelUtils::CreateContext(openClPlatformNum, openClDeviceNum,
+        &platformId, &device, &context, &commandQueue, openClProfiling)) {
         return false;
     }
 
@@ -663,6 +779,26 @@ bool NeuralFieldContext::InitOpenCLContext() {
     return true;
 }
 
+bool NeuralFieldContext::UpdateDeviceContours(double t, bool withFill) {
+    if (!isEnabledOpenCL || !deviceContours_.IsEnabled()) {
+        return false;
+    }
+
+    // Only the compacted vertices are read back from the device
+    if (!deviceContours_.Build(g_area, t, deviceLines_, withFill ? &deviceFill_ : nullptr)) {
+        LOGW << "Unable to build contours on OpenCL device, will build them on CPU";
+        deviceContours_.Release();
+        return false;
+    }
+
+    contourLines_.Upload(deviceLines_);
+    if (withFill) {
+        contourFill_.Upload(deviceFill_);
+    }
+
+    return true;
+}
+
 void NeuralFieldContext::ReleaseOpenCLContext() {
     if (context) {
         clReleaseContext(context);
@@ -689,6 +825,15 @@ int NeuralFieldContext::ParseArgs(int argc, const char* argv[]) {
         if (arg == "-h" || arg == "--help") {
             return ShowUsage(argv[0]);
         }
+        else if (arg == "--check-compute-shaders") {
+            // Handled before the window is created
+            i++;
+        }
+        else if (arg == "--compute-shaders") {
+            useComputeShaders_ = true;
+            autoSelectBackend_ = false;
+            LOGI << "Use OpenGL compute shaders";
+        }
 #ifdef USE_OPENCL
         else if (arg == "-p" || arg == "--platform") {
             if (i + 1 < argc) {
@@ -698,6 +843,7 @@ int NeuralFieldContext::ParseArgs(int argc, const char* argv[]) {
                     return false;
                 }
                 openClPlatformNum = static_cast<size_t>(k);
+                autoSelectBackend_ = false;
                 LOGI << "Set OpenCL platform to " << openClPlatformNum;
             }
             else {
@@ -713,6 +859,7 @@ int NeuralFieldContext::ParseArgs(int argc, const char* argv[]) {
                     return false;
                 }
                 openClDeviceNum = static_cast<size_t>(k);
+                autoSelectBackend_ = false;
                 LOGI << "Set OpenCL device to " << openClDeviceNum;
             }
             else {
@@ -720,6 +867,10 @@ int NeuralFieldContext::ParseArgs(int argc, const char* argv[]) {
                 return EXIT_FAILURE;
             }
         }
+        else if (arg == "--profile") {
+            openClProfiling = true;
+            LOGI << "Enable OpenCL profiling";
+        }
 #endif /* USE_OPENCL */
     }
 
@@ -729,10 +880,13 @@ int NeuralFieldContext::ParseArgs(int argc, const char* argv[]) {
 int NeuralFieldContext::ShowUsage(const std::string& cmd) {
     std::cout << "Usage: " << cmd << " <option(s)>" << std::endl
         << "Options:" << std::endl
-        << "\t-h,--help\t\tShow this help message" << std::endl;
+        << "\t-h,--help\t\tShow this help message" << std::endl
+        << "\t--compute-shaders\t\tRun the model in OpenGL compute shaders" << std::endl
+        << "\t--check-compute-shaders STEPS\tCompare compute shaders with the CPU model without window and exit" << std::endl;
 #ifdef USE_OPENCL
-    std::cout << "\t-p,--platform NUM\t\tSpecify OpenCL platform by ID" << std::endl
-        << "\t-d,--device NUM\t\tSpecify OpenCL device by ID" << std::endl;
+    std::cout << "\t-p,--platform NUM\t\tSpecify OpenCL platform by ID (default: fastest backend)" << std::endl
+        << "\t-d,--device NUM\t\tSpecify OpenCL device by ID" << std::endl
+        << "\t--profile\t\tCollect timings of OpenCL commands" << std::endl;
 #endif
     return EXIT_FAILURE;
 }
@@ -26,10 +26,19 @@ public:
     static void MouseCallback(GLFWwindow* window, int button, int action, int mods);
 
 private:
+    void SwitchBackend(int idx);
+
+    // Model state through the backend that keeps it
+    void InitModel();
+    matrix_t* GetActivity();
+
 #ifdef USE_OPENCL
     bool InitOpenCLContext();
     void ReleaseOpenCLContext();
 
+    // Builds contours on the OpenCL device, false if they should be built on CPU
+    bool UpdateDeviceContours(double t, bool withFill);
+
     std::string GetOpenCLStatus() const;
 #endif
 
@@ -67,15 +76,18 @@ private:
     HMM_Mat4 mvp_;
 
     NeuralFieldModel model_;
+    ComputeShaderModel computeShaders_;
     int modelSize_;
     int modelMode_;
     float modelH_;
     float modelM_;
+    int stepsPerFrame_ = 1;
 
     TextureRenderer renderer_;
 
     ContourLine contourLines_;
     ContourFill contourFill_;
+    ContourPipeline contourPipeline_;
 
     bool isFullscreen_ = false;
     WindowDimensions savedWindowInfo_ = { 0, 0, 0, 0 };
@@ -94,11 +106,18 @@ private:
 
     QuadRenderer quad_;
 
+    std::vector<ComputeBackend> backends_;
+    int backendIdx_ = 0;
+    bool autoSelectBackend_ = true; // Unless the device is set in arguments
+    bool useComputeShaders_ = false;
+
 #ifdef USE_OPENCL
     // OpenCL context
     bool isEnabledOpenCL = false; // If load of OpenCL was successfull
     size_t openClPlatformNum = 1;
     size_t openClDeviceNum = 1;
+    bool openClProfiling = false;
+
     std::string openClStatusStr;
 
     cl_platform_id platformId = nullptr;
@@ -106,5 +125,9 @@ private:
     cl_context context = nullptr;
 
     cl_command_queue commandQueue = nullptr;
+
+    DeviceContours deviceContours_;
+    contour_mesh_t deviceLines_;
+    contour_mesh_t deviceFill_;
 #endif
 };
@@ -8,6 +8,7 @@
 #include "ParallelUtils.h"
 #endif
 #include "NeuralFieldModel.h"
+#include "ComputeShaderModel.h"
 #include "PlainTextureRenderer.h"
 #include "TextureRenderer.h"
 
@@ -79,18 +80,8 @@ bool TextureRenderer::InitTextures(size_t newSize) {
 
 #ifdef USE_OPENCL
     // Init OpenCL
-    if (isEnabledOpenCL) {
-        cl_int status, callStatus;
-
-        status = CL_SUCCESS;
-
-        memTextureBuffer = clCreateBuffer(model_->context, CL_MEM_READ_WRITE, sizeof(cl_float) * size * size, NULL, &callStatus);
-        status |= callStatus;
-
-        if (status != CL_SUCCESS) {
-            LOGE << "Failed to create OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
-            isEnabledOpenCL = false;
-        }
+    if (isEnabledOpenCL && !InitTextureBuffer()) {
+        isEnabledOpenCL = false;
     }
 #endif
 
@@ -98,20 +89,79 @@ bool TextureRenderer::InitTextures(size_t newSize) {
 }
 
 void TextureRenderer::ReleaseTextures() {
+#ifdef USE_OPENCL
+    // Buffer may use memory of the texture matrix
+    if (isEnabledOpenCL) {
+        ReleaseTextureBuffer();
+    }
+#endif
+
     tex.reset();
     tempTex.reset();
 
     texture.reset();
+}
 
 #ifdef USE_OPENCL
-    if (isEnabledOpenCL && memTextureBuffer) {
-        clReleaseMemObject(memTextureBuffer);
-        memTextureBuffer = 0;
+bool TextureRenderer::SwitchOpenCL(bool flag) {
+    if (isEnabledOpenCL) {
+        ReleaseOpenCLBuffers();
+        ReleaseTextureBuffer();
+    }
+
+    isEnabledOpenCL = flag;
+
+    if (isEnabledOpenCL) {
+        if (!InitTextureBuffer()) {
+            isEnabledOpenCL = false;
+            return false;
+        }
+
+        // Recreate buffer of the blur kernel, keeping blur on or off
+        bool savedUseBlur = useBlur;
+        SetBlur(blurSigma);
+        useBlur = savedUseBlur;
+    }
+
+    return isEnabledOpenCL;
+}
+
+bool TextureRenderer::InitTextureBuffer() {
+    cl_int status;
+
+    // With memory shared by the device the results are mapped instead of read
+    if (model_->IsHostMemoryShared()) {
+        memTextureBuffer = clCreateBuffer(model_->context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+            sizeof(cl_float) * tex->dataSize, tex->data, &status);
+    }
+    else {
+        memTextureBuffer = clCreateBuffer(model_->context, CL_MEM_READ_WRITE, sizeof(cl_float) * size * size, NULL, &status);
+    }
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to create OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    memTextureTemp = clCreateBuffer(model_->context, CL_MEM_READ_WRITE, sizeof(cl_float) * size * size, NULL, &status);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to create OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
+        ReleaseTextureBuffer();
+        return false;
+    }
+
+    return true;
+}
+
+void TextureRenderer::ReleaseTextureBuffer() {
+    for (cl_mem* mem : { &memTextureBuffer, &memTextureTemp }) {
+        if (*mem) {
+            clReleaseMemObject(*mem);
+            *mem = 0;
+        }
     }
-#endif
 }
 
-#ifdef USE_OPENCL
 void TextureRenderer::ReleaseOpenCLBuffers() {
     if (memBlurKernel) {
         clReleaseMemObject(memBlurKernel);
@@ -141,12 +191,18 @@ void TextureRenderer::Resize(unsigned int w, unsigned int h) {
 }
 
 void TextureRenderer::UpdateTexture() {
+    if (computeShaders_ && computeShaders_->IsEnabled()) {
+        // Activity stays on the GPU
+        computeShaders_->UpdateTexture(static_cast<GLuint>(texture), useBlur ? blurKernel.get() : nullptr);
+        return;
+    }
+
 #ifdef USE_OPENCL
     if (!isEnabledOpenCL) {
 #else
     {
 #endif
-        matrix_t* m = model_->activity.get();
+        matrix_t* m = model_->GetActivity();
 
         matrix_scalar_set(tempTex.get(), 0.0);
         matrix_add(tempTex.get(), m);
@@ -164,23 +220,51 @@ void TextureRenderer::UpdateTexture() {
     else {
         cl_int status;
 
-        status = clEnqueueCopyBuffer(model_->commandQueue, model_->memActivityMatrix, memTextureBuffer,
-            0, 0, sizeof(cl_float) * this->size * this->size, 0, nullptr, nullptr);
+        // Texture is processed on the second queue of the model after the enqueued
+        // steps, and the next steps only wait for the copy of activity
+        cl_command_queue queue = model_->GetAuxQueue();
+        ParallelUtils::EnqueueWaitForQueue(queue, model_->commandQueue);
+
+        status = clEnqueueCopyBuffer(queue, model_->memActivityMatrix, memTextureBuffer,
+            0, 0, sizeof(cl_float) * this->size * this->size, 0, nullptr, model_->ProfileEvent("CopyTexture"));
         if (status != CL_SUCCESS) {
             LOGE << "Failed to copy OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
             return;
         }
 
-        model_->CalcHeaviside(memTextureBuffer, this->size);
+        ParallelUtils::EnqueueWaitForQueue(model_->commandQueue, queue);
+
+        model_->CalcHeaviside(queue, memTextureBuffer, this->size);
 
         if (useBlur) {
-            model_->GaussianBlur(memTextureBuffer, memTextureBuffer, model_->memTempMatrix, this->size,
-                this->memBlurKernel, this->blurKernel->size);
+            model_->GaussianBlur(queue, memTextureBuffer, memTextureBuffer, memTextureTemp, this->size,
+                this->memBlurKernel, this->blurKernel->size, this->blurKernel->mode);
+        }
+
+        if (model_->IsHostMemoryShared()) {
+            // Map the results in place, texture is uploaded before the buffer is handed back
+            void* data = clEnqueueMapBuffer(queue, memTextureBuffer, CL_TRUE, CL_MAP_READ, 0,
+                sizeof(cl_float) * tex->dataSize, 0, NULL, model_->ProfileEvent("MapTexture"), &status);
+            if (status != CL_SUCCESS) {
+                LOGE << "Failed to map result buffer after OpenCL kernel run : " << ParallelUtils::GetOpenCLError(status);
+                return;
+            }
+
+            glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(texture)); LOGOPENGLERROR();
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RED,
+                            GL_FLOAT, static_cast<const GLfloat *>(data)); LOGOPENGLERROR();
+
+            status = clEnqueueUnmapMemObject(queue, memTextureBuffer, data,
+                0, NULL, model_->ProfileEvent("UnmapTexture"));
+            if (status != CL_SUCCESS) {
+                LOGE << "Failed to unmap result buffer : " << ParallelUtils::GetOpenCLError(status);
+            }
+            return;
         }
 
         // Read the results
-        status = clEnqueueReadBuffer(model_->commandQueue, memTextureBuffer, CL_TRUE, 0,
-            sizeof(cl_float) * tex->dataSize, tex->data, 0, NULL, NULL);
+        status = clEnqueueReadBuffer(queue, memTextureBuffer, CL_TRUE, 0,
+            sizeof(cl_float) * tex->dataSize, tex->data, 0, NULL, model_->ProfileEvent("ReadTexture"));
         if (status != CL_SUCCESS) {
             LOGE << "Failed to read result buffer after OpenCL kernel run : " << ParallelUtils::GetOpenCLError(status);
             return;
@@ -222,7 +306,7 @@ void TextureRenderer::SetBlur(double blur) {
             status = CL_SUCCESS;
 
             status |= clEnqueueWriteBuffer(model_->commandQueue, memBlurKernel, CL_FALSE, 0,
-                sizeof(cl_float) * blurKernel->size, blurKernel->data, 0, NULL, NULL);
+                sizeof(cl_float) * blurKernel->size, blurKernel->data, 0, NULL, model_->ProfileEvent("WriteBlurKernel"));
 
             if (status != CL_SUCCESS) {
                 LOGE << "Failed to load kernels into OpenCL memory : " << ParallelUtils::GetOpenCLError(status);
@@ -23,15 +23,23 @@ public:
 
     void SetUseBlur(bool newUseBlur);
 
+    // Texture is filled by compute shaders while they run the model
+    void SetComputeShaders(ComputeShaderModel* shaders) { computeShaders_ = shaders; }
+
 #ifdef USE_OPENCL
     void SetEnabledOpenCL(bool flag) { isEnabledOpenCL = flag; }
     bool GetEnabledOpenCL() const { return isEnabledOpenCL; }
+
+    // Moves texture processing between OpenCL context of the model and the CPU
+    bool SwitchOpenCL(bool flag);
 #endif
 
 private:
     void Release();
     void ReleaseTextures();
 #ifdef USE_OPENCL
+    bool InitTextureBuffer();
+    void ReleaseTextureBuffer();
     void ReleaseOpenCLBuffers();
 #endif
 
@@ -51,10 +59,12 @@ private:
     GraphicsUtils::unique_program program;
 
     NeuralFieldModel* model_ = nullptr;
+    ComputeShaderModel* computeShaders_ = nullptr;
 
 #ifdef USE_OPENCL
     bool isEnabledOpenCL = false;
     cl_mem memTextureBuffer = 0;
+    cl_mem memTextureTemp = 0;
     cl_mem memBlurKernel = 0;
 #endif
 };
@@ -5,14 +5,23 @@
 #include "GraphicsLogger.h"
 #include "GraphicsResource.h"
 #include "NeuralFieldModel.h"
+#include "ModelConfig.h"
+#include "ComputeBackend.h"
+#include "ComputeShaderModel.h"
 #include "PlainTextureRenderer.h"
 #include "TextureRenderer.h"
+#include "StreamBuffer.h"
 #include "ContourPlot.h"
 #include "ContourLine.h"
 #include "ContourFill.h"
+#include "ContourPipeline.h"
+#ifdef USE_OPENCL
+#include "DeviceContours.h"
+#endif
 #include "QuadRenderer.h"
 #include "NeuralFieldContext.h"
 #include "LogFormatter.h"
+#include "ResourceFinder.h"
 #include "GlfwWrapper.h"
 #include "ImGuiWrapper.h"
 
@@ -22,6 +31,47 @@ constexpr int Height = 600;
 
 const std::string Title = "Model of Planar Neural Field";
 
+const std::filesystem::path ConfigFile = "amari.conf";
+
+// Largest difference of activity between compute shaders and the CPU that passes the check
+constexpr double CheckTolerance = 1e-4;
+
+
+// Number of steps of the --check-compute-shaders option or 0
+static int GetCheckSteps(int argc, const char* argv[]) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--check-compute-shaders") {
+            return std::max(1, atoi(argv[i + 1]));
+        }
+    }
+    return 0;
+}
+
+// Runs the model from amari.conf in compute shaders and on the CPU in every border mode
+static int CheckComputeShaders(const char* argv0, int steps) {
+    NeuralFieldModelParams params = GetDefaultModelParams();
+
+    std::filesystem::path moduleDataDir;
+    if (!Utils::ResourceFinder::GetDataDirectory(argv0, moduleDataDir) ||
+        !LoadModelParams((moduleDataDir / ConfigFile).string(), params)) {
+        LOGI << "Unable to load model config, will use default params instead";
+    }
+
+    bool passed = true;
+    for (const auto& mode : GetModelModes()) {
+        params["mode"] = static_cast<double>(mode.second);
+
+        double diff = CompareComputeShaders(params, steps);
+        bool modePassed = (diff >= 0.0) && (diff <= CheckTolerance);
+        LOGI << "Compute shaders in mode " << mode.first << " after " << steps << " steps : max difference = " <<
+            diff << (modePassed ? " (passed)" : " (failed)");
+
+        passed = passed && modePassed;
+    }
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 
 int main(int argc, const char* argv[]) {
     try {
@@ -32,11 +82,17 @@ int main(int argc, const char* argv[]) {
         plog::init(plog::debug, &logger);
 #endif
 
+        int checkSteps = GetCheckSteps(argc, argv);
+
         GlfwWrapper glfwWrapper;
-        if (glfwWrapper.Init(Title, Width, Height) != 0) {
+        if (glfwWrapper.Init(Title, Width, Height, checkSteps > 0) != 0) {
             LOGE << "Failed to load GLFW";
             return EXIT_FAILURE;
         }
+
+        if (checkSteps > 0) {
+            return CheckComputeShaders(argv[0], checkSteps);
+        }
         
         glfwSwapInterval(0); // Disable vsync to get maximum number of iterations
 
@@ -0,0 +1,274 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#ifdef USE_OPENCL
+#include "ParallelUtils.h"
+#include "KernelProfiler.h"
+#endif
+#include "NeuralFieldModel.h"
+#include "ModelConfig.h"
+#include "FieldBand.h"
+#include "HybridNeuralFieldModel.h"
+#include "ComputeBackend.h"
+#include "FieldObservables.h"
+#include "LogFormatter.h"
+#include "ResourceFinder.h"
+
+const std::filesystem::path g_configFile = "amari.conf";
+
+// Keys of NeuralFieldModelParams that may be set from the command line
+const std::vector<std::string> g_ParamKeys = {
+    "size", "h", "k", "Kp", "m", "Mp"
+};
+
+struct CliOptions {
+    std::string configFile;
+    int steps = 1000;
+    NeuralFieldModelParams overrides;
+#ifdef USE_OPENCL
+    bool useOpenCL = false;
+    bool autoBackend = false;
+    bool hybrid = false;
+    size_t openClPlatformNum = 1;
+    size_t openClDeviceNum = 1;
+    bool profiling = false;
+#endif
+};
+
+static int ShowUsage(const std::string& cmd) {
+    std::cout << "Usage: " << cmd << " <option(s)>" << std::endl
+        << "Options:" << std::endl
+        << "\t-h,--help\t\tShow this help message" << std::endl
+        << "\t-c,--config FILE\tModel config (default: data/amari.conf)" << std::endl
+        << "\t-n,--steps NUM\t\tNumber of simulation steps" << std::endl
+        << "\t-m,--mode MODE\t\tBorder mode: wrap | reflect | mirror" << std::endl
+        << "\t--KEY VALUE\t\tOverride model parameter, KEY is one of size, h, k, Kp, m, Mp" << std::endl
+#ifdef USE_OPENCL
+        << "\t--opencl\t\tRun the model with OpenCL" << std::endl
+        << "\t--auto\t\t\tRun the model on the fastest of CPU and OpenCL devices" << std::endl
+        << "\t--hybrid\t\tSplit rows of the field between CPU and OpenCL device" << std::endl
+        << "\t-p,--platform NUM\tOpenCL platform number (default: 1)" << std::endl
+        << "\t-d,--device NUM\t\tOpenCL device number (default: 1)" << std::endl
+        << "\t--profile\t\tReport timings of OpenCL commands" << std::endl
+#endif
+        ;
+    return EXIT_FAILURE;
+}
+
+static int ParseArgs(int argc, char* argv[], CliOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-h" || arg == "--help") {
+            return ShowUsage(argv[0]);
+        }
+        else if ((arg == "-c" || arg == "--config") && hasValue) {
+            options.configFile = argv[++i];
+        }
+        else if ((arg == "-n" || arg == "--steps") && hasValue) {
+            options.steps = atoi(argv[++i]);
+        }
+        else if ((arg == "-m" || arg == "--mode") && hasValue) {
+            auto mode = GetModelModes().find(argv[++i]);
+            if (mode == GetModelModes().end()) {
+                LOGE << "Unknown border mode " << argv[i];
+                return EXIT_FAILURE;
+            }
+            options.overrides["mode"] = mode->second;
+        }
+#ifdef USE_OPENCL
+        else if (arg == "--opencl") {
+            options.useOpenCL = true;
+        }
+        else if (arg == "--auto") {
+            options.autoBackend = true;
+        }
+        else if (arg == "--hybrid") {
+            options.hybrid = true;
+        }
+        else if ((arg == "-p" || arg == "--platform") && hasValue) {
+            options.openClPlatformNum = static_cast<size_t>(std::max(1, atoi(argv[++i])));
+        }
+        else if ((arg == "-d" || arg == "--device") && hasValue) {
+            options.openClDeviceNum = static_cast<size_t>(std::max(1, atoi(argv[++i])));
+        }
+        else if (arg == "--profile") {
+            options.profiling = true;
+        }
+#endif
+        else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0 && hasValue &&
+            std::find(g_ParamKeys.begin(), g_ParamKeys.end(), arg.substr(2)) != g_ParamKeys.end()) {
+            options.overrides[arg.substr(2)] = atof(argv[++i]);
+        }
+        else {
+            LOGE << "Unknown option or missing argument : " << arg;
+            return ShowUsage(argv[0]);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static NeuralFieldModelParams LoadParams(const CliOptions& options, const char* argv0) {
+    std::string configFilePath = options.configFile;
+    if (configFilePath.empty()) {
+        std::filesystem::path moduleDataDir;
+        if (Utils::ResourceFinder::GetDataDirectory(argv0, moduleDataDir)) {
+            configFilePath = (moduleDataDir / g_configFile).string();
+        }
+    }
+
+    NeuralFieldModelParams params;
+    if (!LoadModelParams(configFilePath, params)) {
+        LOGI << "Unable to load model config, will use default params instead";
+    }
+
+    for (const auto& p : options.overrides) {
+        params[p.first] = p.second;
+    }
+
+    return params;
+}
+
+// Initializes the model, returns time of the initialization in microseconds or negative value on failure
+template <class Model>
+static int64_t InitModel(Model& model, const NeuralFieldModelParams& params) {
+    auto initStartTime = std::chrono::high_resolution_clock::now();
+    if (!model.Init(params)) {
+        LOGE << "Unable to init neural field model";
+        return -1;
+    }
+    auto initEndTime = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(initEndTime - initStartTime).count();
+}
+
+// Runs the steps and reports timings and observables of the final state
+template <class Model>
+static void RunModel(Model& model, int steps, int64_t initTime) {
+    model.SetActivity(model.size / 2, model.size / 2, 1.f);
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    model.Stimulate(steps);
+    matrix_t* activity = model.GetActivity();
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    auto totalTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+    double stepTime = (steps > 0) ? static_cast<double>(totalTime) / steps : 0.0;
+    double cellsPerSecond = (stepTime > 0.0) ? (model.size * model.size) / stepTime : 0.0;
+
+    LOGI << "Size : " << model.size << ", Steps : " << steps;
+    LOGI << "Init Time (us) = " << initTime;
+    LOGI << "Average Stimulation Step Time (us) = " << static_cast<int64_t>(stepTime);
+    LOGI << "Throughput (Mcells/s) = " << cellsPerSecond;
+    LOGI << "Active Fraction = " << field_active_fraction(activity);
+    LOGI << "Bumps Count = " << field_bumps_count(activity, model.mode);
+}
+
+int main(int argc, char* argv[]) {
+    plog::ConsoleAppender<plog::LogFormatter> logger;
+    plog::init(plog::info, &logger);
+
+    CliOptions options;
+    if (ParseArgs(argc, argv, options) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    NeuralFieldModelParams params = LoadParams(options, argv[0]);
+
+    NeuralFieldModel model;
+
+#ifdef USE_OPENCL
+    HybridNeuralFieldModel hybridModel;
+
+    cl_platform_id platformId = nullptr;
+    cl_device_id device = nullptr;
+    cl_context context = nullptr;
+    cl_command_queue commandQueue = nullptr;
+
+    if (options.autoBackend && !options.hybrid) {
+        std::vector<ComputeBackend> backends = GetComputeBackends();
+        const ComputeBackend& backend = backends[SelectComputeBackend(backends, params)];
+
+        options.useOpenCL = backend.kind == BACKEND_OPENCL;
+        options.openClPlatformNum = backend.platformNum;
+        options.openClDeviceNum = backend.deviceNum;
+    }
+
+    if (options.useOpenCL || options.hybrid) {
+        // Hybrid model balances rows between CPU and device by timings of commands
+        bool profiling = options.profiling || options.hybrid;
+        if (!ParallelUtils::CreateContext(options.openClPlatformNum, options.openClDeviceNum,
+            &platformId, &device, &context, &commandQueue, profiling)) {
+            LOGE << "Unable to create OpenCL context";
+            return EXIT_FAILURE;
+        }
+
+        LOGI << "OpenCL Platform Info : " << std::endl << ParallelUtils::GetPlatformInfo(platformId)
+            << "Device Info :" << std::endl << ParallelUtils::GetDeviceInfo(device);
+
+        if (options.hybrid) {
+            hybridModel.InitOpenCLContext(device, context, commandQueue);
+        }
+        else {
+            model.InitOpenCLContext(platformId, device, context, commandQueue);
+        }
+    }
+
+    if (options.hybrid) {
+        int64_t initTime = InitModel(hybridModel, params);
+        if (initTime < 0) {
+            return EXIT_FAILURE;
+        }
+
+        RunModel(hybridModel, options.steps, initTime);
+        LOGI << "Rows on OpenCL device = " << hybridModel.GetSplitRow() << " of " << hybridModel.size;
+
+        hybridModel.Release();
+    }
+    else
+#endif
+    {
+        int64_t initTime = InitModel(model, params);
+        if (initTime < 0) {
+            return EXIT_FAILURE;
+        }
+
+#ifdef USE_OPENCL
+        if (options.useOpenCL && !model.IsEnabledOpenCL()) {
+            LOGE << "Unable to run the model with OpenCL";
+            return EXIT_FAILURE;
+        }
+#endif
+
+        RunModel(model, options.steps, initTime);
+    }
+
+#ifdef USE_OPENCL
+    KernelProfiler* profiler = model.GetProfiler();
+    if (profiler && profiler->IsEnabled()) {
+        profiler->Collect(true);
+
+        LOGI << "OpenCL command timings (us): count, queued, submitted, execution";
+        for (const auto& s : profiler->GetStats()) {
+            double n = static_cast<double>(s.count) * 1000.0;
+            LOGI << "  " << s.name << " : " << s.count << ", "
+                << s.queuedNs / n << ", " << s.submitNs / n << ", " << s.executionNs / n;
+        }
+    }
+#endif
+
+#ifdef USE_OPENCL
+    // Buffers may use memory of the model, release them while the queue is alive
+    model.ReleaseOpenCLContext();
+
+    if (commandQueue) {
+        clReleaseCommandQueue(commandQueue);
+    }
+    if (context) {
+        clReleaseContext(context);
+    }
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "ParallelUtils.h"
+#include "NeuralFieldModel.h"
+#include "ComputeBackend.h"
+
+// Steps before the measurement, they include lazy builds of kernels
+static const int WarmupSteps = 2;
+static const int BenchmarkSteps = 20;
+
+static const std::filesystem::path BackendCacheFileName = "backends.txt";
+
+// Names of backend kinds in the cache
+static const std::map<ComputeBackendKind, std::string> g_BackendKindNames = {
+    {BACKEND_CPU, "cpu"},
+    {BACKEND_OPENCL, "opencl"},
+    {BACKEND_COMPUTE_SHADERS, "shaders"},
+};
+
+std::vector<ComputeBackend> GetComputeBackends() {
+    std::vector<ComputeBackend> backends;
+
+    ComputeBackend cpu;
+#ifdef USE_OPENMP
+    cpu.name = "CPU (OpenMP)";
+#else
+    cpu.name = "CPU";
+#endif
+    backends.push_back(cpu);
+
+#ifdef USE_OPENCL
+    for (const auto& device : ParallelUtils::GetDevices()) {
+        ComputeBackend backend;
+        backend.kind = BACKEND_OPENCL;
+        backend.platformNum = device.platformNum;
+        backend.deviceNum = device.deviceNum;
+        backend.name = "OpenCL: " + device.name;
+        backends.push_back(backend);
+    }
+#endif
+
+    return backends;
+}
+
+double BenchmarkComputeBackend(const ComputeBackend& backend, const NeuralFieldModelParams& params, int steps) {
+    double stepTime = -1.0;
+
+    if (backend.kind == BACKEND_COMPUTE_SHADERS) {
+        return stepTime;
+    }
+
+#ifndef USE_OPENCL
+    if (backend.kind == BACKEND_OPENCL) {
+        return stepTime;
+    }
+#else
+    cl_platform_id platformId = nullptr;
+    cl_device_id device = nullptr;
+    cl_context context = nullptr;
+    cl_command_queue commandQueue = nullptr;
+#endif
+
+    {
+        NeuralFieldModel model;
+
+#ifdef USE_OPENCL
+        if (backend.kind == BACKEND_OPENCL) {
+            if (!ParallelUtils::CreateContext(backend.platformNum, backend.deviceNum,
+                &platformId, &device, &context, &commandQueue) ||
+                !model.InitOpenCLContext(platformId, device, context, commandQueue)) {
+                LOGW << "Unable to benchmark backend " << backend.name;
+                steps = 0;
+            }
+        }
+#endif
+
+        if (steps > 0 && model.Init(params)) {
+            model.SetActivity(model.size / 2, model.size / 2, 1.f);
+
+            model.Stimulate(WarmupSteps);
+            model.GetActivity();
+
+            auto startTime = std::chrono::high_resolution_clock::now();
+            model.Stimulate(steps);
+            model.GetActivity();
+            auto endTime = std::chrono::high_resolution_clock::now();
+
+#ifdef USE_OPENCL
+            // Model silently falls back to the CPU when OpenCL fails
+            if (backend.kind != BACKEND_OPENCL || model.IsEnabledOpenCL())
+#endif
+            {
+                auto duration = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+                stepTime = static_cast<double>(duration.count()) / steps;
+            }
+        }
+    }
+
+#ifdef USE_OPENCL
+    if (commandQueue) {
+        clReleaseCommandQueue(commandQueue);
+    }
+    if (context) {
+        clReleaseContext(context);
+    }
+#endif
+
+    return stepTime;
+}
+
+// Hash of the machine and model configuration
+static uint64_t GetBackendsHash(const std::vector<ComputeBackend>& backends, const NeuralFieldModelParams& params) {
+    std::stringstream s;
+    s << std::thread::hardware_concurrency() << ";";
+    for (const auto& b : backends) {
+        s << g_BackendKindNames.at(b.kind) << ":" << b.platformNum << ":" << b.deviceNum << ":" << b.name << ";";
+    }
+    for (const auto& p : params) {
+        s << p.first << "=" << p.second << ";";
+    }
+
+    return ParallelUtils::Hash(s.str());
+}
+
+static std::filesystem::path GetBackendCachePath() {
+    std::filesystem::path cacheDir = ParallelUtils::GetCacheDir();
+    if (!cacheDir.empty()) {
+        return cacheDir / BackendCacheFileName;
+    }
+    return {};
+}
+
+static bool LoadCachedBackend(const std::filesystem::path& path, uint64_t hash,
+    const std::vector<ComputeBackend>& backends, size_t& backendIdx) {
+    std::ifstream f(path);
+    if (!f) {
+        return false;
+    }
+
+    // Lines of "<hash> <kind> <platform> <device>", backends other than OpenCL have zero numbers
+    std::string line;
+    while (std::getline(f, line)) {
+        std::istringstream s(line);
+        uint64_t lineHash = 0;
+        std::string kindName;
+        size_t platformNum = 0, deviceNum = 0;
+        if (!(s >> std::hex >> lineHash >> std::dec >> kindName >> platformNum >> deviceNum) ||
+            lineHash != hash) {
+            continue;
+        }
+
+        for (size_t i = 0; i < backends.size(); i++) {
+            if (g_BackendKindNames.at(backends[i].kind) == kindName &&
+                backends[i].platformNum == platformNum && backends[i].deviceNum == deviceNum) {
+                backendIdx = i;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static void SaveCachedBackend(const std::filesystem::path& path, uint64_t hash, const ComputeBackend& backend) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    std::ofstream f(path, std::ios::app);
+    if (!f) {
+        LOGW << "Unable to store selected backend in " << path;
+        return;
+    }
+
+    f << ParallelUtils::GetHashString(hash) << " " << g_BackendKindNames.at(backend.kind) << " "
+        << backend.platformNum << " " << backend.deviceNum << std::endl;
+}
+
+size_t SelectComputeBackend(const std::vector<ComputeBackend>& backends, const NeuralFieldModelParams& params,
+    const BenchmarkFunc& benchmark) {
+    if (backends.size() < 2) {
+        return 0;
+    }
+
+    const uint64_t hash = GetBackendsHash(backends, params);
+    const std::filesystem::path cachePath = GetBackendCachePath();
+
+    size_t backendIdx = 0;
+    if (!cachePath.empty() && LoadCachedBackend(cachePath, hash, backends, backendIdx)) {
+        LOGI << "Use cached choice of compute backend : " << backends[backendIdx].name;
+        return backendIdx;
+    }
+
+    double bestTime = -1.0;
+    for (size_t i = 0; i < backends.size(); i++) {
+        double stepTime = benchmark(backends[i], params, BenchmarkSteps);
+        if (stepTime < 0.0) {
+            continue;
+        }
+
+        LOGI << "Backend " << backends[i].name << " : " << stepTime << " us per step";
+        if (bestTime < 0.0 || stepTime < bestTime) {
+            bestTime = stepTime;
+            backendIdx = i;
+        }
+    }
+
+    LOGI << "Selected compute backend : " << backends[backendIdx].name;
+
+    if (!cachePath.empty()) {
+        SaveCachedBackend(cachePath, hash, backends[backendIdx]);
+    }
+
+    return backendIdx;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+/*****************************************************************************
+ * Compute backends of the model: the CPU path, every OpenCL device and
+ * compute shaders of the application. The fastest one for the configuration
+ * is found by a short benchmark
+ ****************************************************************************/
+enum ComputeBackendKind : int {
+    BACKEND_CPU = 0,
+    BACKEND_OPENCL = 1,
+    BACKEND_COMPUTE_SHADERS = 2 // OpenGL compute shaders, added by the application with a context
+};
+
+struct ComputeBackend {
+    ComputeBackendKind kind = BACKEND_CPU;
+    size_t platformNum = 0; // 1-based numbers of OpenCL platform and device, zero for other backends
+    size_t deviceNum = 0;
+    std::string name;
+};
+
+// Average time of a model step on the backend in microseconds, negative on failure
+using BenchmarkFunc = std::function<double(const ComputeBackend& backend, const NeuralFieldModelParams& params, int steps)>;
+
+// CPU backend first, then OpenCL devices when built with OpenCL
+std::vector<ComputeBackend> GetComputeBackends();
+
+// Benchmark of the CPU and OpenCL backends, compute shaders need the application
+double BenchmarkComputeBackend(const ComputeBackend& backend, const NeuralFieldModelParams& params, int steps);
+
+// Index of the fastest backend for the params. The choice is cached on disk
+// for the set of backends and the params, so the benchmark runs only once
+size_t SelectComputeBackend(const std::vector<ComputeBackend>& backends, const NeuralFieldModelParams& params,
+    const BenchmarkFunc& benchmark = BenchmarkComputeBackend);
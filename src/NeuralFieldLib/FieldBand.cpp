@@ -0,0 +1,130 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "FieldBand.h"
+
+static std::vector<int> CreateColumnIndices(const kernel_t* k, size_t size) {
+    int k2 = static_cast<int>(k->size / 2);
+    std::vector<int> indices(size * k->size);
+    for (int j = 0; j < static_cast<int>(size); j++) {
+        for (int n = 0; n < static_cast<int>(k->size); n++) {
+            indices[j * k->size + n] = static_cast<int>(normalize_index(j + n - k2, size, k->mode));
+        }
+    }
+    return indices;
+}
+
+bool FieldBand::Init(size_t size, size_t maxRowsCount, const kernel_t* excitementKernel,
+    const kernel_t* inhibitionKernel) {
+    Release();
+
+    if (!excitementKernel || !inhibitionKernel) {
+        return false;
+    }
+
+    this->size = size;
+    this->ke = excitementKernel;
+    this->ki = inhibitionKernel;
+
+    halo = std::max(ke->size, ki->size) / 2;
+
+    excitementColumns = CreateColumnIndices(ke, size);
+    inhibitionColumns = CreateColumnIndices(ki, size);
+
+    field = MatrixGuard_t(matrix_allocate(maxRowsCount + 2 * halo, size), matrix_free);
+    excitementRows = MatrixGuard_t(matrix_allocate(maxRowsCount + 2 * halo, size), matrix_free);
+    inhibitionRows = MatrixGuard_t(matrix_allocate(maxRowsCount + 2 * halo, size), matrix_free);
+
+    return field && excitementRows && inhibitionRows;
+}
+
+void FieldBand::Release() {
+    field.reset();
+    excitementRows.reset();
+    inhibitionRows.reset();
+
+    excitementColumns.clear();
+    inhibitionColumns.clear();
+
+    ke = nullptr;
+    ki = nullptr;
+}
+
+void FieldBand::Threshold(const float* activity, size_t rowsCount) {
+    float* own = GetFieldRow(halo);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+    for (int idx = 0; idx < static_cast<int>(rowsCount * size); idx++) {
+        own[idx] = (activity[idx] > 0.0) ? 1.0 : 0.0;
+    }
+}
+
+void FieldBand::BlurRows(size_t firstExtRow, size_t lastExtRow) {
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+    for (int row = static_cast<int>(firstExtRow); row < static_cast<int>(lastExtRow); row++) {
+        const float* src = field->data + row * size;
+        float* dstE = excitementRows->data + row * size;
+        float* dstI = inhibitionRows->data + row * size;
+
+        for (size_t j = 0; j < size; j++) {
+            const int* colsE = excitementColumns.data() + j * ke->size;
+            const int* colsI = inhibitionColumns.data() + j * ki->size;
+
+            float e = 0.0;
+            for (size_t n = 0; n < ke->size; n++) {
+                e += src[colsE[n]] * ke->data[n];
+            }
+
+            float i = 0.0;
+            for (size_t n = 0; n < ki->size; n++) {
+                i += src[colsI[n]] * ki->data[n];
+            }
+
+            dstE[j] = e;
+            dstI[j] = i;
+        }
+    }
+}
+
+void FieldBand::BlurColumns(size_t firstOwnRow, size_t lastOwnRow, const float* stimulus, float* activity,
+    double h, double pi_k, double pi_m) {
+    const size_t ke2 = ke->size / 2;
+    const size_t ki2 = ki->size / 2;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+    for (int row = static_cast<int>(firstOwnRow); row < static_cast<int>(lastOwnRow); row++) {
+        // Rows of the horizontal passes that correspond to the first taps
+        const float* srcE = excitementRows->data + (halo + row - ke2) * size;
+        const float* srcI = inhibitionRows->data + (halo + row - ki2) * size;
+
+        const float* s = stimulus + row * size;
+        float* dst = activity + row * size;
+
+        for (size_t j = 0; j < size; j++) {
+            float e = 0.0;
+            for (size_t n = 0; n < ke->size; n++) {
+                e += srcE[j + n * size] * ke->data[n];
+            }
+
+            float i = 0.0;
+            for (size_t n = 0; n < ki->size; n++) {
+                i += srcI[j + n * size] * ki->data[n];
+            }
+
+            // Same order of operations as NeuralFieldModel::Stimulate
+            e *= pi_k;
+            i *= pi_m;
+
+            float a = h;
+            a += e;
+            a -= i;
+            a += s[j];
+            dst[j] = a;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+/*****************************************************************************
+ * FieldBand - contiguous band of rows of the field with halos of the width
+ * of the largest kernel radius above and below it
+ *
+ * Rows of the band are numbered with halos, so the own rows start at the
+ * halo width. Once the halos of the thresholded activity are filled, the own
+ * rows are convolved without access to the rest of the field.
+ ****************************************************************************/
+class FieldBand {
+public:
+    // Kernels are not owned and must outlive the band
+    bool Init(size_t size, size_t maxRowsCount, const kernel_t* excitementKernel,
+        const kernel_t* inhibitionKernel);
+
+    void Release();
+
+    size_t GetHaloWidth() const { return halo; }
+
+    const std::vector<int>& GetExcitementColumns() const { return excitementColumns; }
+    const std::vector<int>& GetInhibitionColumns() const { return inhibitionColumns; }
+
+    // Row of the thresholded field with halos
+    float* GetFieldRow(size_t extRow) { return field->data + extRow * size; }
+
+    // Thresholds own rows of the activity into the middle of the field
+    void Threshold(const float* activity, size_t rowsCount);
+
+    // Horizontal passes of both kernels over rows of the field with halos
+    void BlurRows(size_t firstExtRow, size_t lastExtRow);
+
+    // Vertical passes over own rows, stimulus and activity start at the first own row
+    void BlurColumns(size_t firstOwnRow, size_t lastOwnRow, const float* stimulus, float* activity,
+        double h, double pi_k, double pi_m);
+
+private:
+    size_t size = 0;
+    size_t halo = 0;
+
+    const kernel_t* ke = nullptr;
+    const kernel_t* ki = nullptr;
+
+    // Thresholded activity and horizontal blur passes
+    MatrixGuard_t field;
+    MatrixGuard_t excitementRows;
+    MatrixGuard_t inhibitionRows;
+
+    // Source columns of every kernel tap for the horizontal passes
+    std::vector<int> excitementColumns;
+    std::vector<int> inhibitionColumns;
+};
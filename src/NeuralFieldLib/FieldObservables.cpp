@@ -0,0 +1,132 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "ParallelUtils.h"
+#include "FieldObservables.h"
+
+double field_active_fraction(const matrix_t* m) {
+    assert(m);
+    assert(m->data);
+
+    size_t active = 0;
+#ifdef USE_OPENMP
+#pragma omp parallel for reduction(+:active)
+#endif
+    for (int idx = 0; idx < static_cast<int>(m->dataSize); idx++) {
+        if (m->data[idx] > 0.0) {
+            active++;
+        }
+    }
+
+    return static_cast<double>(active) / static_cast<double>(m->dataSize);
+}
+
+int field_bumps_count(const matrix_t* m, KernelMode mode) {
+    assert(m);
+    assert(m->data);
+
+    const int rows = static_cast<int>(m->rows);
+    const int cols = static_cast<int>(m->cols);
+    const bool wrap = (mode == MODE_WRAP);
+
+    std::vector<uint8_t> visited(m->dataSize, 0);
+    std::vector<int> stack;
+
+    auto visit = [&](int row, int col) {
+        if (wrap) {
+            row = (row + rows) % rows;
+            col = (col + cols) % cols;
+        }
+        else if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            return;
+        }
+
+        int idx = row * cols + col;
+        if (!visited[idx] && m->data[idx] > 0.0) {
+            visited[idx] = 1;
+            stack.push_back(idx);
+        }
+    };
+
+    int bumps = 0;
+    for (int idx = 0; idx < static_cast<int>(m->dataSize); idx++) {
+        if (visited[idx] || m->data[idx] <= 0.0) {
+            continue;
+        }
+
+        bumps++;
+        visited[idx] = 1;
+        stack.push_back(idx);
+
+        while (!stack.empty()) {
+            int cell = stack.back();
+            stack.pop_back();
+
+            int row = cell / cols;
+            int col = cell % cols;
+            visit(row - 1, col);
+            visit(row + 1, col);
+            visit(row, col - 1);
+            visit(row, col + 1);
+        }
+    }
+
+    return bumps;
+}
+
+uint64_t field_active_hash(const matrix_t* m) {
+    assert(m);
+    assert(m->data);
+
+    // Hash of the packed bits of the thresholded activity, hashed in blocks
+    uint64_t hash = ParallelUtils::HashOffsetBasis;
+    uint8_t block[64];
+    size_t blockSize = 0;
+    uint8_t bits = 0;
+    for (size_t idx = 0; idx < m->dataSize; idx++) {
+        bits = (bits << 1) | ((m->data[idx] > 0.0) ? 1 : 0);
+        if ((idx % 8) == 7) {
+            block[blockSize++] = bits;
+            bits = 0;
+            if (blockSize == sizeof(block)) {
+                hash = ParallelUtils::Hash(block, blockSize, hash);
+                blockSize = 0;
+            }
+        }
+    }
+    block[blockSize++] = bits;
+    hash = ParallelUtils::Hash(block, blockSize, hash);
+
+    return hash;
+}
+
+FieldPeriodDetector::FieldPeriodDetector(size_t historySize)
+    : historySize(historySize) {
+    history.reserve(historySize);
+}
+
+int FieldPeriodDetector::Push(uint64_t hash) {
+    int period = 0;
+
+    // Look for the most recent equal state first
+    size_t count = history.size();
+    for (size_t p = 1; p <= count; p++) {
+        size_t idx = (next + historySize - p) % historySize;
+        if (history[idx] == hash) {
+            period = static_cast<int>(p);
+            break;
+        }
+    }
+
+    if (history.size() < historySize) {
+        history.push_back(hash);
+    }
+    else if (historySize > 0) {
+        history[next] = hash;
+    }
+    if (historySize > 0) {
+        next = (next + 1) % historySize;
+    }
+
+    return period;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+/*****************************************************************************
+ * Summary observables of the field state for headless runs
+ ****************************************************************************/
+
+// Share of cells with positive activity
+double field_active_fraction(const matrix_t* m);
+
+// Number of 4-connected regions with positive activity.
+// Regions are joined across the borders when the field wraps around.
+int field_bumps_count(const matrix_t* m, KernelMode mode);
+
+// Hash of the thresholded activity. Next step only depends on the
+// thresholded activity, so equal hashes mean that the field repeats itself.
+uint64_t field_active_hash(const matrix_t* m);
+
+/*****************************************************************************
+ * FieldPeriodDetector - finds the period of the field from hashes of the
+ * last steps
+ ****************************************************************************/
+class FieldPeriodDetector {
+public:
+    explicit FieldPeriodDetector(size_t historySize);
+
+    // Returns the period if the field repeats one of the previous states or 0
+    int Push(uint64_t hash);
+
+private:
+    std::vector<uint64_t> history;
+    size_t historySize = 0;
+    size_t next = 0;
+};
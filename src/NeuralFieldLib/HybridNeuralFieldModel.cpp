@@ -0,0 +1,683 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#ifdef USE_OPENCL
+#include "ParallelUtils.h"
+#endif
+#include "NeuralFieldModel.h"
+#include "FieldBand.h"
+#include "HybridNeuralFieldModel.h"
+
+#ifdef USE_OPENCL
+
+// Weight of the last measurement in the smoothed share of the device
+constexpr double RebalanceFactor = 0.25;
+
+// Split moves by at least this share of rows, so noise in timings doesn't cause transfers
+constexpr double MinSplitChange = 0.01;
+
+/*
+ * Threshold kernel, own rows of the activity into the middle of the device band
+ */
+static const std::string BandThresholdKernelName = "BandThreshold";
+static const std::string BandThresholdKernelSource = R"opencl(
+__kernel void BandThreshold(__global const float *a, uint nmatrix, uint halo, __global float *field)
+{
+    const size_t col = get_global_id(0);
+    const size_t row = get_global_id(1);
+
+    field[(halo + row) * nmatrix + col] = (a[row * nmatrix + col] > 0.0f) ? 1.0f : 0.0f;
+}
+)opencl";
+
+/*
+ * Horizontal passes of both kernels over rows of the device band with halos.
+ * Source columns of the taps are taken from the same tables as on the CPU
+ */
+static const std::string BandBlurRowsKernelName = "BandBlurRows";
+static const std::string BandBlurRowsKernelSource = R"opencl(
+#pragma OPENCL FP_CONTRACT OFF
+
+__kernel void BandBlurRows(__global const float *field,
+                     __global const int *colsE, __constant float *ke, uint nke,
+                     __global const int *colsI, __constant float *ki, uint nki,
+                     uint nmatrix, __global float *outE, __global float *outI)
+{
+    const size_t col = get_global_id(0);
+    const size_t row = get_global_id(1);
+
+    __global const float *src = field + row * nmatrix;
+    __global const int *ce = colsE + col * nke;
+    __global const int *ci = colsI + col * nki;
+
+    float sumE = 0.0f;
+    for (uint n = 0; n < nke; n++) {
+        sumE += src[ce[n]] * ke[n];
+    }
+
+    float sumI = 0.0f;
+    for (uint n = 0; n < nki; n++) {
+        sumI += src[ci[n]] * ki[n];
+    }
+
+    outE[row * nmatrix + col] = sumE;
+    outI[row * nmatrix + col] = sumI;
+}
+)opencl";
+
+/*
+ * Vertical passes over own rows of the device band and the stimulation
+ */
+static const std::string BandBlurColumnsKernelName = "BandBlurColumns";
+static const std::string BandBlurColumnsKernelSource = R"opencl(
+#pragma OPENCL FP_CONTRACT OFF
+
+__kernel void BandBlurColumns(__global const float *e, __global const float *i,
+                     __constant float *ke, uint nke, __constant float *ki, uint nki,
+                     uint nmatrix, uint halo, __global const float *s,
+                     float h, float pik, float pim, __global float *a)
+{
+    const size_t col = get_global_id(0);
+    const size_t row = get_global_id(1);
+
+    // Rows of the horizontal passes that correspond to the first taps
+    __global const float *srcE = e + (halo + row - nke / 2) * nmatrix + col;
+    __global const float *srcI = i + (halo + row - nki / 2) * nmatrix + col;
+
+    float sumE = 0.0f;
+    for (uint n = 0; n < nke; n++) {
+        sumE += srcE[n * nmatrix] * ke[n];
+    }
+
+    float sumI = 0.0f;
+    for (uint n = 0; n < nki; n++) {
+        sumI += srcI[n * nmatrix] * ki[n];
+    }
+
+    const size_t idx = row * nmatrix + col;
+    a[idx] = h + sumE * pik - sumI * pim + s[idx];
+}
+)opencl";
+
+static size_t GetSplitRowForShare(double deviceShare, size_t size) {
+    long row = std::lround(deviceShare * size);
+    return static_cast<size_t>(std::clamp(row, 1L, static_cast<long>(size) - 1));
+}
+
+// Time between start of the first command and end of the last one in seconds
+static double GetEventsTime(cl_event first, cl_event last) {
+    if (!first || !last) {
+        return 0.0;
+    }
+
+    cl_ulong start = 0, end = 0;
+    cl_int status = CL_SUCCESS;
+    status |= clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    status |= clGetEventProfilingInfo(last, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+
+    return (status == CL_SUCCESS && end > start) ? static_cast<double>(end - start) * 1e-9 : 0.0;
+}
+
+static void ReleaseEvent(cl_event* event) {
+    if (*event) {
+        clReleaseEvent(*event);
+        *event = 0;
+    }
+}
+
+HybridNeuralFieldModel::~HybridNeuralFieldModel() {
+    Release();
+    ReleaseOpenCLObjects();
+}
+
+bool HybridNeuralFieldModel::InitOpenCLContext(cl_device_id device, cl_context context,
+    cl_command_queue commandQueue) {
+    this->device = device;
+    this->context = context;
+    this->commandQueue = commandQueue;
+
+    cl_command_queue_properties properties = 0;
+    cl_int status = clGetCommandQueueInfo(commandQueue, CL_QUEUE_PROPERTIES, sizeof(properties), &properties, NULL);
+    isProfilingEnabled = (status == CL_SUCCESS) && (properties & CL_QUEUE_PROFILING_ENABLE);
+    if (!isProfilingEnabled) {
+        LOGW << "OpenCL queue doesn't record timings, split of rows between CPU and device is fixed";
+    }
+
+    if (!InitOpenCLObjects()) {
+        LOGE << "Failed to init OpenCL programs for hybrid neural field simulation";
+        ReleaseOpenCLObjects();
+        return false;
+    }
+
+    return true;
+}
+
+bool HybridNeuralFieldModel::Init(const NeuralFieldModelParams& params) {
+    Release();
+
+    if (!thresholdKernel || !blurRowsKernel || !blurColumnsKernel) {
+        LOGE << "Hybrid model needs an OpenCL device";
+        return false;
+    }
+
+    Set(params);
+
+    excitement_kernel = KernelGuard_t(kernel_create(sigma_k, mode), kernel_free);
+    inhibition_kernel = KernelGuard_t(kernel_create(sigma_m, mode), kernel_free);
+    if (!excitement_kernel || !inhibition_kernel) {
+        return false;
+    }
+
+    // CPU band may grow up to the whole field except one row
+    if (!cpuBand.Init(size, size, excitement_kernel.get(), inhibition_kernel.get())) {
+        return false;
+    }
+    halo = cpuBand.GetHaloWidth();
+
+    if (size < 2 * (halo + 1)) {
+        LOGE << "Unable to split field of size " << size << " with halo width " << halo;
+        return false;
+    }
+
+    stimulus = MatrixGuard_t(matrix_allocate(size, size), matrix_free);
+    activity = MatrixGuard_t(matrix_allocate(size, size), matrix_free);
+
+    splitRow = GetSplitRowForShare(deviceShare, size);
+    InitHaloRows();
+
+    if (!InitOpenCLBuffers()) {
+        LOGE << "Error initialising OpenCL buffers for hybrid neural field simulation";
+        return false;
+    }
+
+    Restart();
+
+    return true;
+}
+
+void HybridNeuralFieldModel::InitHaloRows() {
+    auto createHalos = [this](size_t firstRow, size_t lastRow) {
+        std::vector<HaloRow> halos;
+        for (size_t e = 0; e < halo; e++) {
+            int upperRow = static_cast<int>(firstRow + e) - static_cast<int>(halo);
+            int lowerRow = static_cast<int>(lastRow + e);
+
+            halos.push_back({ e, normalize_index(upperRow, size, mode) });
+            halos.push_back({ halo + (lastRow - firstRow) + e, normalize_index(lowerRow, size, mode) });
+        }
+        return halos;
+    };
+
+    deviceHalos = createHalos(0, splitRow);
+    cpuHalos = createHalos(splitRow, size);
+}
+
+void HybridNeuralFieldModel::Release() {
+    // Pending commands may still use the buffers
+    if (memActivityMatrix) {
+        clFinish(commandQueue);
+    }
+
+    ReleaseEvent(&haloReadEvent);
+    ReleaseEvent(&thresholdEvent);
+    ReleaseEvent(&blurRowsEvent);
+    ReleaseEvent(&blurColumnsEvent);
+
+    ReleaseOpenCLBuffers();
+
+    cpuBand.Release();
+
+    stimulus.reset();
+    activity.reset();
+
+    excitement_kernel.reset();
+    inhibition_kernel.reset();
+}
+
+void HybridNeuralFieldModel::Restart() {
+    matrix_random_f(stimulus.get());
+    matrix_scalar_mul(stimulus.get(), -h);
+
+    matrix_scalar_set(activity.get(), h);
+
+    cl_int status = CL_SUCCESS;
+
+    status |= clEnqueueWriteBuffer(commandQueue, memStimulusMatrix, CL_FALSE, 0,
+        sizeof(cl_float) * stimulus->dataSize, stimulus->data, 0, NULL, NULL);
+
+    cl_float fh = static_cast<cl_float>(h);
+    status |= clEnqueueFillBuffer(commandQueue, memActivityMatrix, &fh, sizeof(fh), 0,
+        sizeof(cl_float) * activity->dataSize, 0, NULL, NULL);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to setup OpenCL buffer queue : " << ParallelUtils::GetOpenCLError(status);
+    }
+
+    isHostActivityValid = true;
+}
+
+void HybridNeuralFieldModel::Stimulate(int steps) {
+    for (int i = 0; i < steps; i++) {
+        Step();
+    }
+
+    isHostActivityValid = false;
+}
+
+void HybridNeuralFieldModel::SetActivity(size_t x, size_t y, float a) {
+    if (y < splitRow && x < size) {
+        // Write a single value instead of the whole band
+        size_t idx = y * size + x;
+        cl_float value = a;
+
+        cl_int status = clEnqueueWriteBuffer(commandQueue, memActivityMatrix, CL_TRUE,
+            sizeof(cl_float) * idx, sizeof(cl_float), &value, 0, NULL, NULL);
+        if (status != CL_SUCCESS) {
+            LOGE << "Failed to write OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
+        }
+    }
+
+    matrix_set(activity.get(), y, x, a);
+}
+
+matrix_t* HybridNeuralFieldModel::GetActivity() {
+    if (!isHostActivityValid) {
+        cl_int status = clEnqueueReadBuffer(commandQueue, memActivityMatrix, CL_TRUE, 0,
+            sizeof(cl_float) * splitRow * size, activity->data, 0, NULL, NULL);
+        if (status != CL_SUCCESS) {
+            LOGE << "Failed to read result buffer after OpenCL kernel run : " << ParallelUtils::GetOpenCLError(status);
+        }
+        else {
+            isHostActivityValid = true;
+        }
+    }
+
+    return activity.get();
+}
+
+void HybridNeuralFieldModel::Step() {
+    const size_t cpuRowsCount = size - splitRow;
+    float* cpuActivity = activity->data + splitRow * size;
+    const float* cpuStimulus = stimulus->data + splitRow * size;
+
+    // Device band starts with the threshold and sends rows for halos of the CPU band
+    CalcDeviceThreshold();
+
+    auto thresholdStartTime = std::chrono::steady_clock::now();
+    cpuBand.Threshold(cpuActivity, cpuRowsCount);
+    for (const HaloRow& r : cpuHalos) {
+        if (r.srcRow >= splitRow) {
+            memcpy(cpuBand.GetFieldRow(r.extRow), cpuBand.GetFieldRow(halo + r.srcRow - splitRow),
+                sizeof(float) * size);
+        }
+    }
+    auto thresholdEndTime = std::chrono::steady_clock::now();
+
+    // Halos of the device band are complete, the rest of its step runs in the background
+    CalcDeviceBand();
+
+    if (haloReadEvent) {
+        cl_int status = clWaitForEvents(1, &haloReadEvent);
+        if (status != CL_SUCCESS) {
+            LOGE << "Failed to read OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
+        }
+        ReleaseEvent(&haloReadEvent);
+    }
+
+    auto blurStartTime = std::chrono::steady_clock::now();
+    cpuBand.BlurRows(0, cpuRowsCount + 2 * halo);
+    cpuBand.BlurColumns(0, cpuRowsCount, cpuStimulus, cpuActivity, h, pi_k, pi_m);
+    auto blurEndTime = std::chrono::steady_clock::now();
+
+    // Field of the CPU band is a source of halo writes until the device is done
+    cl_int status = clFinish(commandQueue);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to finish OpenCL command queue : " << ParallelUtils::GetOpenCLError(status);
+    }
+
+    double cpuTime = std::chrono::duration<double>(
+        (thresholdEndTime - thresholdStartTime) + (blurEndTime - blurStartTime)).count();
+    double deviceTime = GetEventsTime(thresholdEvent, thresholdEvent) +
+        GetEventsTime(blurRowsEvent, blurColumnsEvent);
+
+    ReleaseEvent(&thresholdEvent);
+    ReleaseEvent(&blurRowsEvent);
+    ReleaseEvent(&blurColumnsEvent);
+
+    Rebalance(deviceTime, cpuTime);
+}
+
+void HybridNeuralFieldModel::Rebalance(double deviceTime, double cpuTime) {
+    if (deviceTime <= 0.0 || cpuTime <= 0.0) {
+        return;
+    }
+
+    // Share of rows that makes both bands finish at the same time
+    double deviceRate = static_cast<double>(splitRow) / deviceTime;
+    double cpuRate = static_cast<double>(size - splitRow) / cpuTime;
+    double balancedShare = deviceRate / (deviceRate + cpuRate);
+
+    deviceShare += RebalanceFactor * (balancedShare - deviceShare);
+
+    size_t newSplitRow = GetSplitRowForShare(deviceShare, size);
+    size_t change = (newSplitRow > splitRow) ? (newSplitRow - splitRow) : (splitRow - newSplitRow);
+    if (static_cast<double>(change) >= std::max(1.0, MinSplitChange * size)) {
+        MoveSplit(newSplitRow);
+    }
+}
+
+void HybridNeuralFieldModel::MoveSplit(size_t newSplitRow) {
+    const size_t rowBytes = sizeof(cl_float) * size;
+    cl_int status = CL_SUCCESS;
+
+    if (newSplitRow > splitRow) {
+        // Rows of the CPU band move to the device
+        status = clEnqueueWriteBuffer(commandQueue, memActivityMatrix, CL_TRUE, rowBytes * splitRow,
+            rowBytes * (newSplitRow - splitRow), activity->data + splitRow * size, 0, NULL, NULL);
+    }
+    else {
+        // Rows of the device band move to the CPU
+        status = clEnqueueReadBuffer(commandQueue, memActivityMatrix, CL_TRUE, rowBytes * newSplitRow,
+            rowBytes * (splitRow - newSplitRow), activity->data + newSplitRow * size, 0, NULL, NULL);
+    }
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to move rows between CPU and OpenCL device : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    LOGD << "Rows [0, " << newSplitRow << ") of " << size << " are calculated on OpenCL device";
+
+    splitRow = newSplitRow;
+    InitHaloRows();
+}
+
+bool HybridNeuralFieldModel::InitOpenCLObjects() {
+    if (!ParallelUtils::CreateProgram(context, device,
+        BandThresholdKernelName, BandThresholdKernelSource,
+        &thresholdProgram, &thresholdKernel)) {
+        LOGE << "Failed to create band threshold program";
+        return false;
+    }
+
+    if (!ParallelUtils::CreateProgram(context, device,
+        BandBlurRowsKernelName, BandBlurRowsKernelSource,
+        &blurRowsProgram, &blurRowsKernel)) {
+        LOGE << "Failed to create band horizontal blur program";
+        return false;
+    }
+
+    if (!ParallelUtils::CreateProgram(context, device,
+        BandBlurColumnsKernelName, BandBlurColumnsKernelSource,
+        &blurColumnsProgram, &blurColumnsKernel)) {
+        LOGE << "Failed to create band vertical blur program";
+        return false;
+    }
+
+    return true;
+}
+
+void HybridNeuralFieldModel::ReleaseOpenCLObjects() {
+    ReleaseOpenCLBuffers();
+
+    for (cl_kernel* kernel : { &thresholdKernel, &blurRowsKernel, &blurColumnsKernel }) {
+        if (*kernel) {
+            clReleaseKernel(*kernel);
+            *kernel = 0;
+        }
+    }
+
+    for (cl_program* program : { &thresholdProgram, &blurRowsProgram, &blurColumnsProgram }) {
+        if (*program) {
+            clReleaseProgram(*program);
+            *program = 0;
+        }
+    }
+}
+
+bool HybridNeuralFieldModel::InitOpenCLBuffers() {
+    cl_int status, callStatus;
+
+    const size_t matrixBytes = sizeof(cl_float) * size * size;
+    const size_t bandBytes = sizeof(cl_float) * (size + 2 * halo) * size;
+
+    const std::vector<int>& excitementColumns = cpuBand.GetExcitementColumns();
+    const std::vector<int>& inhibitionColumns = cpuBand.GetInhibitionColumns();
+
+    // --------------------------------------------------------
+    // Allocate the OpenCL buffer memory objects
+    status = CL_SUCCESS;
+
+    memActivityMatrix = clCreateBuffer(context, CL_MEM_READ_WRITE, matrixBytes, NULL, &callStatus);
+    status |= callStatus;
+
+    memStimulusMatrix = clCreateBuffer(context, CL_MEM_READ_ONLY, matrixBytes, NULL, &callStatus);
+    status |= callStatus;
+
+    memField = clCreateBuffer(context, CL_MEM_READ_WRITE, bandBytes, NULL, &callStatus);
+    status |= callStatus;
+
+    memExcitementRows = clCreateBuffer(context, CL_MEM_READ_WRITE, bandBytes, NULL, &callStatus);
+    status |= callStatus;
+
+    memInhibitionRows = clCreateBuffer(context, CL_MEM_READ_WRITE, bandBytes, NULL, &callStatus);
+    status |= callStatus;
+
+    memExcitementColumns = clCreateBuffer(context, CL_MEM_READ_ONLY,
+        sizeof(cl_int) * excitementColumns.size(), NULL, &callStatus);
+    status |= callStatus;
+
+    memInhibitionColumns = clCreateBuffer(context, CL_MEM_READ_ONLY,
+        sizeof(cl_int) * inhibitionColumns.size(), NULL, &callStatus);
+    status |= callStatus;
+
+    memExcitementKernel = clCreateBuffer(context, CL_MEM_READ_ONLY,
+        sizeof(cl_float) * excitement_kernel->size, NULL, &callStatus);
+    status |= callStatus;
+
+    memInhibitionKernel = clCreateBuffer(context, CL_MEM_READ_ONLY,
+        sizeof(cl_float) * inhibition_kernel->size, NULL, &callStatus);
+    status |= callStatus;
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to create OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    // --------------------------------------------------------
+    // Load kernels and column tables into memory objects
+    status = CL_SUCCESS;
+
+    status |= clEnqueueWriteBuffer(commandQueue, memExcitementColumns, CL_FALSE, 0,
+        sizeof(cl_int) * excitementColumns.size(), excitementColumns.data(), 0, NULL, NULL);
+
+    status |= clEnqueueWriteBuffer(commandQueue, memInhibitionColumns, CL_FALSE, 0,
+        sizeof(cl_int) * inhibitionColumns.size(), inhibitionColumns.data(), 0, NULL, NULL);
+
+    status |= clEnqueueWriteBuffer(commandQueue, memExcitementKernel, CL_FALSE, 0,
+        sizeof(cl_float) * excitement_kernel->size, excitement_kernel->data, 0, NULL, NULL);
+
+    status |= clEnqueueWriteBuffer(commandQueue, memInhibitionKernel, CL_FALSE, 0,
+        sizeof(cl_float) * inhibition_kernel->size, inhibition_kernel->data, 0, NULL, NULL);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to load kernels into OpenCL memory : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    return true;
+}
+
+void HybridNeuralFieldModel::ReleaseOpenCLBuffers() {
+    for (cl_mem* mem : { &memActivityMatrix, &memStimulusMatrix, &memField, &memExcitementRows,
+        &memInhibitionRows, &memExcitementColumns, &memInhibitionColumns,
+        &memExcitementKernel, &memInhibitionKernel }) {
+        if (*mem) {
+            clReleaseMemObject(*mem);
+            *mem = 0;
+        }
+    }
+}
+
+void HybridNeuralFieldModel::CalcDeviceThreshold() {
+    cl_int status;
+
+    const size_t rowBytes = sizeof(cl_float) * size;
+    const size_t globalWorkSize[2] = { size, splitRow };
+
+    cl_uint matrixSize = static_cast<cl_uint>(size);
+    cl_uint haloWidth = static_cast<cl_uint>(halo);
+
+    // --------------------------------------------------------
+    // Field = Heaviside(Activity) for own rows of the device band
+
+    status = CL_SUCCESS;
+
+    status |= clSetKernelArg(thresholdKernel, 0, sizeof(cl_mem), (void*)&memActivityMatrix);
+    status |= clSetKernelArg(thresholdKernel, 1, sizeof(cl_uint), (void*)&matrixSize);
+    status |= clSetKernelArg(thresholdKernel, 2, sizeof(cl_uint), (void*)&haloWidth);
+    status |= clSetKernelArg(thresholdKernel, 3, sizeof(cl_mem), (void*)&memField);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    status = clEnqueueNDRangeKernel(commandQueue, thresholdKernel, 2, NULL, globalWorkSize,
+        NULL, 0, NULL, isProfilingEnabled ? &thresholdEvent : NULL);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    // --------------------------------------------------------
+    // Exchange of halos that are own rows of the device band
+
+    status = CL_SUCCESS;
+
+    for (const HaloRow& r : deviceHalos) {
+        if (r.srcRow < splitRow) {
+            status |= clEnqueueCopyBuffer(commandQueue, memField, memField, rowBytes * (halo + r.srcRow),
+                rowBytes * r.extRow, rowBytes, 0, NULL, NULL);
+        }
+    }
+
+    for (const HaloRow& r : cpuHalos) {
+        if (r.srcRow < splitRow) {
+            // Commands run in order, so the last read completes after all others
+            ReleaseEvent(&haloReadEvent);
+            status |= clEnqueueReadBuffer(commandQueue, memField, CL_FALSE, rowBytes * (halo + r.srcRow),
+                rowBytes, cpuBand.GetFieldRow(r.extRow), 0, NULL, &haloReadEvent);
+        }
+    }
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to exchange halos with OpenCL device : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    status = clFlush(commandQueue);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to flush OpenCL command queue : " << ParallelUtils::GetOpenCLError(status);
+    }
+}
+
+void HybridNeuralFieldModel::CalcDeviceBand() {
+    cl_int status;
+
+    const size_t rowBytes = sizeof(cl_float) * size;
+
+    cl_uint matrixSize = static_cast<cl_uint>(size);
+    cl_uint haloWidth = static_cast<cl_uint>(halo);
+    cl_uint excitementSize = static_cast<cl_uint>(excitement_kernel->size);
+    cl_uint inhibitionSize = static_cast<cl_uint>(inhibition_kernel->size);
+
+    float fh = float(h);
+    float fpi_k = float(pi_k);
+    float fpi_m = float(pi_m);
+
+    // --------------------------------------------------------
+    // Exchange of halos that are rows of the CPU band
+
+    status = CL_SUCCESS;
+
+    for (const HaloRow& r : deviceHalos) {
+        if (r.srcRow >= splitRow) {
+            status |= clEnqueueWriteBuffer(commandQueue, memField, CL_FALSE, rowBytes * r.extRow, rowBytes,
+                cpuBand.GetFieldRow(halo + r.srcRow - splitRow), 0, NULL, NULL);
+        }
+    }
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to exchange halos with OpenCL device : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    // --------------------------------------------------------
+    // Excitement, Inhibition = HorizontalBlur(Field) for rows with halos
+
+    status = CL_SUCCESS;
+
+    status |= clSetKernelArg(blurRowsKernel, 0, sizeof(cl_mem), (void*)&memField);
+    status |= clSetKernelArg(blurRowsKernel, 1, sizeof(cl_mem), (void*)&memExcitementColumns);
+    status |= clSetKernelArg(blurRowsKernel, 2, sizeof(cl_mem), (void*)&memExcitementKernel);
+    status |= clSetKernelArg(blurRowsKernel, 3, sizeof(cl_uint), (void*)&excitementSize);
+    status |= clSetKernelArg(blurRowsKernel, 4, sizeof(cl_mem), (void*)&memInhibitionColumns);
+    status |= clSetKernelArg(blurRowsKernel, 5, sizeof(cl_mem), (void*)&memInhibitionKernel);
+    status |= clSetKernelArg(blurRowsKernel, 6, sizeof(cl_uint), (void*)&inhibitionSize);
+    status |= clSetKernelArg(blurRowsKernel, 7, sizeof(cl_uint), (void*)&matrixSize);
+    status |= clSetKernelArg(blurRowsKernel, 8, sizeof(cl_mem), (void*)&memExcitementRows);
+    status |= clSetKernelArg(blurRowsKernel, 9, sizeof(cl_mem), (void*)&memInhibitionRows);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    const size_t rowsWorkSize[2] = { size, splitRow + 2 * halo };
+    status = clEnqueueNDRangeKernel(commandQueue, blurRowsKernel, 2, NULL, rowsWorkSize,
+        NULL, 0, NULL, isProfilingEnabled ? &blurRowsEvent : NULL);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    // --------------------------------------------------------
+    // Activity = h + VerticalBlur(Excitement) * piK - VerticalBlur(Inhibition) * piM + Stimulus
+
+    status = CL_SUCCESS;
+
+    status |= clSetKernelArg(blurColumnsKernel, 0, sizeof(cl_mem), (void*)&memExcitementRows);
+    status |= clSetKernelArg(blurColumnsKernel, 1, sizeof(cl_mem), (void*)&memInhibitionRows);
+    status |= clSetKernelArg(blurColumnsKernel, 2, sizeof(cl_mem), (void*)&memExcitementKernel);
+    status |= clSetKernelArg(blurColumnsKernel, 3, sizeof(cl_uint), (void*)&excitementSize);
+    status |= clSetKernelArg(blurColumnsKernel, 4, sizeof(cl_mem), (void*)&memInhibitionKernel);
+    status |= clSetKernelArg(blurColumnsKernel, 5, sizeof(cl_uint), (void*)&inhibitionSize);
+    status |= clSetKernelArg(blurColumnsKernel, 6, sizeof(cl_uint), (void*)&matrixSize);
+    status |= clSetKernelArg(blurColumnsKernel, 7, sizeof(cl_uint), (void*)&haloWidth);
+    status |= clSetKernelArg(blurColumnsKernel, 8, sizeof(cl_mem), (void*)&memStimulusMatrix);
+    status |= clSetKernelArg(blurColumnsKernel, 9, sizeof(cl_float), (void*)&fh);
+    status |= clSetKernelArg(blurColumnsKernel, 10, sizeof(cl_float), (void*)&fpi_k);
+    status |= clSetKernelArg(blurColumnsKernel, 11, sizeof(cl_float), (void*)&fpi_m);
+    status |= clSetKernelArg(blurColumnsKernel, 12, sizeof(cl_mem), (void*)&memActivityMatrix);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    const size_t columnsWorkSize[2] = { size, splitRow };
+    status = clEnqueueNDRangeKernel(commandQueue, blurColumnsKernel, 2, NULL, columnsWorkSize,
+        NULL, 0, NULL, isProfilingEnabled ? &blurColumnsEvent : NULL);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    status = clFlush(commandQueue);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to flush OpenCL command queue : " << ParallelUtils::GetOpenCLError(status);
+    }
+}
+
+#endif /* USE_OPENCL */
@@ -0,0 +1,120 @@
+#pragma once
+
+#ifdef USE_OPENCL
+
+/*****************************************************************************
+ * HybridNeuralFieldModel - neural field split into two bands of rows, the
+ * upper band is calculated on an OpenCL device and the lower one on the CPU
+ *
+ * Both bands keep halos of the largest kernel radius, and every step only
+ * the thresholded rows referenced by the halos of the other band are
+ * exchanged. The split row follows throughput of the device and the CPU
+ * measured on the previous steps.
+ ****************************************************************************/
+class HybridNeuralFieldModel : public NeuralFieldParams {
+public:
+    HybridNeuralFieldModel() = default;
+    ~HybridNeuralFieldModel();
+
+    // Has to be called before Init. Throughput of the device is only measured
+    // on queues with profiling, otherwise the split stays fixed
+    bool InitOpenCLContext(cl_device_id device, cl_context context, cl_command_queue commandQueue);
+
+    bool Init(const NeuralFieldModelParams& params);
+
+    void Release();
+
+    void Restart();
+
+    void Stimulate(int steps = 1);
+
+    void SetActivity(size_t x, size_t y, float a);
+
+    // Activity on the host, rows of the device band are read back when out of date
+    matrix_t* GetActivity();
+
+    // Rows [0, split) are calculated on the device and the rest on the CPU
+    size_t GetSplitRow() const { return splitRow; }
+    size_t GetHaloWidth() const { return halo; }
+
+private:
+    bool InitOpenCLObjects();
+    void ReleaseOpenCLObjects();
+
+    bool InitOpenCLBuffers();
+    void ReleaseOpenCLBuffers();
+
+    void InitHaloRows();
+
+    void Step();
+    void CalcDeviceThreshold();
+    void CalcDeviceBand();
+
+    void Rebalance(double deviceTime, double cpuTime);
+    void MoveSplit(size_t newSplitRow);
+
+public:
+    KernelGuard_t excitement_kernel;
+    KernelGuard_t inhibition_kernel;
+
+    MatrixGuard_t stimulus;
+    MatrixGuard_t activity;
+
+private:
+    // Halo row of a band and the row of the field it is copied from
+    struct HaloRow {
+        size_t extRow = 0;
+        size_t srcRow = 0;
+    };
+
+    cl_device_id device = 0;
+    cl_context context = 0;
+    cl_command_queue commandQueue = 0;
+    bool isProfilingEnabled = false;
+
+    // Host copy of the device band matches the device buffer
+    bool isHostActivityValid = true;
+
+    size_t splitRow = 0;
+    size_t halo = 0;
+
+    // Smoothed share of rows calculated on the device
+    double deviceShare = 0.5;
+
+    FieldBand cpuBand;
+
+    std::vector<HaloRow> deviceHalos;
+    std::vector<HaloRow> cpuHalos;
+
+    // Last read of device rows into halos of the CPU band
+    cl_event haloReadEvent = 0;
+
+    // Kernels of the device band, timed on queues with profiling
+    cl_event thresholdEvent = 0;
+    cl_event blurRowsEvent = 0;
+    cl_event blurColumnsEvent = 0;
+
+    cl_mem memActivityMatrix = 0;
+    cl_mem memStimulusMatrix = 0;
+
+    // Device band with halos: thresholded activity and horizontal blur passes
+    cl_mem memField = 0;
+    cl_mem memExcitementRows = 0;
+    cl_mem memInhibitionRows = 0;
+
+    cl_mem memExcitementColumns = 0;
+    cl_mem memInhibitionColumns = 0;
+    cl_mem memExcitementKernel = 0;
+    cl_mem memInhibitionKernel = 0;
+
+    cl_program thresholdProgram = 0;
+    cl_kernel thresholdKernel = 0;
+
+    cl_program blurRowsProgram = 0;
+    cl_kernel blurRowsKernel = 0;
+
+    cl_program blurColumnsProgram = 0;
+    cl_kernel blurColumnsKernel = 0;
+};
+
+#endif /* USE_OPENCL */
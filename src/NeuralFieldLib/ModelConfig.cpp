@@ -0,0 +1,51 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "NeuralFieldModel.h"
+#include "ModelConfig.h"
+
+const std::map<std::string, KernelMode>& GetModelModes() {
+    static const std::map<std::string, KernelMode> ModelModes = {
+        {"wrap", KernelMode::MODE_WRAP},
+        {"reflect", KernelMode::MODE_REFLECT},
+        {"mirror", KernelMode::MODE_MIRROR}
+    };
+    return ModelModes;
+}
+
+NeuralFieldModelParams GetDefaultModelParams() {
+    return {
+        {"h", -0.1},
+        {"k", 0.05},
+        {"Kp", 0.125},
+        {"m", 0.025},
+        {"Mp", 0.0625},
+        {"size", 256},
+        {"mode", MODE_WRAP},
+    };
+}
+
+bool LoadModelParams(const std::string& configFilePath, NeuralFieldModelParams& params) {
+    params = GetDefaultModelParams();
+
+    if (configFilePath.empty()) {
+        return false;
+    }
+
+    INIReader reader(configFilePath);
+    if (reader.ParseError() != 0) {
+        return false;
+    }
+
+    for (const char* key : { "h", "k", "Kp", "m", "Mp" }) {
+        params[key] = reader.GetReal("", key, params[key]);
+    }
+    params["size"] = reader.GetInteger("", "size", static_cast<long>(params["size"]));
+
+    auto mode = GetModelModes().find(reader.Get("", "mode", "wrap"));
+    if (mode != GetModelModes().end()) {
+        params["mode"] = mode->second;
+    }
+
+    return true;
+}
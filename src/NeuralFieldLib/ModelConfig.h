@@ -0,0 +1,11 @@
+#pragma once
+
+// Border modes of the model by their names in configs and arguments
+const std::map<std::string, KernelMode>& GetModelModes();
+
+// Params of the model when the config doesn't set them
+NeuralFieldModelParams GetDefaultModelParams();
+
+// Params of the model from amari.conf, keys missing in the file keep default values.
+// Returns false with default params if the file can't be read
+bool LoadModelParams(const std::string& configFilePath, NeuralFieldModelParams& params);
@@ -0,0 +1,305 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "NeuralFieldModel.h"
+#include "NeuralFieldEnsemble.h"
+
+// Member seeds that are not set leave drand48 state as is
+constexpr long NoSeed = -1;
+
+static long GetSeed(const NeuralFieldModelParams& params, const NeuralFieldModelParams& member) {
+    for (const auto* p : { &member, &params }) {
+        auto it = p->find("seed");
+        if (it != p->end()) {
+            return static_cast<long>(it->second);
+        }
+    }
+    return NoSeed;
+}
+
+bool NeuralFieldEnsemble::Init(const NeuralFieldModelParams& params,
+    const std::vector<NeuralFieldModelParams>& members) {
+    Release();
+
+    if (members.empty()) {
+        LOGE << "Ensemble has no members";
+        return false;
+    }
+
+    if (params.find("mode") != params.end()) {
+        this->mode = static_cast<KernelMode>(params.at("mode"));
+    }
+    if (params.find("size") != params.end()) {
+        this->size = static_cast<size_t>(params.at("size"));
+    }
+
+    membersCount = members.size();
+    h.resize(membersCount);
+    pi_k.resize(membersCount);
+    pi_m.resize(membersCount);
+    seeds.resize(membersCount);
+
+    std::vector<const kernel_t*> excitementKernels(membersCount);
+    std::vector<const kernel_t*> inhibitionKernels(membersCount);
+
+    for (size_t b = 0; b < membersCount; b++) {
+        // Same defaults and derived params as in NeuralFieldModel
+        NeuralFieldParams p;
+        p.Set(params);
+        p.Set(members[b]);
+
+        h[b] = p.h;
+        pi_k[b] = p.pi_k;
+        pi_m[b] = p.pi_m;
+        seeds[b] = GetSeed(params, members[b]);
+
+        excitementKernels[b] = FindKernel(p.sigma_k);
+        inhibitionKernels[b] = FindKernel(p.sigma_m);
+        if (!excitementKernels[b] || !inhibitionKernels[b]) {
+            Release();
+            return false;
+        }
+    }
+
+    InitTaps(excitementKernels, excitementTaps, excitementWeights, excitementIndices);
+    InitTaps(inhibitionKernels, inhibitionTaps, inhibitionWeights, inhibitionIndices);
+
+    LOGD << "Ensemble of " << membersCount << " fields shares " << kernels.size() << " kernels";
+
+    stimulus = MatrixGuard_t(matrix_allocate(size * size, membersCount), matrix_free);
+    activity = MatrixGuard_t(matrix_allocate(size * size, membersCount), matrix_free);
+    excitementRows = MatrixGuard_t(matrix_allocate(size * size, membersCount), matrix_free);
+    inhibitionRows = MatrixGuard_t(matrix_allocate(size * size, membersCount), matrix_free);
+
+    Restart();
+
+    return true;
+}
+
+const kernel_t* NeuralFieldEnsemble::FindKernel(float sigma) {
+    for (const auto& k : kernels) {
+        if (k->sigma == sigma) {
+            return k.get();
+        }
+    }
+
+    KernelGuard_t k(kernel_create(sigma, mode), kernel_free);
+    if (!k) {
+        return nullptr;
+    }
+    kernels.push_back(std::move(k));
+
+    return kernels.back().get();
+}
+
+void NeuralFieldEnsemble::InitTaps(const std::vector<const kernel_t*>& memberKernels,
+    size_t& taps, std::vector<float>& weights, std::vector<int>& indices) const {
+    taps = 0;
+    for (const kernel_t* k : memberKernels) {
+        taps = std::max(taps, k->size);
+    }
+
+    // Kernel sizes are odd, so shorter kernels are centered with zero taps on both sides
+    weights.assign(taps * membersCount, 0.f);
+    for (size_t b = 0; b < membersCount; b++) {
+        const kernel_t* k = memberKernels[b];
+        size_t pad = (taps - k->size) / 2;
+        for (size_t n = 0; n < k->size; n++) {
+            weights[(pad + n) * membersCount + b] = k->data[n];
+        }
+    }
+
+    int t2 = static_cast<int>(taps / 2);
+    indices.resize(size * taps);
+    for (int j = 0; j < static_cast<int>(size); j++) {
+        for (int n = 0; n < static_cast<int>(taps); n++) {
+            indices[j * taps + n] = static_cast<int>(normalize_index(j + n - t2, size, mode));
+        }
+    }
+}
+
+void NeuralFieldEnsemble::Release() {
+    stimulus.reset();
+    activity.reset();
+    excitementRows.reset();
+    inhibitionRows.reset();
+
+    kernels.clear();
+    membersCount = 0;
+}
+
+void NeuralFieldEnsemble::Restart() {
+    const size_t cells = size * size;
+
+    for (size_t b = 0; b < membersCount; b++) {
+        if (seeds[b] != NoSeed) {
+            srand48(seeds[b]);
+        }
+
+        // Same order of operations as NeuralFieldModel::Restart
+        for (size_t idx = 0; idx < cells; idx++) {
+            float s = drand48();
+            s *= -h[b];
+            stimulus->data[idx * membersCount + b] = s;
+            activity->data[idx * membersCount + b] = h[b];
+        }
+    }
+}
+
+void NeuralFieldEnsemble::SetActivity(size_t member, size_t x, size_t y, float a) {
+    activity->data[(y * size + x) * membersCount + member] = a;
+}
+
+matrix_t* NeuralFieldEnsemble::GetActivity(size_t member, matrix_t* dst) const {
+    assert(dst);
+    assert(dst->data);
+
+    if (dst->dataSize != size * size) {
+        LOGE << "Ensemble member size mismatch";
+        return dst;
+    }
+
+    for (size_t idx = 0; idx < dst->dataSize; idx++) {
+        dst->data[idx] = activity->data[idx * membersCount + member];
+    }
+    return dst;
+}
+
+void NeuralFieldEnsemble::Stimulate() {
+    const int B = static_cast<int>(membersCount);
+    const int N = static_cast<int>(size);
+    const int ke = static_cast<int>(excitementTaps);
+    const int ki = static_cast<int>(inhibitionTaps);
+
+    float* __restrict a = activity->data;
+    float* __restrict e = excitementRows->data;
+    float* __restrict i = inhibitionRows->data;
+    const float* __restrict s = stimulus->data;
+
+    const float* __restrict we = excitementWeights.data();
+    const float* __restrict wi = inhibitionWeights.data();
+    const int* ie = excitementIndices.data();
+    const int* ii = inhibitionIndices.data();
+
+    const double* __restrict hb = h.data();
+    const double* __restrict pk = pi_k.data();
+    const double* __restrict pm = pi_m.data();
+
+#ifdef USE_OPENMP
+#pragma omp parallel
+#endif
+    {
+        // Vertical sums of the current cell for every member
+        std::vector<float> sumE(B), sumI(B);
+
+        // Activity = Heaviside(Activity)
+#ifdef USE_OPENMP
+#pragma omp for
+#endif
+        for (int row = 0; row < N; row++) {
+            float* dst = a + row * N * B;
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+            for (int idx = 0; idx < N * B; idx++) {
+                dst[idx] = (dst[idx] > 0.0) ? 1.0 : 0.0;
+            }
+        }
+
+        // Horizontal passes of both kernels
+#ifdef USE_OPENMP
+#pragma omp for
+#endif
+        for (int row = 0; row < N; row++) {
+            const float* src = a + row * N * B;
+
+            for (int col = 0; col < N; col++) {
+                float* de = e + (row * N + col) * B;
+                float* di = i + (row * N + col) * B;
+
+                for (int b = 0; b < B; b++) {
+                    de[b] = 0.0;
+                    di[b] = 0.0;
+                }
+
+                for (int n = 0; n < ke; n++) {
+                    const float* se = src + ie[col * ke + n] * B;
+                    const float* w = we + n * B;
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+                    for (int b = 0; b < B; b++) {
+                        de[b] += se[b] * w[b];
+                    }
+                }
+
+                for (int n = 0; n < ki; n++) {
+                    const float* si = src + ii[col * ki + n] * B;
+                    const float* w = wi + n * B;
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+                    for (int b = 0; b < B; b++) {
+                        di[b] += si[b] * w[b];
+                    }
+                }
+            }
+        }
+
+        // Vertical passes and activity update, thresholded activity is not needed any more
+#ifdef USE_OPENMP
+#pragma omp for
+#endif
+        for (int row = 0; row < N; row++) {
+            for (int col = 0; col < N; col++) {
+                std::fill(sumE.begin(), sumE.end(), 0.f);
+                std::fill(sumI.begin(), sumI.end(), 0.f);
+
+                float* __restrict se = sumE.data();
+                float* __restrict si = sumI.data();
+
+                for (int n = 0; n < ke; n++) {
+                    const float* src = e + (ie[row * ke + n] * N + col) * B;
+                    const float* w = we + n * B;
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+                    for (int b = 0; b < B; b++) {
+                        se[b] += src[b] * w[b];
+                    }
+                }
+
+                for (int n = 0; n < ki; n++) {
+                    const float* src = i + (ii[row * ki + n] * N + col) * B;
+                    const float* w = wi + n * B;
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+                    for (int b = 0; b < B; b++) {
+                        si[b] += src[b] * w[b];
+                    }
+                }
+
+                float* dst = a + (row * N + col) * B;
+                const float* stim = s + (row * N + col) * B;
+
+                // Same order of operations as NeuralFieldModel::Stimulate
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+                for (int b = 0; b < B; b++) {
+                    float ve = se[b];
+                    float vi = si[b];
+                    ve *= pk[b];
+                    vi *= pm[b];
+
+                    float v = hb[b];
+                    v += ve;
+                    v -= vi;
+                    v += stim[b];
+                    dst[b] = v;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/*****************************************************************************
+ * NeuralFieldEnsemble - batch of independent neural fields of the same size
+ * and border mode that are advanced together
+ *
+ * Fields are interleaved: value of member b in cell idx is stored at
+ * data[idx * membersCount + b], so the innermost loops run across members.
+ * Members with equal sigmas share kernels. Shorter kernels are padded with
+ * zero taps, so every member gets the same result as a separate
+ * NeuralFieldModel with the same parameters.
+ ****************************************************************************/
+class NeuralFieldEnsemble {
+public:
+    NeuralFieldEnsemble() = default;
+
+    // Common params give size, mode and defaults for the members.
+    // Member params may override h, k, Kp, m, Mp and set seed of the stimulus.
+    bool Init(const NeuralFieldModelParams& params, const std::vector<NeuralFieldModelParams>& members);
+
+    void Release();
+
+    void Restart();
+    void Stimulate();
+
+    void SetActivity(size_t member, size_t x, size_t y, float a);
+    matrix_t* GetActivity(size_t member, matrix_t* dst) const;
+
+    size_t GetMembersCount() const { return membersCount; }
+    size_t GetKernelsCount() const { return kernels.size(); }
+
+private:
+    const kernel_t* FindKernel(float sigma);
+
+    void InitTaps(const std::vector<const kernel_t*>& memberKernels,
+        size_t& taps, std::vector<float>& weights, std::vector<int>& indices) const;
+
+public:
+    size_t size = 0;
+    size_t membersCount = 0;
+
+    KernelMode mode = MODE_REFLECT;
+
+    // Per member parameters
+    std::vector<double> h;
+    std::vector<double> pi_k;
+    std::vector<double> pi_m;
+    std::vector<long> seeds;
+
+    // Interleaved fields with (size * size) rows and membersCount columns
+    MatrixGuard_t stimulus;
+    MatrixGuard_t activity;
+
+private:
+    // Horizontal passes of the blur
+    MatrixGuard_t excitementRows;
+    MatrixGuard_t inhibitionRows;
+
+    // Kernels shared between members with the same sigma
+    std::vector<KernelGuard_t> kernels;
+
+    // Weights of every tap for every member: weights[n * membersCount + b]
+    size_t excitementTaps = 0;
+    size_t inhibitionTaps = 0;
+    std::vector<float> excitementWeights;
+    std::vector<float> inhibitionWeights;
+
+    // Source row/column of every tap: indices[j * taps + n]
+    std::vector<int> excitementIndices;
+    std::vector<int> inhibitionIndices;
+};
@@ -3,19 +3,27 @@
 #include "Gauss.h"
 #ifdef USE_OPENCL
 #include "ParallelUtils.h"
+#include "KernelProfiler.h"
+#include "WorkGroupTuner.h"
 #endif
 #include "NeuralFieldModel.h"
 
 #ifdef USE_OPENCL
 
+// Largest side of square work-groups of the tiled kernels
+constexpr size_t MaxBlurTileSize = 32;
+
 /*
  * Heaviside kernel
  */
 static const std::string HeavisideKernelName = "HeavisideMatrix";
 static const std::string HeavisideKernelSource = R"opencl(
-__kernel void HeavisideMatrix(__global float *m)
+__kernel void HeavisideMatrix(__global float *m, uint count)
 {
     size_t idx = get_global_id(0);
+    if (idx >= count) {
+        return;
+    }
     m[idx] = (m[idx] > 0.0f) ? 1.0f : 0.0f;
 }
 )opencl";
@@ -26,79 +34,415 @@ __kernel void HeavisideMatrix(__global float *m)
 static const std::string StimulationKernelName = "Stimulation";
 static const std::string StimulationKernelSource = R"opencl(
 __kernel void Stimulation(__global const float *e, __global const float *i, __global const float *s,
-    float h, float pik, float pim, __global float *out)
+    float h, float pik, float pim, __global float *out, uint count)
 {
     size_t idx = get_global_id(0);
+    if (idx >= count) {
+        return;
+    }
     out[idx] = h + e[idx] * pik - i[idx] * pim + s[idx];
 }
 )opencl";
 
 /*
- * Gaussian blur kenel
+ * Border handling shared by the tiled kernels, same as normalize_index on CPU
+ */
+static const std::string BorderModeSource = R"opencl(
+#pragma OPENCL FP_CONTRACT OFF
+
+#define MODE_WRAP 0
+#define MODE_REFLECT 1
+#define MODE_MIRROR 2
+
+int normalize_index(int n, int size, int mode)
+{
+    switch (mode) {
+    case MODE_WRAP:
+        if (n < 0) {
+            n = size - ((-n) % size);
+        }
+        if (n >= size) {
+            n %= size;
+        }
+        break;
+
+    case MODE_REFLECT:
+        while (n < 0 || n >= size) {
+            if (n == -1) {
+                n = 0;
+            }
+            if (n < -1) {
+                n = 1;
+            }
+            if (n == size) {
+                n = size - 2;
+            }
+            if (n > size) {
+                n = size - 3;
+            }
+        }
+        break;
+
+    case MODE_MIRROR:
+        while (n < 0 || n >= size) {
+            if (n < 0) {
+                n = -n;
+            }
+            if (n == size) {
+                n = 2 * size - n - 1;
+            }
+            if (n > size) {
+                n = 2 * size - n;
+            }
+        }
+        break;
+    }
+
+    return n;
+}
+)opencl";
+
+/*
+ * Gaussian blur kernel
+ *
+ * Square work-groups load a tile of the source with halos of the kernel radius
+ * along the blur direction into local memory. Taps are summed in the same order
+ * as in kernel_apply_to_matrix and border indices follow normalize_index.
  */
 static const std::string GaussianBlurKernelName = "GaussianBlur";
-static const std::string GaussianBlurKernelSource = R"opencl(
+static const std::string GaussianBlurKernelSource = BorderModeSource + R"opencl(
 #define HORIZONTAL_BLUR 0
 #define VERTICAL_BLUR 1
 
-int wrap_index(int n, uint size)
+__kernel void GaussianBlur(__global const float *m, __constant float *k,
+                     uint nmatrix, uint nkernel, int dir, int mode,
+                     __global float *out, __local float *tile)
 {
-    if (n < 0) {
-        return (n + size);
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+
+    const int n = nmatrix;
+    const int k2 = nkernel / 2;
+    const int tileSize = get_local_size(0);
+    const int tileLength = tileSize + 2 * k2;
+
+    if (dir == HORIZONTAL_BLUR) {
+        // Rows of the group with halos on the left and on the right
+        int firstCol = get_group_id(0) * tileSize - k2;
+        int srcRow = min(row, n - 1);
+        for (int t = lx; t < tileLength; t += tileSize) {
+            int srcCol = normalize_index(firstCol + t, n, mode);
+            tile[ly * tileLength + t] = m[srcCol + srcRow * n];
+        }
     }
-    else if (n >= size) {
-        return (n % size);
+    else {
+        // Columns of the group with halos above and below
+        int firstRow = get_group_id(1) * tileSize - k2;
+        int srcCol = min(col, n - 1);
+        for (int t = ly; t < tileLength; t += tileSize) {
+            int srcRow = normalize_index(firstRow + t, n, mode);
+            tile[lx + t * tileSize] = m[srcCol + srcRow * n];
+        }
     }
-    return n;
-}
 
-__kernel void GaussianBlur(__global const float *m, __global const float *k,
-                     uint nmatrix, uint nkernel, int dir, __global float *out)
-{
-    size_t idx = get_global_id(0);
+    barrier(CLK_LOCAL_MEM_FENCE);
 
-    int row = idx / nmatrix;
-    int col = idx % nmatrix;
-    int ofs = row * nmatrix;
+    if (row >= n || col >= n) {
+        return;
+    }
 
-    uint k2 = nkernel / 2;
     float sum = 0.f;
 
     if (dir == HORIZONTAL_BLUR) {
-        for (uint j = 1; j < k2; j++)
-        {
-            int col1 = col + j;
-            int col2 = col - j;
-        
-            col1 = wrap_index(col1, nmatrix);
-            col2 = wrap_index(col2, nmatrix);
-
-            sum += (m[col1 + ofs] + m[col2 + ofs]) * k[k2 - j];
+        __local const float *src = tile + ly * tileLength + lx;
+        for (int j = 0; j < (int)nkernel; j++) {
+            sum += src[j] * k[j];
         }
     }
-    else if (dir == VERTICAL_BLUR) {
-        for (uint j = 1; j < k2; j++)
-        {
-            int row1 = row + j;
-            int row2 = row - j;
-        
-            row1 = wrap_index(row1, nmatrix);
-            row2 = wrap_index(row2, nmatrix);
-
-            sum += (m[col + row1 * nmatrix] + m[col + row2 * nmatrix]) * k[k2 - j];
+    else {
+        __local const float *src = tile + ly * tileSize + lx;
+        for (int j = 0; j < (int)nkernel; j++) {
+            sum += src[j * tileSize] * k[j];
         }
     }
-    sum += m[idx] * k[k2];
 
-    out[idx] = sum;
+    out[col + row * n] = sum;
+}
+)opencl";
+
+/*
+ * Fused step kernels
+ *
+ * The first kernel thresholds activity on load and does horizontal passes of
+ * both blurs, the second one does both vertical passes and combines the result
+ * with the stimulus. Tiles have halos of the larger kernel radius.
+ *
+ * With SPECIALIZED defined matrix size, border mode, tile size and weights of
+ * the kernels are compile-time constants instead of arguments, so the tap loops
+ * have constant bounds and can be fully unrolled.
+ */
+static const std::string StepParamsSource = R"opencl(
+#ifdef SPECIALIZED
+__constant float keWeights[KE_SIZE] = { KE_WEIGHTS };
+__constant float kiWeights[KI_SIZE] = { KI_WEIGHTS };
+
+#define STEP_MATRIX_SIZE MATRIX_SIZE
+#define STEP_MODE BORDER_MODE
+#define STEP_TILE_SIZE TILE_SIZE
+#define STEP_KE_SIZE KE_SIZE
+#define STEP_KI_SIZE KI_SIZE
+#define STEP_KE(j) keWeights[j]
+#define STEP_KI(j) kiWeights[j]
+#define STEP_ATTRIBUTES __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
+#else
+#define STEP_MATRIX_SIZE ((int)nmatrix)
+#define STEP_MODE mode
+#define STEP_TILE_SIZE ((int)get_local_size(0))
+#define STEP_KE_SIZE ((int)nke)
+#define STEP_KI_SIZE ((int)nki)
+#define STEP_KE(j) ke[j]
+#define STEP_KI(j) ki[j]
+#define STEP_ATTRIBUTES
+#endif
+)opencl";
+
+static const std::string HorizontalStepKernelName = "HeavisideHorizontalBlur";
+static const std::string HorizontalStepKernelSource = BorderModeSource + StepParamsSource + R"opencl(
+__kernel STEP_ATTRIBUTES void HeavisideHorizontalBlur(__global const float *a,
+                     __constant float *ke, uint nke, __constant float *ki, uint nki,
+                     uint nmatrix, int mode,
+                     __global float *outE, __global float *outI, __local float *tile)
+{
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+
+    const int n = STEP_MATRIX_SIZE;
+    const int ke2 = STEP_KE_SIZE / 2;
+    const int ki2 = STEP_KI_SIZE / 2;
+    const int k2 = max(ke2, ki2);
+    const int tileSize = STEP_TILE_SIZE;
+    const int tileLength = tileSize + 2 * k2;
+
+    int firstCol = get_group_id(0) * tileSize - k2;
+    int srcRow = min(row, n - 1);
+    for (int t = lx; t < tileLength; t += tileSize) {
+        int srcCol = normalize_index(firstCol + t, n, STEP_MODE);
+        tile[ly * tileLength + t] = (a[srcCol + srcRow * n] > 0.0f) ? 1.0f : 0.0f;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (row >= n || col >= n) {
+        return;
+    }
+
+    __local const float *src = tile + ly * tileLength + lx;
+
+    float sumE = 0.f;
+    for (int j = 0; j < STEP_KE_SIZE; j++) {
+        sumE += src[k2 - ke2 + j] * STEP_KE(j);
+    }
+
+    float sumI = 0.f;
+    for (int j = 0; j < STEP_KI_SIZE; j++) {
+        sumI += src[k2 - ki2 + j] * STEP_KI(j);
+    }
+
+    outE[col + row * n] = sumE;
+    outI[col + row * n] = sumI;
+}
+)opencl";
+
+static const std::string VerticalStepKernelName = "VerticalBlurStimulation";
+static const std::string VerticalStepKernelSource = BorderModeSource + StepParamsSource + R"opencl(
+__kernel STEP_ATTRIBUTES void VerticalBlurStimulation(__global const float *e, __global const float *i,
+                     __constant float *ke, uint nke, __constant float *ki, uint nki,
+                     uint nmatrix, int mode,
+                     __global const float *s, float h, float pik, float pim,
+                     __global float *out, __local float *tileE, __local float *tileI)
+{
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+
+    const int n = STEP_MATRIX_SIZE;
+    const int ke2 = STEP_KE_SIZE / 2;
+    const int ki2 = STEP_KI_SIZE / 2;
+    const int k2 = max(ke2, ki2);
+    const int tileSize = STEP_TILE_SIZE;
+    const int tileLength = tileSize + 2 * k2;
+
+    int firstRow = get_group_id(1) * tileSize - k2;
+    int srcCol = min(col, n - 1);
+    for (int t = ly; t < tileLength; t += tileSize) {
+        int srcIdx = srcCol + normalize_index(firstRow + t, n, STEP_MODE) * n;
+        tileE[lx + t * tileSize] = e[srcIdx];
+        tileI[lx + t * tileSize] = i[srcIdx];
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (row >= n || col >= n) {
+        return;
+    }
+
+    __local const float *srcE = tileE + (ly + k2 - ke2) * tileSize + lx;
+    float sumE = 0.f;
+    for (int j = 0; j < STEP_KE_SIZE; j++) {
+        sumE += srcE[j * tileSize] * STEP_KE(j);
+    }
+
+    __local const float *srcI = tileI + (ly + k2 - ki2) * tileSize + lx;
+    float sumI = 0.f;
+    for (int j = 0; j < STEP_KI_SIZE; j++) {
+        sumI += srcI[j * tileSize] * STEP_KI(j);
+    }
+
+    int idx = col + row * n;
+    out[idx] = h + sumE * pik - sumI * pim + s[idx];
+}
+)opencl";
+
+/*
+ * Image step kernels
+ *
+ * Horizontal passes threshold activity on load and store both results in 2D
+ * images. Vertical passes read them through a sampler, so neighbouring rows come
+ * from the texture cache. With MODE_WRAP the sampler repeats normalized
+ * coordinates and rows beyond the borders need no index arithmetic. Other modes
+ * don't match hardware addressing and use the same indices as normalize_index.
+ */
+static const std::string ImageHorizontalStepKernelName = "HeavisideHorizontalBlurImage";
+static const std::string ImageHorizontalStepKernelSource = BorderModeSource + R"opencl(
+__kernel void HeavisideHorizontalBlurImage(__global const float *a,
+                     __constant float *ke, uint nke, __constant float *ki, uint nki,
+                     uint nmatrix, int mode,
+                     __write_only image2d_t outE, __write_only image2d_t outI)
+{
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const int n = nmatrix;
+
+    if (row >= n || col >= n) {
+        return;
+    }
+
+    const int ke2 = nke / 2;
+    const int ki2 = nki / 2;
+    __global const float *src = a + row * n;
+
+    float sumE = 0.f;
+    for (int j = 0; j < (int)nke; j++) {
+        float v = (src[normalize_index(col + j - ke2, n, mode)] > 0.0f) ? 1.0f : 0.0f;
+        sumE += v * ke[j];
+    }
+
+    float sumI = 0.f;
+    for (int j = 0; j < (int)nki; j++) {
+        float v = (src[normalize_index(col + j - ki2, n, mode)] > 0.0f) ? 1.0f : 0.0f;
+        sumI += v * ki[j];
+    }
+
+    write_imagef(outE, (int2)(col, row), (float4)(sumE, 0.0f, 0.0f, 0.0f));
+    write_imagef(outI, (int2)(col, row), (float4)(sumI, 0.0f, 0.0f, 0.0f));
+}
+)opencl";
+
+static const std::string ImageVerticalStepKernelName = "VerticalBlurStimulationImage";
+static const std::string ImageVerticalStepKernelSource = BorderModeSource + R"opencl(
+float read_row(__read_only image2d_t img, sampler_t sampler, int col, int row, int n, int mode)
+{
+    if (mode == MODE_WRAP) {
+        // Centers of texels, the sampler repeats coordinates outside of [0, 1)
+        float2 coord = (float2)((col + 0.5f) / n, (row + 0.5f) / n);
+        return read_imagef(img, sampler, coord).x;
+    }
+
+    return read_imagef(img, sampler, (int2)(col, normalize_index(row, n, mode))).x;
+}
+
+__kernel void VerticalBlurStimulationImage(__read_only image2d_t e, __read_only image2d_t i,
+                     sampler_t sampler, __constant float *ke, uint nke, __constant float *ki, uint nki,
+                     uint nmatrix, int mode,
+                     __global const float *s, float h, float pik, float pim,
+                     __global float *out)
+{
+    const int col = get_global_id(0);
+    const int row = get_global_id(1);
+    const int n = nmatrix;
+
+    if (row >= n || col >= n) {
+        return;
+    }
+
+    const int ke2 = nke / 2;
+    const int ki2 = nki / 2;
+
+    float sumE = 0.f;
+    for (int j = 0; j < (int)nke; j++) {
+        sumE += read_row(e, sampler, col, row + j - ke2, n, mode) * ke[j];
+    }
+
+    float sumI = 0.f;
+    for (int j = 0; j < (int)nki; j++) {
+        sumI += read_row(i, sampler, col, row + j - ki2, n, mode) * ki[j];
+    }
+
+    int idx = col + row * n;
+    out[idx] = h + sumE * pik - sumI * pim + s[idx];
 }
 )opencl";
 
+// Side of the largest field that fits 2D images of single floats, 0 without image support
+static size_t GetMaxFloatImageSize(cl_context context, cl_device_id device) {
+    cl_int status = CL_SUCCESS;
+
+    cl_bool imageSupport = CL_FALSE;
+    size_t maxWidth = 0, maxHeight = 0;
+    status |= clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(imageSupport), &imageSupport, nullptr);
+    status |= clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(maxWidth), &maxWidth, nullptr);
+    status |= clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(maxHeight), &maxHeight, nullptr);
+    if (status != CL_SUCCESS || !imageSupport) {
+        return 0;
+    }
+
+    cl_uint formatsCount = 0;
+    status = clGetSupportedImageFormats(context, CL_MEM_READ_WRITE, CL_MEM_OBJECT_IMAGE2D,
+        0, nullptr, &formatsCount);
+    if (status != CL_SUCCESS || formatsCount == 0) {
+        return 0;
+    }
+
+    std::vector<cl_image_format> formats(formatsCount);
+    status = clGetSupportedImageFormats(context, CL_MEM_READ_WRITE, CL_MEM_OBJECT_IMAGE2D,
+        formatsCount, formats.data(), nullptr);
+    if (status != CL_SUCCESS) {
+        return 0;
+    }
+
+    bool isFloatSupported = std::any_of(formats.begin(), formats.end(), [](const cl_image_format& f) {
+        return f.image_channel_order == CL_R && f.image_channel_data_type == CL_FLOAT;
+    });
+
+    return isFloatSupported ? std::min(maxWidth, maxHeight) : 0;
+}
+
 #endif /* USE_OPENCL */
 
+NeuralFieldModel::NeuralFieldModel() = default;
+
 NeuralFieldModel::~NeuralFieldModel() {
 #ifdef USE_OPENCL
     ReleaseOpenCLObjects();
+
+    if (auxQueue) {
+        clReleaseCommandQueue(auxQueue);
+    }
 #endif
 }
 
@@ -110,6 +454,24 @@ bool NeuralFieldModel::InitOpenCLContext(cl_platform_id platformId, cl_device_id
     this->context = context;
     this->commandQueue = commandQueue;
 
+    profiler = std::make_unique<KernelProfiler>();
+    profiler->Init(commandQueue);
+
+    tuner = std::make_unique<WorkGroupTuner>();
+    tuner->Init(device, commandQueue);
+
+    // Second queue with the same profiling, commands of both queues may run concurrently
+    cl_command_queue_properties properties = 0;
+    cl_int status = clGetCommandQueueInfo(commandQueue, CL_QUEUE_PROPERTIES, sizeof(properties), &properties, nullptr);
+    if (status == CL_SUCCESS) {
+        auxQueue = clCreateCommandQueue(context, device, properties & CL_QUEUE_PROFILING_ENABLE, &status);
+    }
+    if (status != CL_SUCCESS) {
+        LOGW << "Failed to create second OpenCL command queue, commands are serialized : "
+            << ParallelUtils::GetOpenCLError(status);
+        auxQueue = 0;
+    }
+
     if (InitOpenCLObjects()) {
         LOGI << "Successfully created OpenCL objects for neural field simulation";
         isEnabledOpenCL = true;
@@ -119,11 +481,44 @@ bool NeuralFieldModel::InitOpenCLContext(cl_platform_id platformId, cl_device_id
         isEnabledOpenCL = false;
     }
 
+    // Model is already initialized, continue from its current state
+    if (isEnabledOpenCL && activity) {
+        if (!InitOpenCLBuffers() || !UploadState()) {
+            LOGE << "Error initialising OpenCL buffers. Disable OpenCL calculations";
+            ReleaseOpenCLObjects();
+            isEnabledOpenCL = false;
+        }
+    }
+
     return isEnabledOpenCL;
 }
+
+void NeuralFieldModel::ReleaseOpenCLContext() {
+    if (isEnabledOpenCL) {
+        // Bring the state back to the host
+        GetActivity();
+    }
+
+    ReleaseOpenCLObjects();
+    profiler.reset();
+    tuner.reset();
+
+    if (auxQueue) {
+        clReleaseCommandQueue(auxQueue);
+        auxQueue = 0;
+    }
+
+    isEnabledOpenCL = false;
+    isHostActivityValid = true;
+
+    platformId = 0;
+    device = 0;
+    context = 0;
+    commandQueue = 0;
+}
 #endif
 
-bool NeuralFieldModel::Init(const NeuralFieldModelParams& params) {
+void NeuralFieldParams::Set(const NeuralFieldModelParams& params) {
     if (params.find("h") != params.end()) {
         this->h = params.at("h");
     }
@@ -150,9 +545,24 @@ bool NeuralFieldModel::Init(const NeuralFieldModelParams& params) {
     sigma_m = 1.0 / sqrtf(2.0 * m);
     pi_k = K_ * M_PI / k;
     pi_m = M_ * M_PI / m;
+}
+
+bool NeuralFieldModel::Init(const NeuralFieldModelParams& params) {
+    Set(params);
 
     excitement_kernel = KernelGuard_t(kernel_create(sigma_k, mode), kernel_free);
     inhibition_kernel = KernelGuard_t(kernel_create(sigma_m, mode), kernel_free);
+    if (!excitement_kernel || !inhibition_kernel) {
+        LOGE << "Unable to create kernels of the model";
+        return false;
+    }
+
+#ifdef USE_OPENCL
+    // Shared buffers use memory of the matrices, release them first
+    if (isEnabledOpenCL) {
+        ReleaseOpenCLBuffers();
+    }
+#endif
 
     stimulus = MatrixGuard_t(matrix_allocate(size, size), matrix_free);
     activity = MatrixGuard_t(matrix_allocate(size, size), matrix_free);
@@ -162,7 +572,6 @@ bool NeuralFieldModel::Init(const NeuralFieldModelParams& params) {
 
 #ifdef USE_OPENCL
     if (isEnabledOpenCL) {
-        ReleaseOpenCLBuffers();
         if (!InitOpenCLBuffers()) {
             LOGE << "Error initialising OpenCL buffers. Disable OpenCL calculations";
             isEnabledOpenCL = false;
@@ -176,6 +585,13 @@ bool NeuralFieldModel::Init(const NeuralFieldModelParams& params) {
 }
 
 void NeuralFieldModel::Restart() {
+#ifdef USE_OPENCL
+    // Shared matrices are only written by the host while mapped
+    if (isEnabledOpenCL && isHostMemoryShared) {
+        MapSharedMatrices(CL_MAP_READ | CL_MAP_WRITE);
+    }
+#endif
+
     matrix_random_f(stimulus.get());
     matrix_scalar_mul(stimulus.get(), -h);
 
@@ -184,17 +600,27 @@ void NeuralFieldModel::Restart() {
     matrix_scalar_set(inhibition.get(), 0.0);
 
 #ifdef USE_OPENCL
-    if (isEnabledOpenCL) {
+    if (isEnabledOpenCL && isHostMemoryShared) {
+        UnmapSharedMatrices();
+    }
+    else if (isEnabledOpenCL) {
         cl_int status = CL_SUCCESS;
 
         status |= clEnqueueWriteBuffer(commandQueue, memStimulusMatrix, CL_FALSE, 0,
-            sizeof(cl_float) * stimulus->dataSize, stimulus->data, 0, NULL, NULL);
+            sizeof(cl_float) * stimulus->dataSize, stimulus->data, 0, NULL, ProfileEvent("WriteStimulus"));
+
+        // Activity is constant, so it is filled on the device without a host copy
+        cl_float fh = static_cast<cl_float>(h);
+        status |= clEnqueueFillBuffer(commandQueue, memActivityMatrix, &fh, sizeof(fh), 0,
+            sizeof(cl_float) * activity->dataSize, 0, NULL, ProfileEvent("FillActivity"));
 
         if (status != CL_SUCCESS) {
             LOGE << "Failed to setup OpenCL buffer queue : " << ParallelUtils::GetOpenCLError(status);
             LOGE << "Disable OpenCL";
             isEnabledOpenCL = false;
         }
+
+        isHostActivityValid = true;
     }
 #endif
 }
@@ -209,60 +635,128 @@ void NeuralFieldModel::Release() {
     inhibition_kernel.release();
 }
 
-void NeuralFieldModel::Stimulate() {
+void NeuralFieldModel::Finish() {
+#ifdef USE_OPENCL
+    if (isEnabledOpenCL) {
+        clFinish(commandQueue);
+        clFinish(GetAuxQueue());
+    }
+#endif
+}
+
+void NeuralFieldModel::Stimulate(int steps) {
 #ifdef USE_OPENCL
     if (!isEnabledOpenCL)
 #endif
     {
-        matrix_heaviside(activity.get());
+        for (int i = 0; i < steps; i++) {
+            matrix_heaviside(activity.get());
 
-        kernel_apply_to_matrix(excitement.get(), activity.get(), temp.get(), excitement_kernel.get());
-        matrix_scalar_mul(excitement.get(), pi_k);
+            kernel_apply_to_matrix(excitement.get(), activity.get(), temp.get(), excitement_kernel.get());
+            matrix_scalar_mul(excitement.get(), pi_k);
 
-        kernel_apply_to_matrix(inhibition.get(), activity.get(), temp.get(), inhibition_kernel.get());
-        matrix_scalar_mul(inhibition.get(), pi_m);
+            kernel_apply_to_matrix(inhibition.get(), activity.get(), temp.get(), inhibition_kernel.get());
+            matrix_scalar_mul(inhibition.get(), pi_m);
 
-        matrix_scalar_set(activity.get(), h);
-        matrix_add(activity.get(), excitement.get());
-        matrix_sub(activity.get(), inhibition.get());
-        matrix_add(activity.get(), stimulus.get());
+            matrix_scalar_set(activity.get(), h);
+            matrix_add(activity.get(), excitement.get());
+            matrix_sub(activity.get(), inhibition.get());
+            matrix_add(activity.get(), stimulus.get());
+        }
     }
 #ifdef USE_OPENCL
     else {
-        cl_int status;
+        // Shared matrices are handed over to the device for the steps
+        if (isHostMemoryShared && sharedMapFlags) {
+            UnmapSharedMatrices();
+        }
 
-        // Load activity matrix to OpenCL memory buffer
-        status = clEnqueueWriteBuffer(commandQueue, memActivityMatrix, CL_FALSE, 0,
-            sizeof(cl_float) * activity->dataSize, activity->data, 0, NULL, NULL);
+        for (int i = 0; i < steps; i++) {
+            if (stepPath == STEP_FUSED) {
+                // Activity = h + Blur(Heaviside(Activity)) * piK - Blur(Heaviside(Activity)) * piM + Stimulus
+                CalcFusedStep();
+                continue;
+            }
+
+            if (stepPath == STEP_IMAGES) {
+                // Same as the fused step with horizontal passes kept in images
+                CalcImageStep();
+                continue;
+            }
+
+            // Activity = Heaviside(Activity)
+            CalcHeaviside(commandQueue, memActivityMatrix, this->size);
+
+            // Inhibition = GaussianBlur(Activity, InhibitionKernel) on the second queue
+            ParallelUtils::EnqueueWaitForQueue(GetAuxQueue(), commandQueue);
+            CalcInhibitionMatrix();
+
+            // Excitement = GaussianBlur(Activity, ExcitementKernel)
+            CalcExcitementMatrix();
+
+            // Activity = h + Excitement * piK - Inhibition * piM + Stimulus
+            ParallelUtils::EnqueueWaitForQueue(commandQueue, GetAuxQueue());
+            CalcActivity();
+        }
+
+        // Start execution without waiting for the results
+        cl_int status = clFlush(commandQueue);
         if (status != CL_SUCCESS) {
-            LOGE << "Failed to setup OpenCL buffer queue : " << ParallelUtils::GetOpenCLError(status);
-            return;
+            LOGE << "Failed to flush OpenCL command queue : " << ParallelUtils::GetOpenCLError(status);
         }
 
-        // Activity = Heaviside(Activity)
-        CalcHeaviside(memActivityMatrix, this->size);
+        isHostActivityValid = false;
+    }
+#endif
+}
 
-        // Excitement = GaussianBlur(Activity, ExcitementKernel)
-        CalcExcitementMatrix();
+void NeuralFieldModel::SetActivity(size_t x, size_t y, float a) {
+#ifdef USE_OPENCL
+    if (isEnabledOpenCL && isHostMemoryShared) {
+        // Written in place and handed back to the device right away
+        if (MapSharedMatrices(CL_MAP_READ | CL_MAP_WRITE)) {
+            matrix_set(activity.get(), y, x, a);
+            UnmapSharedMatrices();
+        }
+        return;
+    }
+
+    if (isEnabledOpenCL && y < activity->rows && x < activity->cols) {
+        // Write a single value instead of the whole matrix
+        size_t idx = y * activity->cols + x;
+        cl_float value = a;
 
-        // Inhibition = GaussianBlur(Activity, InhibitionKernel)
-        CalcInhibitionMatrix();
+        cl_int status = clEnqueueWriteBuffer(commandQueue, memActivityMatrix, CL_TRUE,
+            sizeof(cl_float) * idx, sizeof(cl_float), &value, 0, NULL, ProfileEvent("WriteActivity"));
+        if (status != CL_SUCCESS) {
+            LOGE << "Failed to write OpenCL memory buffer : " << ParallelUtils::GetOpenCLError(status);
+        }
+    }
+#endif
 
-        // Activity = h + Excitement * piK - Inhibition * piM + Stimulus
-        CalcActivity();
+    matrix_set(activity.get(), y, x, a);
+}
 
+matrix_t* NeuralFieldModel::GetActivity() {
+#ifdef USE_OPENCL
+    if (isEnabledOpenCL && !isHostActivityValid && isHostMemoryShared) {
+        // Blocking map waits for the steps without copies
+        MapSharedMatrices(CL_MAP_READ);
+    }
+    else if (isEnabledOpenCL && !isHostActivityValid) {
         // Synchronous/blocking read of results
-        status = clEnqueueReadBuffer(commandQueue, memActivityMatrix, CL_TRUE, 0,
-            sizeof(cl_float) * activity->dataSize, activity->data, 0, NULL, NULL);
+        cl_int status = clEnqueueReadBuffer(commandQueue, memActivityMatrix, CL_TRUE, 0,
+            sizeof(cl_float) * activity->dataSize, activity->data, 0, NULL, ProfileEvent("ReadActivity"));
         if (status != CL_SUCCESS) {
             LOGE << "Failed to read result buffer after OpenCL kernel run : " << ParallelUtils::GetOpenCLError(status);
         }
+        else {
+            isHostActivityValid = true;
+        }
     }
 #endif
-}
 
-void NeuralFieldModel::SetActivity(size_t x, size_t y, float a) {
-    matrix_set(activity.get(), y, x, a);
+    return activity.get();
 }
 
 #ifdef USE_OPENCL
@@ -296,12 +790,96 @@ bool NeuralFieldModel::InitOpenCLObjects() {
         return false;
     }
 
+    // --------------------------------------------------------
+    // Create the fused step programs
+    if (!ParallelUtils::CreateProgram(context, device,
+        HorizontalStepKernelName, HorizontalStepKernelSource,
+        &horizontalStepProgram, &horizontalStepKernel)) {
+        LOGE << "Failed to create fused horizontal step program";
+        return false;
+    }
+
+    if (!ParallelUtils::CreateProgram(context, device,
+        VerticalStepKernelName, VerticalStepKernelSource,
+        &verticalStepProgram, &verticalStepKernel)) {
+        LOGE << "Failed to create fused vertical step program";
+        return false;
+    }
+
+    horizontalStepVariants = std::make_unique<ParallelUtils::ProgramVariants>(
+        HorizontalStepKernelName, HorizontalStepKernelSource);
+    verticalStepVariants = std::make_unique<ParallelUtils::ProgramVariants>(
+        VerticalStepKernelName, VerticalStepKernelSource);
+
+    // --------------------------------------------------------
+    // Create the image step programs, buffers are used without them
+    maxImageSize = GetMaxFloatImageSize(context, device);
+    if (maxImageSize > 0) {
+        if (!ParallelUtils::CreateProgram(context, device,
+            ImageHorizontalStepKernelName, ImageHorizontalStepKernelSource,
+            &imageHorizontalStepProgram, &imageHorizontalStepKernel) ||
+            !ParallelUtils::CreateProgram(context, device,
+            ImageVerticalStepKernelName, ImageVerticalStepKernelSource,
+            &imageVerticalStepProgram, &imageVerticalStepKernel)) {
+            LOGW << "Failed to create image step programs, image step is disabled";
+            maxImageSize = 0;
+        }
+    }
+    else {
+        LOGI << "OpenCL device has no support of single float images, image step is disabled";
+    }
+
+    // --------------------------------------------------------
+    // Select tile size of the tiled kernels that fits the device
+    cl_int status = CL_SUCCESS;
+
+    size_t maxWorkGroupSize = std::numeric_limits<size_t>::max();
+    for (cl_kernel kernel : { gaussianBlurKernel, horizontalStepKernel, verticalStepKernel }) {
+        size_t kernelWorkGroupSize = 0;
+        status |= clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+            sizeof(kernelWorkGroupSize), &kernelWorkGroupSize, nullptr);
+        maxWorkGroupSize = std::min(maxWorkGroupSize, kernelWorkGroupSize);
+    }
+
+    cl_ulong deviceLocalMemSize = 0;
+    status |= clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE,
+        sizeof(deviceLocalMemSize), &deviceLocalMemSize, nullptr);
+
+    cl_bool hostUnifiedMemory = CL_FALSE;
+    status |= clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY,
+        sizeof(hostUnifiedMemory), &hostUnifiedMemory, nullptr);
+
+    cl_uint baseAddressAlignBits = 0;
+    status |= clGetDeviceInfo(device, CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+        sizeof(baseAddressAlignBits), &baseAddressAlignBits, nullptr);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to get OpenCL device limits : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    maxBlurTileSize = MaxBlurTileSize;
+    while (maxBlurTileSize > 1 && maxBlurTileSize * maxBlurTileSize > maxWorkGroupSize) {
+        maxBlurTileSize /= 2;
+    }
+    blurTileSize = maxBlurTileSize;
+    localMemSize = static_cast<size_t>(deviceLocalMemSize);
+
+    // CPU runtimes and integrated devices work on matrices of the model, copies
+    // to discrete devices are faster than access to host memory
+    isHostMemoryShared = hostUnifiedMemory && (baseAddressAlignBits / 8 <= MatrixDataAlignment);
+    LOGI << "OpenCL buffers " << (isHostMemoryShared ? "share memory with the host" : "are copied to the device");
+
     return true;
 }
 
 void NeuralFieldModel::ReleaseOpenCLObjects() {
     ReleaseOpenCLBuffers();
 
+    if (profiler) {
+        profiler->Release();
+    }
+
     if (heavisideProgram) {
         clReleaseProgram(heavisideProgram);
         heavisideProgram = 0;
@@ -331,30 +909,91 @@ void NeuralFieldModel::ReleaseOpenCLObjects() {
         clReleaseKernel(stimulationKernel);
         stimulationKernel = 0;
     }
+
+    if (horizontalStepProgram) {
+        clReleaseProgram(horizontalStepProgram);
+        horizontalStepProgram = 0;
+    }
+
+    if (horizontalStepKernel) {
+        clReleaseKernel(horizontalStepKernel);
+        horizontalStepKernel = 0;
+    }
+
+    if (verticalStepProgram) {
+        clReleaseProgram(verticalStepProgram);
+        verticalStepProgram = 0;
+    }
+
+    if (verticalStepKernel) {
+        clReleaseKernel(verticalStepKernel);
+        verticalStepKernel = 0;
+    }
+
+    horizontalStepVariants.reset();
+    verticalStepVariants.reset();
+    horizontalStepVariant = 0;
+    verticalStepVariant = 0;
+    isStepVariantValid = false;
+
+    if (imageHorizontalStepProgram) {
+        clReleaseProgram(imageHorizontalStepProgram);
+        imageHorizontalStepProgram = 0;
+    }
+
+    if (imageHorizontalStepKernel) {
+        clReleaseKernel(imageHorizontalStepKernel);
+        imageHorizontalStepKernel = 0;
+    }
+
+    if (imageVerticalStepProgram) {
+        clReleaseProgram(imageVerticalStepProgram);
+        imageVerticalStepProgram = 0;
+    }
+
+    if (imageVerticalStepKernel) {
+        clReleaseKernel(imageVerticalStepKernel);
+        imageVerticalStepKernel = 0;
+    }
+
+    maxImageSize = 0;
+    isHostMemoryShared = false;
 }
 
 bool NeuralFieldModel::InitOpenCLBuffers() {
     cl_int status, callStatus;
 
+    // Launches of the tuner overwrite shared activity, keep the state of the model
+    if (isHostMemoryShared) {
+        matrix_copy(temp.get(), activity.get());
+    }
+
     // --------------------------------------------------------
     // Allocate the OpenCL buffer memory objects
     status = CL_SUCCESS;
 
+    const cl_mem_flags sharedFlags = isHostMemoryShared ? CL_MEM_USE_HOST_PTR : 0;
+
     memExcitementMatrix = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float) * activity->dataSize, NULL, &callStatus);
     status |= callStatus;
 
     memInhibitionMatrix = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float) * activity->dataSize, NULL, &callStatus);
     status |= callStatus;
 
-    memStimulusMatrix = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float) * activity->dataSize, NULL, &callStatus);
+    memStimulusMatrix = clCreateBuffer(context, CL_MEM_READ_WRITE | sharedFlags, sizeof(cl_float) * activity->dataSize,
+        isHostMemoryShared ? stimulus->data : NULL, &callStatus);
     status |= callStatus;
 
-    memActivityMatrix = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float) * activity->dataSize, NULL, &callStatus);
+    memActivityMatrix = clCreateBuffer(context, CL_MEM_READ_WRITE | sharedFlags, sizeof(cl_float) * activity->dataSize,
+        isHostMemoryShared ? activity->data : NULL, &callStatus);
     status |= callStatus;
 
     memTempMatrix = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float) * activity->dataSize, NULL, &callStatus);
     status |= callStatus;
 
+    memInhibitionTemp = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float) * activity->dataSize, NULL, &callStatus);
+    status |= callStatus;
+
     memInhibitionKernel = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_float) * inhibition_kernel->size, NULL, &callStatus);
     status |= callStatus;
 
@@ -372,76 +1011,262 @@ bool NeuralFieldModel::InitOpenCLBuffers() {
     status = CL_SUCCESS;
 
     status |= clEnqueueWriteBuffer(commandQueue, memExcitementKernel, CL_FALSE, 0,
-        sizeof(cl_float) * excitement_kernel->size, excitement_kernel->data, 0, NULL, NULL);
+        sizeof(cl_float) * excitement_kernel->size, excitement_kernel->data, 0, NULL, ProfileEvent("WriteKernels"));
 
     status |= clEnqueueWriteBuffer(commandQueue, memInhibitionKernel, CL_FALSE, 0,
-        sizeof(cl_float) * inhibition_kernel->size, inhibition_kernel->data, 0, NULL, NULL);
+        sizeof(cl_float) * inhibition_kernel->size, inhibition_kernel->data, 0, NULL, ProfileEvent("WriteKernels"));
 
     if (status != CL_SUCCESS) {
         LOGE << "Failed to load kernels into OpenCL memory : " << ParallelUtils::GetOpenCLError(status);
         return false;
     }
 
+    // --------------------------------------------------------
+    // Images of the horizontal passes, the step falls back to buffers without them
+    if (maxImageSize > 0 && !InitImages()) {
+        ReleaseImages();
+    }
+
+    // --------------------------------------------------------
+    // Local sizes of the kernels for the device and size of the field
+    TuneWorkGroups();
+
+    if (isHostMemoryShared) {
+        if (!MapSharedMatrices(CL_MAP_READ | CL_MAP_WRITE)) {
+            return false;
+        }
+        matrix_copy(activity.get(), temp.get());
+        UnmapSharedMatrices();
+    }
+
     return true;
 }
 
 void NeuralFieldModel::ReleaseOpenCLBuffers() {
-    clReleaseMemObject(memExcitementMatrix);
-    clReleaseMemObject(memInhibitionMatrix);
-    clReleaseMemObject(memStimulusMatrix);
-    clReleaseMemObject(memActivityMatrix);
-    clReleaseMemObject(memTempMatrix);
+    // Hand shared matrices back to the host, enqueued steps may still write them
+    if (isHostMemoryShared && memActivityMatrix && memStimulusMatrix) {
+        if (sharedMapFlags) {
+            UnmapSharedMatrices();
+        }
+        clFinish(commandQueue);
+        clFinish(GetAuxQueue());
+        isHostActivityValid = true;
+    }
+
+    ReleaseImages();
+
+    for (cl_mem* mem : { &memExcitementMatrix, &memInhibitionMatrix, &memStimulusMatrix,
+        &memActivityMatrix, &memTempMatrix, &memInhibitionTemp, &memInhibitionKernel, &memExcitementKernel }) {
+        if (*mem) {
+            clReleaseMemObject(*mem);
+            *mem = 0;
+        }
+    }
+}
+
+bool NeuralFieldModel::InitImages() {
+    if (this->size > maxImageSize) {
+        LOGI << "Field doesn't fit into OpenCL images of " << maxImageSize << "x" << maxImageSize
+            << ", image step is disabled";
+        return false;
+    }
+
+    cl_int status, callStatus;
+
+    const cl_image_format format = { CL_R, CL_FLOAT };
+
+    cl_image_desc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+    desc.image_width = this->size;
+    desc.image_height = this->size;
+
+    status = CL_SUCCESS;
+
+    memExcitementImage = clCreateImage(context, CL_MEM_READ_WRITE, &format, &desc, NULL, &callStatus);
+    status |= callStatus;
+
+    memInhibitionImage = clCreateImage(context, CL_MEM_READ_WRITE, &format, &desc, NULL, &callStatus);
+    status |= callStatus;
+
+    // Only wrapping matches addressing of samplers, it needs normalized coordinates.
+    // Rows of other modes are mapped by the kernel and always lie inside images
+    if (mode == MODE_WRAP) {
+        imageSampler = clCreateSampler(context, CL_TRUE, CL_ADDRESS_REPEAT, CL_FILTER_NEAREST, &callStatus);
+    }
+    else {
+        imageSampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &callStatus);
+    }
+    status |= callStatus;
+
+    if (status != CL_SUCCESS) {
+        LOGW << "Failed to create OpenCL images, image step is disabled : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    return true;
+}
+
+void NeuralFieldModel::ReleaseImages() {
+    for (cl_mem* mem : { &memExcitementImage, &memInhibitionImage }) {
+        if (*mem) {
+            clReleaseMemObject(*mem);
+            *mem = 0;
+        }
+    }
+
+    if (imageSampler) {
+        clReleaseSampler(imageSampler);
+        imageSampler = 0;
+    }
+}
+
+bool NeuralFieldModel::UploadState() {
+    // Device already sees shared matrices
+    if (isHostMemoryShared) {
+        return true;
+    }
+
+    cl_int status = CL_SUCCESS;
+
+    status |= clEnqueueWriteBuffer(commandQueue, memStimulusMatrix, CL_FALSE, 0,
+        sizeof(cl_float) * stimulus->dataSize, stimulus->data, 0, NULL, ProfileEvent("WriteStimulus"));
+    status |= clEnqueueWriteBuffer(commandQueue, memActivityMatrix, CL_TRUE, 0,
+        sizeof(cl_float) * activity->dataSize, activity->data, 0, NULL, ProfileEvent("WriteActivity"));
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to upload model state to OpenCL memory : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    isHostActivityValid = true;
+
+    return true;
+}
+
+bool NeuralFieldModel::MapSharedMatrices(cl_map_flags flags) {
+    if (sharedMapFlags == flags) {
+        return true;
+    }
+    if (sharedMapFlags && !UnmapSharedMatrices()) {
+        return false;
+    }
+
+    cl_int status = CL_SUCCESS, callStatus;
+
+    const size_t bytes = sizeof(cl_float) * activity->dataSize;
+
+    // Buffers over host memory are mapped to the same matrices
+    if (flags & CL_MAP_WRITE) {
+        clEnqueueMapBuffer(commandQueue, memStimulusMatrix, CL_FALSE, flags, 0, bytes,
+            0, NULL, ProfileEvent("MapStimulus"), &callStatus);
+        status |= callStatus;
+    }
+
+    clEnqueueMapBuffer(commandQueue, memActivityMatrix, CL_TRUE, flags, 0, bytes,
+        0, NULL, ProfileEvent("MapActivity"), &callStatus);
+    status |= callStatus;
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to map shared OpenCL memory : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    sharedMapFlags = flags;
+    isHostActivityValid = true;
 
-    clReleaseMemObject(memInhibitionKernel);
-    clReleaseMemObject(memExcitementKernel);
+    return true;
+}
+
+bool NeuralFieldModel::UnmapSharedMatrices() {
+    cl_int status = CL_SUCCESS;
+
+    if (sharedMapFlags & CL_MAP_WRITE) {
+        status |= clEnqueueUnmapMemObject(commandQueue, memStimulusMatrix, stimulus->data,
+            0, NULL, ProfileEvent("UnmapStimulus"));
+    }
+    status |= clEnqueueUnmapMemObject(commandQueue, memActivityMatrix, activity->data,
+        0, NULL, ProfileEvent("UnmapActivity"));
+
+    sharedMapFlags = 0;
+    isHostActivityValid = false;
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to unmap shared OpenCL memory : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    return true;
+}
+
+cl_event* NeuralFieldModel::ProfileEvent(const std::string& name) {
+    return profiler ? profiler->NextEvent(name) : nullptr;
 }
 
-void NeuralFieldModel::CalcHeaviside(cl_mem memDst, cl_uint matrixSize) {
+bool NeuralFieldModel::CalcHeaviside(cl_command_queue queue, cl_mem memDst, cl_uint matrixSize) {
     cl_int status = CL_SUCCESS;
 
-    const size_t globalWorkSize = matrixSize * matrixSize;
-    const size_t localWorkSize = 64;
+    // Whole work-groups, extra items are skipped by the kernel
+    cl_uint count = matrixSize * matrixSize;
+    const size_t localWorkSize = heavisideLocalSize;
+    const size_t globalWorkSize = ((count + localWorkSize - 1) / localWorkSize) * localWorkSize;
 
     {
         // --------------------------------------------------------
         // Set the Argument values
 
-        status = clSetKernelArg(heavisideKernel, 0, sizeof(cl_mem), (void*)&memDst);
+        status = CL_SUCCESS;
+
+        status |= clSetKernelArg(heavisideKernel, 0, sizeof(cl_mem), (void*)&memDst);
+        status |= clSetKernelArg(heavisideKernel, 1, sizeof(cl_uint), (void*)&count);
         if (status != CL_SUCCESS) {
             LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
-            return;
+            return false;
         }
 
         // --------------------------------------------------------
         // Start Core sequence
 
         // Compute: launch kernel
-        status = clEnqueueNDRangeKernel(commandQueue, heavisideKernel, 1, NULL, &globalWorkSize,
-            &localWorkSize, 0, NULL, NULL);
+        status = clEnqueueNDRangeKernel(queue, heavisideKernel, 1, NULL, &globalWorkSize,
+            &localWorkSize, 0, NULL, ProfileEvent(HeavisideKernelName));
         if (status != CL_SUCCESS) {
             LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
-            return;
+            return false;
         }
     }
+
+    return true;
 }
 
-void NeuralFieldModel::CalcExcitementMatrix() {
-    GaussianBlur(memExcitementMatrix, memActivityMatrix, memTempMatrix, this->size,
-        memExcitementKernel, excitement_kernel->size);
+bool NeuralFieldModel::CalcExcitementMatrix() {
+    return GaussianBlur(commandQueue, memExcitementMatrix, memActivityMatrix, memTempMatrix, this->size,
+        memExcitementKernel, excitement_kernel->size, mode);
 }
 
-void NeuralFieldModel::CalcInhibitionMatrix() {
-    GaussianBlur(memInhibitionMatrix, memActivityMatrix, memTempMatrix, this->size,
-        memInhibitionKernel, inhibition_kernel->size);
+bool NeuralFieldModel::CalcInhibitionMatrix() {
+    return GaussianBlur(GetAuxQueue(), memInhibitionMatrix, memActivityMatrix, memInhibitionTemp, this->size,
+        memInhibitionKernel, inhibition_kernel->size, mode);
 }
 
-void NeuralFieldModel::GaussianBlur(cl_mem memDst, cl_mem memSrc, cl_mem memTmp, cl_uint matrixSize, cl_mem memKernel, cl_uint kernelSize) {
+bool NeuralFieldModel::GaussianBlur(cl_command_queue queue, cl_mem memDst, cl_mem memSrc, cl_mem memTmp, cl_uint matrixSize,
+    cl_mem memKernel, cl_uint kernelSize, KernelMode kernelMode) {
     cl_int status;
 
-    const size_t globalWorkSize = matrixSize * matrixSize;
-    const size_t localWorkSize = 64;
+    // Square work-groups that cover the whole matrix
+    const size_t localWorkSize[2] = { blurTileSize, blurTileSize };
+    const size_t groups = (matrixSize + blurTileSize - 1) / blurTileSize;
+    const size_t globalWorkSize[2] = { groups * blurTileSize, groups * blurTileSize };
+
+    // Tile with halos on both sides along the blur direction
+    const size_t tileBytes = sizeof(cl_float) * blurTileSize * (blurTileSize + 2 * (kernelSize / 2));
+    if (tileBytes > localMemSize) {
+        LOGE << "Blur kernel of size " << kernelSize << " doesn't fit into OpenCL local memory";
+        return false;
+    }
 
     cl_int blurDirection = 0;
+    cl_int blurMode = static_cast<cl_int>(kernelMode);
     cl_mem src = memSrc;
     cl_mem dst = memTmp;
 
@@ -456,35 +1281,41 @@ void NeuralFieldModel::GaussianBlur(cl_mem memDst, cl_mem memSrc, cl_mem memTmp,
         status |= clSetKernelArg(gaussianBlurKernel, 2, sizeof(cl_uint), (void*)&matrixSize);
         status |= clSetKernelArg(gaussianBlurKernel, 3, sizeof(cl_uint), (void*)&kernelSize);
         status |= clSetKernelArg(gaussianBlurKernel, 4, sizeof(cl_int), (void*)&blurDirection);
-        status |= clSetKernelArg(gaussianBlurKernel, 5, sizeof(cl_mem), (void*)&dst);
+        status |= clSetKernelArg(gaussianBlurKernel, 5, sizeof(cl_int), (void*)&blurMode);
+        status |= clSetKernelArg(gaussianBlurKernel, 6, sizeof(cl_mem), (void*)&dst);
+        status |= clSetKernelArg(gaussianBlurKernel, 7, tileBytes, NULL);
 
         if (status != CL_SUCCESS) {
             LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
-            break;
+            return false;
         }
 
         // --------------------------------------------------------
         // Start Core sequence
 
         // Compute: launch kernel
-        status = clEnqueueNDRangeKernel(commandQueue, gaussianBlurKernel, 1, NULL, &globalWorkSize,
-            &localWorkSize, 0, NULL, NULL);
+        status = clEnqueueNDRangeKernel(queue, gaussianBlurKernel, 2, NULL, globalWorkSize,
+            localWorkSize, 0, NULL, ProfileEvent(GaussianBlurKernelName));
         if (status != CL_SUCCESS) {
             LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
-            break;
+            return false;
         }
 
         // Next matrix
         src = dst;
         dst = memDst;
     } while (++blurDirection < 2);
+
+    return true;
 }
 
-void NeuralFieldModel::CalcActivity() {
+bool NeuralFieldModel::CalcActivity() {
     cl_int status;
 
-    const size_t globalWorkSize = activity->dataSize;
-    const size_t localWorkSize = 64;
+    // Whole work-groups, extra items are skipped by the kernel
+    cl_uint count = static_cast<cl_uint>(activity->dataSize);
+    const size_t localWorkSize = stimulationLocalSize;
+    const size_t globalWorkSize = ((count + localWorkSize - 1) / localWorkSize) * localWorkSize;
 
     {
         float fh = float(h);
@@ -503,10 +1334,11 @@ void NeuralFieldModel::CalcActivity() {
         status |= clSetKernelArg(stimulationKernel, 4, sizeof(cl_float), (void*)&fpi_k);
         status |= clSetKernelArg(stimulationKernel, 5, sizeof(cl_float), (void*)&fpi_m);
         status |= clSetKernelArg(stimulationKernel, 6, sizeof(cl_mem), (void*)&memActivityMatrix);
+        status |= clSetKernelArg(stimulationKernel, 7, sizeof(cl_uint), (void*)&count);
 
         if (status != CL_SUCCESS) {
             LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
-            return;
+            return false;
         }
 
         // --------------------------------------------------------
@@ -514,11 +1346,334 @@ void NeuralFieldModel::CalcActivity() {
 
         // Compute: launch kernel
         status = clEnqueueNDRangeKernel(commandQueue, stimulationKernel, 1, NULL, &globalWorkSize,
-            &localWorkSize, 0, NULL, NULL);
+            &localWorkSize, 0, NULL, ProfileEvent(StimulationKernelName));
         if (status != CL_SUCCESS) {
             LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
-            return;
+            return false;
         }
     }
+
+    return true;
 }
-#endif /* USE_OPENCL */
\ No newline at end of file
+
+size_t NeuralFieldModel::GetFusedTileBytes(size_t tileSize) const {
+    const size_t k2 = std::max(excitement_kernel->size, inhibition_kernel->size) / 2;
+    return sizeof(cl_float) * tileSize * (tileSize + 2 * k2);
+}
+
+void NeuralFieldModel::TuneWorkGroups() {
+    const size_t cells = activity->dataSize;
+
+    // --------------------------------------------------------
+    // Element-wise kernels
+
+    heavisideLocalSize = tuner->GetLocalSize(HeavisideKernelName, cells,
+        tuner->GetCandidates(heavisideKernel, 1), [this](size_t localSize) {
+            heavisideLocalSize = localSize;
+            return CalcHeaviside(commandQueue, memTempMatrix, static_cast<cl_uint>(this->size));
+        });
+
+    stimulationLocalSize = tuner->GetLocalSize(StimulationKernelName, cells,
+        tuner->GetCandidates(stimulationKernel, 1), [this](size_t localSize) {
+            stimulationLocalSize = localSize;
+            return CalcActivity();
+        });
+
+    // --------------------------------------------------------
+    // Tiles are shared by the tiled kernels and limited by local memory. Fused step
+    // keeps tiles of both blurs, so it is used when any candidate fits twice
+    std::vector<size_t> fusedTileSizes, blurTileSizes;
+    for (size_t tileSize : tuner->GetCandidates(gaussianBlurKernel, 2)) {
+        if (tileSize > maxBlurTileSize) {
+            continue;
+        }
+        if (GetFusedTileBytes(tileSize) * 2 <= localMemSize) {
+            fusedTileSizes.push_back(tileSize);
+        }
+        if (GetFusedTileBytes(tileSize) <= localMemSize) {
+            blurTileSizes.push_back(tileSize);
+        }
+    }
+
+    // Timings also depend on the halo width
+    const std::string radius = std::to_string(std::max(excitement_kernel->size, inhibition_kernel->size) / 2);
+
+    // Generic step kernels are timed, the specialized one is built for the chosen tile
+    horizontalStepVariant = 0;
+    verticalStepVariant = 0;
+    isStepVariantValid = true;
+
+    if (!fusedTileSizes.empty()) {
+        blurTileSize = tuner->GetLocalSize(HorizontalStepKernelName + "-r" + radius, this->size,
+            fusedTileSizes, [this](size_t tileSize) {
+                blurTileSize = tileSize;
+                return CalcFusedStep();
+            });
+    }
+    else {
+        LOGI << "Blur kernels don't fit into OpenCL local memory, fused step is disabled";
+
+        if (!blurTileSizes.empty()) {
+            blurTileSize = tuner->GetLocalSize(GaussianBlurKernelName + "-r" + radius, this->size,
+                blurTileSizes, [this](size_t tileSize) {
+                    blurTileSize = tileSize;
+                    // Tuner waits for the main queue only
+                    return CalcExcitementMatrix() && CalcInhibitionMatrix() &&
+                        ParallelUtils::EnqueueWaitForQueue(commandQueue, GetAuxQueue());
+                });
+        }
+    }
+
+    isStepVariantValid = false;
+
+    LOGD << "Blur kernels use tiles of " << blurTileSize << "x" << blurTileSize;
+
+    // --------------------------------------------------------
+    // Image step doesn't use local memory, work-groups have to fit both kernels
+    std::vector<size_t> imageTileSizes;
+    if (memExcitementImage) {
+        std::vector<size_t> verticalTileSizes = tuner->GetCandidates(imageVerticalStepKernel, 2);
+        for (size_t tileSize : tuner->GetCandidates(imageHorizontalStepKernel, 2)) {
+            if (std::find(verticalTileSizes.begin(), verticalTileSizes.end(), tileSize) != verticalTileSizes.end()) {
+                imageTileSizes.push_back(tileSize);
+            }
+        }
+    }
+
+    if (!imageTileSizes.empty()) {
+        imageTileSize = tuner->GetLocalSize(ImageHorizontalStepKernelName + "-r" + radius, this->size,
+            imageTileSizes, [this](size_t tileSize) {
+                imageTileSize = tileSize;
+                return CalcImageStep();
+            });
+    }
+
+    // --------------------------------------------------------
+    // Faster of the two-launch steps, the specialized fused kernels are built
+    // on the warm-up launch
+    std::vector<size_t> stepPaths;
+    if (!fusedTileSizes.empty()) {
+        stepPaths.push_back(STEP_FUSED);
+    }
+    if (!imageTileSizes.empty()) {
+        stepPaths.push_back(STEP_IMAGES);
+    }
+
+    if (stepPaths.empty()) {
+        stepPath = STEP_BUFFERS;
+    }
+    else if (stepPaths.size() == 1) {
+        stepPath = static_cast<StepPath>(stepPaths.front());
+    }
+    else {
+        stepPath = static_cast<StepPath>(tuner->GetFastestVariant("StepPath-r" + radius, this->size,
+            stepPaths, [this](size_t path) {
+                return (path == STEP_FUSED) ? CalcFusedStep() : CalcImageStep();
+            }));
+    }
+
+    static const char* StepPathNames[] = { "buffers", "fused tiles", "images" };
+    LOGI << "OpenCL step uses " << StepPathNames[stepPath];
+
+    // Launches of the tuner are not a part of the timings
+    if (profiler && profiler->IsEnabled()) {
+        profiler->Collect(true);
+        profiler->Reset();
+    }
+}
+
+void NeuralFieldModel::UpdateStepVariant() {
+    std::vector<std::pair<std::string, std::string>> defines = {
+        {"SPECIALIZED", ""},
+        {"MATRIX_SIZE", std::to_string(this->size)},
+        {"BORDER_MODE", std::to_string(static_cast<int>(mode))},
+        {"TILE_SIZE", std::to_string(blurTileSize)},
+        {"KE_SIZE", std::to_string(excitement_kernel->size)},
+        {"KE_WEIGHTS", ParallelUtils::GetFloatListLiteral(excitement_kernel->data, excitement_kernel->size)},
+        {"KI_SIZE", std::to_string(inhibition_kernel->size)},
+        {"KI_WEIGHTS", ParallelUtils::GetFloatListLiteral(inhibition_kernel->data, inhibition_kernel->size)},
+    };
+    std::string buildOptions = ParallelUtils::GetBuildOptions(defines);
+
+    horizontalStepVariant = horizontalStepVariants->GetKernel(context, device, buildOptions);
+    verticalStepVariant = verticalStepVariants->GetKernel(context, device, buildOptions);
+
+    if (!horizontalStepVariant || !verticalStepVariant) {
+        LOGW << "Failed to build specialized step kernels, use generic ones";
+        horizontalStepVariant = 0;
+        verticalStepVariant = 0;
+    }
+
+    isStepVariantValid = true;
+}
+
+bool NeuralFieldModel::CalcFusedStep() {
+    cl_int status;
+
+    // Kernels with parameters of the model compiled in, built on the first step after Init
+    if (!isStepVariantValid) {
+        UpdateStepVariant();
+    }
+
+    cl_kernel horizontalStepKernel = horizontalStepVariant ? horizontalStepVariant : this->horizontalStepKernel;
+    cl_kernel verticalStepKernel = verticalStepVariant ? verticalStepVariant : this->verticalStepKernel;
+
+    // Square work-groups that cover the whole matrix
+    const size_t localWorkSize[2] = { blurTileSize, blurTileSize };
+    const size_t groups = (this->size + blurTileSize - 1) / blurTileSize;
+    const size_t globalWorkSize[2] = { groups * blurTileSize, groups * blurTileSize };
+
+    const size_t tileBytes = GetFusedTileBytes(blurTileSize);
+
+    cl_uint matrixSize = static_cast<cl_uint>(this->size);
+    cl_uint excitementSize = static_cast<cl_uint>(excitement_kernel->size);
+    cl_uint inhibitionSize = static_cast<cl_uint>(inhibition_kernel->size);
+    cl_int blurMode = static_cast<cl_int>(mode);
+
+    float fh = float(h);
+    float fpi_k = float(pi_k);
+    float fpi_m = float(pi_m);
+
+    // --------------------------------------------------------
+    // Excitement, Inhibition = HorizontalBlur(Heaviside(Activity))
+
+    status = CL_SUCCESS;
+
+    status |= clSetKernelArg(horizontalStepKernel, 0, sizeof(cl_mem), (void*)&memActivityMatrix);
+    status |= clSetKernelArg(horizontalStepKernel, 1, sizeof(cl_mem), (void*)&memExcitementKernel);
+    status |= clSetKernelArg(horizontalStepKernel, 2, sizeof(cl_uint), (void*)&excitementSize);
+    status |= clSetKernelArg(horizontalStepKernel, 3, sizeof(cl_mem), (void*)&memInhibitionKernel);
+    status |= clSetKernelArg(horizontalStepKernel, 4, sizeof(cl_uint), (void*)&inhibitionSize);
+    status |= clSetKernelArg(horizontalStepKernel, 5, sizeof(cl_uint), (void*)&matrixSize);
+    status |= clSetKernelArg(horizontalStepKernel, 6, sizeof(cl_int), (void*)&blurMode);
+    status |= clSetKernelArg(horizontalStepKernel, 7, sizeof(cl_mem), (void*)&memExcitementMatrix);
+    status |= clSetKernelArg(horizontalStepKernel, 8, sizeof(cl_mem), (void*)&memInhibitionMatrix);
+    status |= clSetKernelArg(horizontalStepKernel, 9, tileBytes, NULL);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    status = clEnqueueNDRangeKernel(commandQueue, horizontalStepKernel, 2, NULL, globalWorkSize,
+        localWorkSize, 0, NULL, ProfileEvent(HorizontalStepKernelName));
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    // --------------------------------------------------------
+    // Activity = h + VerticalBlur(Excitement) * piK - VerticalBlur(Inhibition) * piM + Stimulus
+
+    status = CL_SUCCESS;
+
+    status |= clSetKernelArg(verticalStepKernel, 0, sizeof(cl_mem), (void*)&memExcitementMatrix);
+    status |= clSetKernelArg(verticalStepKernel, 1, sizeof(cl_mem), (void*)&memInhibitionMatrix);
+    status |= clSetKernelArg(verticalStepKernel, 2, sizeof(cl_mem), (void*)&memExcitementKernel);
+    status |= clSetKernelArg(verticalStepKernel, 3, sizeof(cl_uint), (void*)&excitementSize);
+    status |= clSetKernelArg(verticalStepKernel, 4, sizeof(cl_mem), (void*)&memInhibitionKernel);
+    status |= clSetKernelArg(verticalStepKernel, 5, sizeof(cl_uint), (void*)&inhibitionSize);
+    status |= clSetKernelArg(verticalStepKernel, 6, sizeof(cl_uint), (void*)&matrixSize);
+    status |= clSetKernelArg(verticalStepKernel, 7, sizeof(cl_int), (void*)&blurMode);
+    status |= clSetKernelArg(verticalStepKernel, 8, sizeof(cl_mem), (void*)&memStimulusMatrix);
+    status |= clSetKernelArg(verticalStepKernel, 9, sizeof(cl_float), (void*)&fh);
+    status |= clSetKernelArg(verticalStepKernel, 10, sizeof(cl_float), (void*)&fpi_k);
+    status |= clSetKernelArg(verticalStepKernel, 11, sizeof(cl_float), (void*)&fpi_m);
+    status |= clSetKernelArg(verticalStepKernel, 12, sizeof(cl_mem), (void*)&memActivityMatrix);
+    status |= clSetKernelArg(verticalStepKernel, 13, tileBytes, NULL);
+    status |= clSetKernelArg(verticalStepKernel, 14, tileBytes, NULL);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    status = clEnqueueNDRangeKernel(commandQueue, verticalStepKernel, 2, NULL, globalWorkSize,
+        localWorkSize, 0, NULL, ProfileEvent(VerticalStepKernelName));
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    return true;
+}
+
+bool NeuralFieldModel::CalcImageStep() {
+    cl_int status;
+
+    // Square work-groups that cover the whole matrix
+    const size_t localWorkSize[2] = { imageTileSize, imageTileSize };
+    const size_t groups = (this->size + imageTileSize - 1) / imageTileSize;
+    const size_t globalWorkSize[2] = { groups * imageTileSize, groups * imageTileSize };
+
+    cl_uint matrixSize = static_cast<cl_uint>(this->size);
+    cl_uint excitementSize = static_cast<cl_uint>(excitement_kernel->size);
+    cl_uint inhibitionSize = static_cast<cl_uint>(inhibition_kernel->size);
+    cl_int blurMode = static_cast<cl_int>(mode);
+
+    float fh = float(h);
+    float fpi_k = float(pi_k);
+    float fpi_m = float(pi_m);
+
+    // --------------------------------------------------------
+    // ExcitementImage, InhibitionImage = HorizontalBlur(Heaviside(Activity))
+
+    status = CL_SUCCESS;
+
+    status |= clSetKernelArg(imageHorizontalStepKernel, 0, sizeof(cl_mem), (void*)&memActivityMatrix);
+    status |= clSetKernelArg(imageHorizontalStepKernel, 1, sizeof(cl_mem), (void*)&memExcitementKernel);
+    status |= clSetKernelArg(imageHorizontalStepKernel, 2, sizeof(cl_uint), (void*)&excitementSize);
+    status |= clSetKernelArg(imageHorizontalStepKernel, 3, sizeof(cl_mem), (void*)&memInhibitionKernel);
+    status |= clSetKernelArg(imageHorizontalStepKernel, 4, sizeof(cl_uint), (void*)&inhibitionSize);
+    status |= clSetKernelArg(imageHorizontalStepKernel, 5, sizeof(cl_uint), (void*)&matrixSize);
+    status |= clSetKernelArg(imageHorizontalStepKernel, 6, sizeof(cl_int), (void*)&blurMode);
+    status |= clSetKernelArg(imageHorizontalStepKernel, 7, sizeof(cl_mem), (void*)&memExcitementImage);
+    status |= clSetKernelArg(imageHorizontalStepKernel, 8, sizeof(cl_mem), (void*)&memInhibitionImage);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    status = clEnqueueNDRangeKernel(commandQueue, imageHorizontalStepKernel, 2, NULL, globalWorkSize,
+        localWorkSize, 0, NULL, ProfileEvent(ImageHorizontalStepKernelName));
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    // --------------------------------------------------------
+    // Activity = h + VerticalBlur(ExcitementImage) * piK - VerticalBlur(InhibitionImage) * piM + Stimulus
+
+    status = CL_SUCCESS;
+
+    status |= clSetKernelArg(imageVerticalStepKernel, 0, sizeof(cl_mem), (void*)&memExcitementImage);
+    status |= clSetKernelArg(imageVerticalStepKernel, 1, sizeof(cl_mem), (void*)&memInhibitionImage);
+    status |= clSetKernelArg(imageVerticalStepKernel, 2, sizeof(cl_sampler), (void*)&imageSampler);
+    status |= clSetKernelArg(imageVerticalStepKernel, 3, sizeof(cl_mem), (void*)&memExcitementKernel);
+    status |= clSetKernelArg(imageVerticalStepKernel, 4, sizeof(cl_uint), (void*)&excitementSize);
+    status |= clSetKernelArg(imageVerticalStepKernel, 5, sizeof(cl_mem), (void*)&memInhibitionKernel);
+    status |= clSetKernelArg(imageVerticalStepKernel, 6, sizeof(cl_uint), (void*)&inhibitionSize);
+    status |= clSetKernelArg(imageVerticalStepKernel, 7, sizeof(cl_uint), (void*)&matrixSize);
+    status |= clSetKernelArg(imageVerticalStepKernel, 8, sizeof(cl_int), (void*)&blurMode);
+    status |= clSetKernelArg(imageVerticalStepKernel, 9, sizeof(cl_mem), (void*)&memStimulusMatrix);
+    status |= clSetKernelArg(imageVerticalStepKernel, 10, sizeof(cl_float), (void*)&fh);
+    status |= clSetKernelArg(imageVerticalStepKernel, 11, sizeof(cl_float), (void*)&fpi_k);
+    status |= clSetKernelArg(imageVerticalStepKernel, 12, sizeof(cl_float), (void*)&fpi_m);
+    status |= clSetKernelArg(imageVerticalStepKernel, 13, sizeof(cl_mem), (void*)&memActivityMatrix);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to setup OpenCL program arguments : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    status = clEnqueueNDRangeKernel(commandQueue, imageVerticalStepKernel, 2, NULL, globalWorkSize,
+        localWorkSize, 0, NULL, ProfileEvent(ImageVerticalStepKernelName));
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to launch OpenCL kernel : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    return true;
+}
+#endif /* USE_OPENCL */
@@ -1,30 +1,83 @@
 #pragma once
 
+#ifdef USE_OPENCL
+namespace ParallelUtils {
+    class ProgramVariants;
+}
+class KernelProfiler;
+class WorkGroupTuner;
+#endif
+
 using NeuralFieldModelParams = std::map<std::string, double>;
 
-class NeuralFieldModel {
+/*****************************************************************************
+ * NeuralFieldParams - parameters of the model with sigmas and weights of the
+ * kernels derived from them
+ ****************************************************************************/
+struct NeuralFieldParams {
+    // Keys that are missing in params keep their current values
+    void Set(const NeuralFieldModelParams& params);
+
+    size_t size = 0;
+
+    double h = -0.1;
+    double k = 0.05, K_ = 0.125;
+    double sigma_k = 0.0;
+    double pi_k = 0.0;
+
+    double m = 0.025, M_ = 0.065;
+    double sigma_m = 0.0;
+    double pi_m = 0.0;
+
+    KernelMode mode = MODE_REFLECT;
+};
+
+class NeuralFieldModel : public NeuralFieldParams {
 public:
-    NeuralFieldModel() = default;
+    NeuralFieldModel();
     ~NeuralFieldModel();
 
 #ifdef USE_OPENCL
+    // Moves calculations to OpenCL. Can be called on initialized model, the state is uploaded to the device
     bool InitOpenCLContext(cl_platform_id platformId, cl_device_id device,
         cl_context context, cl_command_queue commandQueue);
+    // Moves calculations back to the CPU keeping the state. Context and queue are not released
+    void ReleaseOpenCLContext();
 #endif
     bool Init(const NeuralFieldModelParams& params);
 
     void Release();
 
     void Restart();
-    void Stimulate();
+
+    // Advances the model by the number of steps. With OpenCL the steps are only
+    // enqueued and activity stays on the device until GetActivity() is called.
+    void Stimulate(int steps = 1);
+    // Waits until the enqueued steps are done, CPU steps are done on return of Stimulate()
+    void Finish();
 
     void SetActivity(size_t x, size_t y, float a);
 
+    // Activity on the host, read back from the device only when it is out of date
+    matrix_t* GetActivity();
+
 #ifdef USE_OPENCL
     bool IsEnabledOpenCL() const { return isEnabledOpenCL; }
 
-    void CalcHeaviside(cl_mem memDst, cl_uint matrixSize);
-    void GaussianBlur(cl_mem memDst, cl_mem memSrc, cl_mem memTmp, cl_uint matrixSize, cl_mem memKernel, cl_uint kernelSize);
+    // Activity and stimulus buffers use memory of the matrices without copies
+    bool IsHostMemoryShared() const { return isHostMemoryShared; }
+
+    // Timings of OpenCL commands, enabled on queues with profiling
+    KernelProfiler* GetProfiler() { return profiler.get(); }
+    cl_event* ProfileEvent(const std::string& name);
+
+    // Second queue of the device for work independent of the current commands,
+    // the main queue when the second one can't be created
+    cl_command_queue GetAuxQueue() const { return auxQueue ? auxQueue : commandQueue; }
+
+    bool CalcHeaviside(cl_command_queue queue, cl_mem memDst, cl_uint matrixSize);
+    bool GaussianBlur(cl_command_queue queue, cl_mem memDst, cl_mem memSrc, cl_mem memTmp, cl_uint matrixSize,
+        cl_mem memKernel, cl_uint kernelSize, KernelMode kernelMode);
 #endif
 
 #ifdef USE_OPENCL
@@ -35,27 +88,27 @@ private:
 
     bool InitOpenCLBuffers();
     void ReleaseOpenCLBuffers();
-
-    void CalcExcitementMatrix();
-    void CalcInhibitionMatrix();
-    void CalcActivity();
+    bool InitImages();
+    void ReleaseImages();
+    bool UploadState();
+    // Host access to shared matrices, stimulus is only mapped for writing
+    bool MapSharedMatrices(cl_map_flags flags);
+    bool UnmapSharedMatrices();
+
+    bool CalcExcitementMatrix();
+    bool CalcInhibitionMatrix();
+    bool CalcActivity();
+
+    size_t GetFusedTileBytes(size_t tileSize) const;
+    void TuneWorkGroups();
+    void UpdateStepVariant();
+    bool CalcFusedStep();
+    bool CalcImageStep();
 #endif
 
 public:
-    size_t size = 0;
     size_t data_size = 0;
 
-    double h = -0.1;
-    double k = 0.05, K_ = 0.125;
-    double sigma_k = 0.0;
-    double pi_k = 0.0;
-
-    double m = 0.025, M_ = 0.065;
-    double sigma_m = 0.0;
-    double pi_m = 0.0;
-
-    KernelMode mode = MODE_REFLECT;
-
     KernelGuard_t excitement_kernel;
     KernelGuard_t inhibition_kernel;
 
@@ -80,10 +133,32 @@ private:
     // OpenCL context and objects
     bool isEnabledOpenCL = false;
 
+    // Host copy of activity matches the device buffer. With shared memory
+    // the matrices are mapped to the host
+    bool isHostActivityValid = true;
+
+    // Device shares memory with the host, set by CL_DEVICE_HOST_UNIFIED_MEMORY.
+    // Between steps activity stays mapped for reading, so commands may still read it
+    bool isHostMemoryShared = false;
+    cl_map_flags sharedMapFlags = 0;
+
+    std::unique_ptr<KernelProfiler> profiler;
+
+    // Local sizes of the kernels, timed for the device and size of the field
+    std::unique_ptr<WorkGroupTuner> tuner;
+    size_t heavisideLocalSize = 64;
+    size_t stimulationLocalSize = 64;
+
+    // Blurs of the step without fused kernels overlap on both queues
+    cl_command_queue auxQueue = 0;
+
     cl_mem memExcitementMatrix = 0;
     cl_mem memInhibitionMatrix = 0;
     cl_mem memStimulusMatrix = 0;
 
+    // Temporary matrix of the inhibition blur, the excitement one uses memTempMatrix
+    cl_mem memInhibitionTemp = 0;
+
     cl_mem memExcitementKernel = 0;
     cl_mem memInhibitionKernel = 0;
 
@@ -92,8 +167,46 @@ private:
 
     cl_program gaussianBlurProgram = 0;
     cl_kernel gaussianBlurKernel = 0;
+    size_t blurTileSize = 1;
+    size_t maxBlurTileSize = 1;
+    size_t localMemSize = 0;
 
     cl_program stimulationProgram = 0;
     cl_kernel stimulationKernel = 0;
+
+    // Kernels of a step on the device
+    enum StepPath {
+        STEP_BUFFERS, // Heaviside, four blur passes and stimulation
+        STEP_FUSED, // Two launches with tiles in local memory
+        STEP_IMAGES, // Two launches with horizontal passes in images
+    };
+    StepPath stepPath = STEP_BUFFERS;
+
+    cl_program horizontalStepProgram = 0;
+    cl_kernel horizontalStepKernel = 0;
+
+    cl_program verticalStepProgram = 0;
+    cl_kernel verticalStepKernel = 0;
+
+    // Step kernels specialized for the current size, mode and weights
+    std::unique_ptr<ParallelUtils::ProgramVariants> horizontalStepVariants;
+    std::unique_ptr<ParallelUtils::ProgramVariants> verticalStepVariants;
+    bool isStepVariantValid = false;
+    cl_kernel horizontalStepVariant = 0;
+    cl_kernel verticalStepVariant = 0;
+
+    cl_program imageHorizontalStepProgram = 0;
+    cl_kernel imageHorizontalStepKernel = 0;
+
+    cl_program imageVerticalStepProgram = 0;
+    cl_kernel imageVerticalStepKernel = 0;
+
+    // Largest side of the field in images, 0 without support of single float images
+    size_t maxImageSize = 0;
+    size_t imageTileSize = 1;
+
+    cl_mem memExcitementImage = 0;
+    cl_mem memInhibitionImage = 0;
+    cl_sampler imageSampler = 0;
 #endif
 };
@@ -2,14 +2,27 @@
 
 #include <plog/Log.h>
 
+#include <INIReader.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <filesystem>
 #include <functional>
+#include <iomanip>
+#include <limits>
 #include <map>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #ifdef USE_OPENCL
 #ifdef __APPLE__
@@ -0,0 +1,201 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "NeuralFieldModel.h"
+#include "ModelConfig.h"
+#include "FieldBand.h"
+#include "DistributedNeuralFieldModel.h"
+#include "LogFormatter.h"
+#include "ResourceFinder.h"
+
+const std::filesystem::path g_configFile = "amari.conf";
+
+// Largest difference with the single-process model that is accepted by --verify
+constexpr double VerifyTolerance = 1e-5;
+
+struct RunOptions {
+    std::string configFile;
+    int steps = 100;
+    bool verify = false;
+    NeuralFieldModelParams overrides;
+};
+
+static int ShowUsage(const std::string& cmd) {
+    std::cout << "Usage: mpirun -np <ranks> " << cmd << " <option(s)>" << std::endl
+        << "Options:" << std::endl
+        << "\t-h,--help\t\tShow this help message" << std::endl
+        << "\t-c,--config FILE\tModel config (default: data/amari.conf)" << std::endl
+        << "\t-s,--size NUM\t\tSize of the field" << std::endl
+        << "\t-m,--mode MODE\t\tBorder mode: wrap | reflect | mirror" << std::endl
+        << "\t-n,--steps NUM\t\tNumber of simulation steps" << std::endl
+        << "\t--verify\t\tCompare results with the single-process model on rank 0" << std::endl;
+    return EXIT_FAILURE;
+}
+
+static int ParseArgs(int argc, char* argv[], RunOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-h" || arg == "--help") {
+            return ShowUsage(argv[0]);
+        }
+        else if ((arg == "-c" || arg == "--config") && hasValue) {
+            options.configFile = argv[++i];
+        }
+        else if ((arg == "-s" || arg == "--size") && hasValue) {
+            options.overrides["size"] = atoi(argv[++i]);
+        }
+        else if ((arg == "-n" || arg == "--steps") && hasValue) {
+            options.steps = atoi(argv[++i]);
+        }
+        else if ((arg == "-m" || arg == "--mode") && hasValue) {
+            auto mode = GetModelModes().find(argv[++i]);
+            if (mode == GetModelModes().end()) {
+                LOGE << "Unknown border mode " << argv[i];
+                return EXIT_FAILURE;
+            }
+            options.overrides["mode"] = mode->second;
+        }
+        else if (arg == "--verify") {
+            options.verify = true;
+        }
+        else {
+            LOGE << "Unknown option or missing argument : " << arg;
+            return ShowUsage(argv[0]);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static NeuralFieldModelParams LoadParams(const RunOptions& options, const char* argv0) {
+    std::string configFilePath = options.configFile;
+    if (configFilePath.empty()) {
+        std::filesystem::path moduleDataDir;
+        if (Utils::ResourceFinder::GetDataDirectory(argv0, moduleDataDir)) {
+            configFilePath = (moduleDataDir / g_configFile).string();
+        }
+    }
+
+    NeuralFieldModelParams params;
+    if (!LoadModelParams(configFilePath, params)) {
+        LOGI << "Unable to load model config, will use default params instead";
+    }
+
+    for (const auto& p : options.overrides) {
+        params[p.first] = p.second;
+    }
+
+    return params;
+}
+
+static double ActiveFraction(const matrix_t* m) {
+    size_t active = 0;
+    for (size_t idx = 0; idx < m->dataSize; idx++) {
+        if (m->data[idx] > 0.0) {
+            active++;
+        }
+    }
+    return static_cast<double>(active) / static_cast<double>(m->dataSize);
+}
+
+static bool Run(int argc, char* argv[], int rank) {
+    RunOptions options;
+    if (ParseArgs(argc, argv, options) != EXIT_SUCCESS) {
+        return false;
+    }
+
+    NeuralFieldModelParams params = LoadParams(options, argv[0]);
+    size_t size = static_cast<size_t>(params["size"]);
+
+    DistributedNeuralFieldModel model;
+    if (!model.Init(MPI_COMM_WORLD, params)) {
+        LOGE << "Unable to init distributed neural field model";
+        return false;
+    }
+
+    // Reference model shares the stimulus of the distributed one
+    NeuralFieldModel reference;
+    if (options.verify) {
+        // Scatter is collective, so all ranks leave together if the reference fails
+        int referenceReady = 1;
+        if (rank == 0 && !reference.Init(params)) {
+            LOGE << "Unable to init single-process neural field model";
+            referenceReady = 0;
+        }
+        MPI_Bcast(&referenceReady, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (!referenceReady) {
+            return false;
+        }
+
+        model.ScatterStimulus(reference.stimulus.get());
+    }
+
+    model.SetActivity(size / 2, size / 2, 1.f);
+    if (options.verify && rank == 0) {
+        reference.SetActivity(size / 2, size / 2, 1.f);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double startTime = MPI_Wtime();
+
+    for (int i = 0; i < options.steps; i++) {
+        model.Stimulate();
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double endTime = MPI_Wtime();
+
+    MatrixGuard_t result;
+    if (rank == 0) {
+        result = MatrixGuard_t(matrix_allocate(size, size), matrix_free);
+    }
+    model.GatherActivity(result.get());
+
+    if (rank != 0) {
+        return true;
+    }
+
+    double stepTime = (options.steps > 0) ? (endTime - startTime) / options.steps : 0.0;
+    LOGI << "Ranks : " << model.GetRanksCount() << ", Size : " << size <<
+        ", Halo : " << model.GetHaloWidth() << ", Steps : " << options.steps;
+    LOGI << "Average Stimulation Step Time (us) = " << static_cast<int64_t>(stepTime * 1e6);
+    LOGI << "Active Fraction = " << ActiveFraction(result.get());
+
+    if (options.verify) {
+        for (int i = 0; i < options.steps; i++) {
+            reference.Stimulate();
+        }
+
+        double maxDifference = 0.0;
+        for (size_t idx = 0; idx < result->dataSize; idx++) {
+            double d = fabs(result->data[idx] - reference.GetActivity()->data[idx]);
+            maxDifference = std::max(maxDifference, d);
+        }
+
+        LOGI << "Max Difference With Single-Process Model = " << maxDifference;
+        if (maxDifference > VerifyTolerance) {
+            LOGE << "Distributed model doesn't match single-process model";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    plog::ConsoleAppender<plog::LogFormatter> logger;
+    plog::init((rank == 0) ? plog::info : plog::warning, &logger);
+
+    int ok = Run(argc, argv, rank) ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+
+    MPI_Finalize();
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <plog/Init.h>
+#include <plog/Log.h>
+#include <plog/Appenders/ConsoleAppender.h>
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstringop-truncation"
+#include <INIReader.h>
+#pragma GCC diagnostic pop
+
+#ifdef USE_OPENCL
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
@@ -0,0 +1,241 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "NeuralFieldModel.h"
+#include "FieldBand.h"
+#include "DistributedNeuralFieldModel.h"
+
+enum HaloTag : int {
+    // Own rows sent to the rank below become its upper halo
+    TAG_HALO_DOWN = 1,
+    // Own rows sent to the rank above become its lower halo
+    TAG_HALO_UP = 2
+};
+
+DistributedNeuralFieldModel::~DistributedNeuralFieldModel() {
+    Release();
+}
+
+bool DistributedNeuralFieldModel::Init(MPI_Comm parentComm, const NeuralFieldModelParams& params) {
+    Release();
+
+    if (params.find("h") != params.end()) {
+        this->h = params.at("h");
+    }
+    if (params.find("k") != params.end()) {
+        this->k = params.at("k");
+    }
+    if (params.find("Kp") != params.end()) {
+        this->K_ = params.at("Kp");
+    }
+    if (params.find("m") != params.end()) {
+        this->m = params.at("m");
+    }
+    if (params.find("Mp") != params.end()) {
+        this->M_ = params.at("Mp");
+    }
+    if (params.find("mode") != params.end()) {
+        this->mode = static_cast<KernelMode>(params.at("mode"));
+    }
+    if (params.find("size") != params.end()) {
+        this->size = static_cast<size_t>(params.at("size"));
+    }
+
+    sigma_k = 1.0 / sqrtf(2.0 * k);
+    sigma_m = 1.0 / sqrtf(2.0 * m);
+    pi_k = K_ * M_PI / k;
+    pi_m = M_ * M_PI / m;
+
+    excitement_kernel = KernelGuard_t(kernel_create(sigma_k, mode), kernel_free);
+    inhibition_kernel = KernelGuard_t(kernel_create(sigma_m, mode), kernel_free);
+    if (!excitement_kernel || !inhibition_kernel) {
+        return false;
+    }
+
+    MPI_Comm_dup(parentComm, &comm);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &ranksCount);
+
+    // Split rows between ranks as evenly as possible
+    size_t baseRows = size / ranksCount;
+    size_t extraRows = size % ranksCount;
+
+    rowCounts.resize(ranksCount);
+    rowOffsets.resize(ranksCount);
+    for (int r = 0, offset = 0; r < ranksCount; r++) {
+        size_t rows = baseRows + ((static_cast<size_t>(r) < extraRows) ? 1 : 0);
+        rowCounts[r] = static_cast<int>(rows * size);
+        rowOffsets[r] = offset;
+        offset += rowCounts[r];
+    }
+
+    rowsCount = baseRows + ((static_cast<size_t>(rank) < extraRows) ? 1 : 0);
+    firstRow = rank * baseRows + std::min(static_cast<size_t>(rank), extraRows);
+
+    bool isBandValid = band.Init(size, rowsCount, excitement_kernel.get(), inhibition_kernel.get());
+    halo = band.GetHaloWidth();
+
+    if (mode == MODE_WRAP) {
+        upperRank = (rank + ranksCount - 1) % ranksCount;
+        lowerRank = (rank + 1) % ranksCount;
+    }
+    else {
+        upperRank = (rank > 0) ? rank - 1 : MPI_PROC_NULL;
+        lowerRank = (rank < ranksCount - 1) ? rank + 1 : MPI_PROC_NULL;
+    }
+
+    int valid = (isBandValid && InitIndices()) ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &valid, 1, MPI_INT, MPI_MIN, comm);
+    if (!valid) {
+        LOGE << "Unable to split field of size " << size << " with halo width " << halo <<
+            " between " << ranksCount << " ranks";
+        return false;
+    }
+
+    stimulus = MatrixGuard_t(matrix_allocate(rowsCount, size), matrix_free);
+    activity = MatrixGuard_t(matrix_allocate(rowsCount, size), matrix_free);
+
+    LOGD << "Rank " << rank << " owns rows [" << firstRow << ", " << (firstRow + rowsCount) <<
+        ") with halo width " << halo;
+
+    Restart();
+
+    return true;
+}
+
+bool DistributedNeuralFieldModel::InitIndices() {
+    // Every halo has to be provided by a single neighbour
+    if (rowsCount < halo || rowsCount == 0) {
+        return false;
+    }
+
+    // Halos at global borders are reflected from the own rows
+    upperBorderRows.clear();
+    if (upperRank == MPI_PROC_NULL) {
+        for (size_t e = 0; e < halo; e++) {
+            int row = static_cast<int>(normalize_index(static_cast<int>(e) - static_cast<int>(halo),
+                size, mode)) - static_cast<int>(firstRow);
+            if (row < 0 || row >= static_cast<int>(rowsCount)) {
+                return false;
+            }
+            upperBorderRows.push_back(row);
+        }
+    }
+
+    lowerBorderRows.clear();
+    if (lowerRank == MPI_PROC_NULL) {
+        for (size_t e = 0; e < halo; e++) {
+            int row = static_cast<int>(normalize_index(static_cast<int>(size + e),
+                size, mode)) - static_cast<int>(firstRow);
+            if (row < 0 || row >= static_cast<int>(rowsCount)) {
+                return false;
+            }
+            lowerBorderRows.push_back(row);
+        }
+    }
+
+    return true;
+}
+
+void DistributedNeuralFieldModel::Release() {
+    stimulus.reset();
+    activity.reset();
+
+    band.Release();
+
+    excitement_kernel.reset();
+    inhibition_kernel.reset();
+
+    if (comm != MPI_COMM_NULL) {
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (!finalized) {
+            MPI_Comm_free(&comm);
+        }
+        comm = MPI_COMM_NULL;
+    }
+}
+
+void DistributedNeuralFieldModel::Restart() {
+    MatrixGuard_t globalStimulus;
+    if (rank == 0) {
+        globalStimulus = MatrixGuard_t(matrix_allocate(size, size), matrix_free);
+        matrix_random_f(globalStimulus.get());
+        matrix_scalar_mul(globalStimulus.get(), -h);
+    }
+
+    ScatterStimulus(globalStimulus.get());
+
+    matrix_scalar_set(activity.get(), h);
+}
+
+void DistributedNeuralFieldModel::ScatterStimulus(const matrix_t* globalStimulus, int root) {
+    MPI_Scatterv((rank == root) ? globalStimulus->data : nullptr, rowCounts.data(), rowOffsets.data(), MPI_FLOAT,
+        stimulus->data, static_cast<int>(stimulus->dataSize), MPI_FLOAT, root, comm);
+}
+
+void DistributedNeuralFieldModel::GatherActivity(matrix_t* globalActivity, int root) {
+    MPI_Gatherv(activity->data, static_cast<int>(activity->dataSize), MPI_FLOAT,
+        (rank == root) ? globalActivity->data : nullptr, rowCounts.data(), rowOffsets.data(), MPI_FLOAT,
+        root, comm);
+}
+
+void DistributedNeuralFieldModel::SetActivity(size_t x, size_t y, float a) {
+    if (y >= firstRow && y < firstRow + rowsCount) {
+        matrix_set(activity.get(), y - firstRow, x, a);
+    }
+}
+
+void DistributedNeuralFieldModel::Stimulate() {
+    // Threshold own rows into the middle of the field with halos
+    band.Threshold(activity->data, rowsCount);
+
+    StartHaloExchange();
+    FillBorderHalos();
+
+    // Convolve everything that doesn't depend on the neighbours
+    size_t interiorFirst = std::min(halo, rowsCount);
+    size_t interiorLast = std::max(interiorFirst, rowsCount - halo);
+
+    band.BlurRows(halo, halo + rowsCount);
+    BlurColumns(interiorFirst, interiorLast);
+
+    FinishHaloExchange();
+
+    band.BlurRows(0, halo);
+    band.BlurRows(halo + rowsCount, rowsCount + 2 * halo);
+    BlurColumns(0, interiorFirst);
+    BlurColumns(interiorLast, rowsCount);
+}
+
+void DistributedNeuralFieldModel::StartHaloExchange() {
+    const int count = static_cast<int>(halo * size);
+
+    float* upperHalo = band.GetFieldRow(0);
+    float* ownUpperRows = band.GetFieldRow(halo);
+    float* ownLowerRows = band.GetFieldRow(rowsCount);
+    float* lowerHalo = band.GetFieldRow(halo + rowsCount);
+
+    MPI_Irecv(upperHalo, count, MPI_FLOAT, upperRank, TAG_HALO_DOWN, comm, &requests[0]);
+    MPI_Irecv(lowerHalo, count, MPI_FLOAT, lowerRank, TAG_HALO_UP, comm, &requests[1]);
+    MPI_Isend(ownLowerRows, count, MPI_FLOAT, lowerRank, TAG_HALO_DOWN, comm, &requests[2]);
+    MPI_Isend(ownUpperRows, count, MPI_FLOAT, upperRank, TAG_HALO_UP, comm, &requests[3]);
+}
+
+void DistributedNeuralFieldModel::FinishHaloExchange() {
+    MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
+}
+
+void DistributedNeuralFieldModel::FillBorderHalos() {
+    for (size_t e = 0; e < upperBorderRows.size(); e++) {
+        memcpy(band.GetFieldRow(e), band.GetFieldRow(halo + upperBorderRows[e]), sizeof(float) * size);
+    }
+    for (size_t e = 0; e < lowerBorderRows.size(); e++) {
+        memcpy(band.GetFieldRow(halo + rowsCount + e), band.GetFieldRow(halo + lowerBorderRows[e]),
+            sizeof(float) * size);
+    }
+}
+
+void DistributedNeuralFieldModel::BlurColumns(size_t firstOwnRow, size_t lastOwnRow) {
+    band.BlurColumns(firstOwnRow, lastOwnRow, stimulus->data, activity->data, h, pi_k, pi_m);
+}
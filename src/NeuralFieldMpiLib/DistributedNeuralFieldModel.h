@@ -0,0 +1,87 @@
+#pragma once
+
+/*****************************************************************************
+ * DistributedNeuralFieldModel - neural field split into row blocks across
+ * the ranks of an MPI communicator
+ *
+ * Each rank owns a contiguous band of rows and keeps halos of the width of
+ * the largest kernel radius above and below it. Horizontal blur passes need
+ * no communication, so halos of the thresholded activity are exchanged once
+ * per step for both kernels while the own rows and the interior of the
+ * vertical pass are convolved.
+ ****************************************************************************/
+class DistributedNeuralFieldModel {
+public:
+    DistributedNeuralFieldModel() = default;
+    ~DistributedNeuralFieldModel();
+
+    bool Init(MPI_Comm comm, const NeuralFieldModelParams& params);
+
+    void Release();
+
+    void Restart();
+    void Stimulate();
+
+    void SetActivity(size_t x, size_t y, float a);
+
+    // Collective operations, global matrices are only accessed on the root rank
+    void ScatterStimulus(const matrix_t* globalStimulus, int root = 0);
+    void GatherActivity(matrix_t* globalActivity, int root = 0);
+
+    int GetRank() const { return rank; }
+    int GetRanksCount() const { return ranksCount; }
+    size_t GetFirstRow() const { return firstRow; }
+    size_t GetRowsCount() const { return rowsCount; }
+    size_t GetHaloWidth() const { return halo; }
+
+private:
+    bool InitIndices();
+
+    void StartHaloExchange();
+    void FinishHaloExchange();
+    void FillBorderHalos();
+
+    void BlurColumns(size_t firstOwnRow, size_t lastOwnRow);
+
+public:
+    size_t size = 0;
+
+    double h = -0.1;
+    double k = 0.05, K_ = 0.125;
+    double sigma_k = 0.0;
+    double pi_k = 0.0;
+
+    double m = 0.025, M_ = 0.065;
+    double sigma_m = 0.0;
+    double pi_m = 0.0;
+
+    KernelMode mode = MODE_REFLECT;
+
+    KernelGuard_t excitement_kernel;
+    KernelGuard_t inhibition_kernel;
+
+    // Own rows of the field
+    MatrixGuard_t stimulus;
+    MatrixGuard_t activity;
+
+private:
+    MPI_Comm comm = MPI_COMM_NULL;
+    int rank = 0;
+    int ranksCount = 1;
+    int upperRank = MPI_PROC_NULL;
+    int lowerRank = MPI_PROC_NULL;
+
+    size_t firstRow = 0;
+    size_t rowsCount = 0;
+    size_t halo = 0;
+
+    // Own rows with halos: thresholded activity and horizontal blur passes
+    FieldBand band;
+
+    // Source rows in the own band for halos at global borders
+    std::vector<int> upperBorderRows;
+    std::vector<int> lowerBorderRows;
+
+    std::vector<int> rowCounts, rowOffsets;
+    MPI_Request requests[4];
+};
@@ -0,0 +1,150 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "ParallelUtils.h"
+#include "NeuralFieldModel.h"
+#include "ModelConfig.h"
+#include "SweepConfig.h"
+
+// Keys of NeuralFieldModelParams that may be swept, in the order of axes
+static const std::vector<std::string> g_SweepKeys = {
+    "size", "mode", "h", "k", "Kp", "m", "Mp"
+};
+
+static std::string Trim(const std::string& s) {
+    const char* spaces = " \t";
+    size_t first = s.find_first_not_of(spaces);
+    if (first == std::string::npos) {
+        return std::string();
+    }
+    size_t last = s.find_last_not_of(spaces);
+    return s.substr(first, last - first + 1);
+}
+
+bool SweepConfig::ParseValues(const std::string& key, const std::string& text, std::vector<double>& values) {
+    values.clear();
+
+    // Range in the form first:last:count
+    if (text.find(':') != std::string::npos) {
+        double first = 0.0, last = 0.0;
+        int count = 0;
+        if (sscanf(text.c_str(), "%lf:%lf:%d", &first, &last, &count) != 3 || count <= 0) {
+            LOGE << "Invalid range of sweep key " << key << " : " << text;
+            return false;
+        }
+
+        for (int i = 0; i < count; i++) {
+            double t = (count > 1) ? static_cast<double>(i) / (count - 1) : 0.0;
+            values.push_back(first + (last - first) * t);
+        }
+        return true;
+    }
+
+    // Comma-separated list of values
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item = Trim(item);
+        if (item.empty()) {
+            continue;
+        }
+
+        if (key == "mode") {
+            auto mode = GetModelModes().find(item);
+            if (mode == GetModelModes().end()) {
+                LOGE << "Unknown border mode " << item;
+                return false;
+            }
+            values.push_back(mode->second);
+            continue;
+        }
+
+        char* end = nullptr;
+        double value = strtod(item.c_str(), &end);
+        if (end == item.c_str() || *end != '\0') {
+            LOGE << "Invalid value of sweep key " << key << " : " << item;
+            return false;
+        }
+        values.push_back(value);
+    }
+
+    if (values.empty()) {
+        LOGE << "No values for sweep key " << key;
+        return false;
+    }
+
+    return true;
+}
+
+bool SweepConfig::Load(const std::string& fileName) {
+    INIReader reader(fileName);
+    if (reader.ParseError() != 0) {
+        LOGE << "Unable to load sweep config " << fileName;
+        return false;
+    }
+
+    axes.clear();
+    for (const auto& key : g_SweepKeys) {
+        std::string text = reader.Get("sweep", key, "");
+        if (text.empty()) {
+            continue;
+        }
+
+        SweepAxis axis;
+        axis.key = key;
+        if (!ParseValues(key, text, axis.values)) {
+            return false;
+        }
+        axes.push_back(axis);
+    }
+
+    steps = reader.GetInteger("run", "steps", steps);
+    history = reader.GetInteger("run", "history", history);
+    seed = reader.GetInteger("run", "seed", seed);
+
+    if (steps <= 0 || history < 0) {
+        LOGE << "Invalid run settings in sweep config " << fileName;
+        return false;
+    }
+
+    return true;
+}
+
+size_t SweepConfig::GetRunsCount() const {
+    size_t count = 1;
+    for (const auto& axis : axes) {
+        count *= axis.values.size();
+    }
+    return count;
+}
+
+NeuralFieldModelParams SweepConfig::GetRunParams(size_t run, const NeuralFieldModelParams& baseParams) const {
+    NeuralFieldModelParams params = baseParams;
+    for (auto axis = axes.rbegin(); axis != axes.rend(); ++axis) {
+        size_t count = axis->values.size();
+        params[axis->key] = axis->values[run % count];
+        run /= count;
+    }
+    return params;
+}
+
+uint64_t SweepConfig::GetHash(const NeuralFieldModelParams& baseParams) const {
+    uint64_t hash = ParallelUtils::HashOffsetBasis;
+    auto add = [&hash](const void* data, size_t size) {
+        hash = ParallelUtils::Hash(data, size, hash);
+    };
+
+    for (const auto& p : baseParams) {
+        add(p.first.data(), p.first.size());
+        add(&p.second, sizeof(p.second));
+    }
+    for (const auto& axis : axes) {
+        add(axis.key.data(), axis.key.size());
+        add(axis.values.data(), sizeof(double) * axis.values.size());
+    }
+    add(&steps, sizeof(steps));
+    add(&history, sizeof(history));
+    add(&seed, sizeof(seed));
+
+    return hash;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+/*****************************************************************************
+ * SweepConfig - grid of model parameters for a headless sweep
+ *
+ * Every axis gives values of a single key of NeuralFieldModelParams, runs
+ * are the cartesian product of all axes with the last axis changing fastest.
+ ****************************************************************************/
+struct SweepAxis {
+    std::string key;
+    std::vector<double> values;
+};
+
+class SweepConfig {
+public:
+    bool Load(const std::string& fileName);
+
+    size_t GetRunsCount() const;
+    NeuralFieldModelParams GetRunParams(size_t run, const NeuralFieldModelParams& baseParams) const;
+
+    // Hash of the grid, base params and run settings to check that results belong to the sweep
+    uint64_t GetHash(const NeuralFieldModelParams& baseParams) const;
+
+private:
+    static bool ParseValues(const std::string& key, const std::string& text, std::vector<double>& values);
+
+public:
+    std::vector<SweepAxis> axes;
+
+    // Maximal number of steps of a single run
+    int steps = 2000;
+
+    // Number of previous states that are checked for periodic activity
+    int history = 64;
+
+    // Seed of the random stimulus, each run uses (seed + run index)
+    long seed = 1;
+};
@@ -0,0 +1,265 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "NeuralFieldModel.h"
+#include "SweepConfig.h"
+#include "SweepResultsFile.h"
+
+static const char FileMagic[8] = {'N', 'F', 'S', 'W', 'E', 'E', 'P', '1'};
+static const uint32_t BlockMagic = 0x4B42464E; // "NFBK"
+
+// Number of results written at once, smaller blocks lose less on interruption
+constexpr size_t BlockRows = 32;
+
+template<typename T>
+static void WriteValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static bool ReadValue(std::istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template<typename T, typename F>
+static void WriteColumn(std::ostream& out, const std::vector<SweepResult>& rows, F get) {
+    std::vector<T> column(rows.size());
+    std::transform(rows.begin(), rows.end(), column.begin(), get);
+    out.write(reinterpret_cast<const char*>(column.data()), sizeof(T) * column.size());
+}
+
+template<typename T, typename F>
+static bool ReadColumn(std::istream& in, std::vector<SweepResult>& rows, F set) {
+    std::vector<T> column(rows.size());
+    if (!in.read(reinterpret_cast<char*>(column.data()), sizeof(T) * column.size())) {
+        return false;
+    }
+    for (size_t i = 0; i < rows.size(); i++) {
+        set(rows[i], column[i]);
+    }
+    return true;
+}
+
+SweepResultsFile::~SweepResultsFile() {
+    Close();
+}
+
+bool SweepResultsFile::Open(const std::string& fileName, const SweepConfig& config, uint64_t hash,
+    std::vector<bool>& finishedRuns) {
+    Close();
+
+    Header header;
+    header.hash = hash;
+    header.runsCount = static_cast<uint32_t>(config.GetRunsCount());
+    for (const auto& axis : config.axes) {
+        header.keys.push_back(axis.key);
+    }
+    keysCount = header.keys.size();
+
+    finishedRuns.assign(header.runsCount, false);
+
+    std::error_code ec;
+    if (!std::filesystem::exists(fileName, ec)) {
+        file.open(fileName, std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!file) {
+            LOGE << "Unable to create results file " << fileName;
+            return false;
+        }
+        return WriteHeader(header);
+    }
+
+    // Resume previous sweep
+    uintmax_t validSize = 0;
+    size_t finishedCount = 0;
+    {
+        std::ifstream in(fileName, std::ios::binary);
+        Header existing;
+        if (!ReadHeader(in, existing)) {
+            LOGE << "Invalid results file " << fileName;
+            return false;
+        }
+        if (existing.hash != header.hash || existing.runsCount != header.runsCount) {
+            LOGE << "Results file " << fileName << " belongs to another sweep";
+            return false;
+        }
+
+        validSize = static_cast<uintmax_t>(in.tellg());
+
+        std::vector<SweepResult> results;
+        while (ReadBlock(in, keysCount, results)) {
+            for (const auto& r : results) {
+                if (r.run < finishedRuns.size() && !finishedRuns[r.run]) {
+                    finishedRuns[r.run] = true;
+                    finishedCount++;
+                }
+            }
+            validSize = static_cast<uintmax_t>(in.tellg());
+        }
+    }
+
+    if (std::filesystem::file_size(fileName, ec) != validSize) {
+        LOGI << "Dropping incomplete block at the end of " << fileName;
+        std::filesystem::resize_file(fileName, validSize, ec);
+        if (ec) {
+            LOGE << "Unable to truncate results file " << fileName << " : " << ec.message();
+            return false;
+        }
+    }
+
+    LOGI << "Resuming sweep with " << finishedCount << " of " << header.runsCount << " runs finished";
+
+    file.open(fileName, std::ios::binary | std::ios::out | std::ios::app);
+    if (!file) {
+        LOGE << "Unable to open results file " << fileName;
+        return false;
+    }
+
+    return true;
+}
+
+void SweepResultsFile::Close() {
+    if (file.is_open()) {
+        Flush();
+        file.close();
+    }
+}
+
+void SweepResultsFile::Append(const SweepResult& result) {
+    pending.push_back(result);
+    if (pending.size() >= BlockRows) {
+        Flush();
+    }
+}
+
+bool SweepResultsFile::Flush() {
+    if (pending.empty()) {
+        return true;
+    }
+
+    WriteValue(file, BlockMagic);
+    WriteValue(file, static_cast<uint32_t>(pending.size()));
+
+    WriteColumn<uint32_t>(file, pending, [](const SweepResult& r) { return r.run; });
+    for (size_t k = 0; k < keysCount; k++) {
+        WriteColumn<double>(file, pending, [k](const SweepResult& r) { return r.values[k]; });
+    }
+    WriteColumn<float>(file, pending, [](const SweepResult& r) { return r.activeFraction; });
+    WriteColumn<int32_t>(file, pending, [](const SweepResult& r) { return r.bumps; });
+    WriteColumn<int32_t>(file, pending, [](const SweepResult& r) { return r.period; });
+    WriteColumn<int32_t>(file, pending, [](const SweepResult& r) { return r.steps; });
+
+    pending.clear();
+
+    file.flush();
+    if (!file) {
+        LOGE << "Failed to write sweep results";
+        return false;
+    }
+
+    return true;
+}
+
+bool SweepResultsFile::WriteHeader(const Header& header) {
+    file.write(FileMagic, sizeof(FileMagic));
+    WriteValue(file, header.hash);
+    WriteValue(file, header.runsCount);
+    WriteValue(file, static_cast<uint32_t>(header.keys.size()));
+    for (const auto& key : header.keys) {
+        WriteValue(file, static_cast<uint32_t>(key.size()));
+        file.write(key.data(), key.size());
+    }
+
+    file.flush();
+    if (!file) {
+        LOGE << "Failed to write header of results file";
+        return false;
+    }
+
+    return true;
+}
+
+bool SweepResultsFile::ReadHeader(std::istream& in, Header& header) {
+    char magic[sizeof(FileMagic)];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, FileMagic, sizeof(FileMagic)) != 0) {
+        return false;
+    }
+
+    uint32_t keysCount = 0;
+    if (!ReadValue(in, header.hash) || !ReadValue(in, header.runsCount) || !ReadValue(in, keysCount)) {
+        return false;
+    }
+
+    header.keys.clear();
+    for (uint32_t k = 0; k < keysCount; k++) {
+        uint32_t length = 0;
+        if (!ReadValue(in, length)) {
+            return false;
+        }
+        std::string key(length, '\0');
+        if (!in.read(&key[0], length)) {
+            return false;
+        }
+        header.keys.push_back(key);
+    }
+
+    return true;
+}
+
+bool SweepResultsFile::ReadBlock(std::istream& in, size_t keysCount, std::vector<SweepResult>& results) {
+    uint32_t magic = 0, rows = 0;
+    if (!ReadValue(in, magic) || magic != BlockMagic || !ReadValue(in, rows)) {
+        return false;
+    }
+
+    results.assign(rows, SweepResult());
+    for (auto& r : results) {
+        r.values.resize(keysCount);
+    }
+
+    if (!ReadColumn<uint32_t>(in, results, [](SweepResult& r, uint32_t v) { r.run = v; })) {
+        return false;
+    }
+    for (size_t k = 0; k < keysCount; k++) {
+        if (!ReadColumn<double>(in, results, [k](SweepResult& r, double v) { r.values[k] = v; })) {
+            return false;
+        }
+    }
+
+    return ReadColumn<float>(in, results, [](SweepResult& r, float v) { r.activeFraction = v; }) &&
+        ReadColumn<int32_t>(in, results, [](SweepResult& r, int32_t v) { r.bumps = v; }) &&
+        ReadColumn<int32_t>(in, results, [](SweepResult& r, int32_t v) { r.period = v; }) &&
+        ReadColumn<int32_t>(in, results, [](SweepResult& r, int32_t v) { r.steps = v; });
+}
+
+bool SweepResultsFile::Dump(const std::string& fileName, std::ostream& out) {
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in) {
+        LOGE << "Unable to open results file " << fileName;
+        return false;
+    }
+
+    Header header;
+    if (!ReadHeader(in, header)) {
+        LOGE << "Invalid results file " << fileName;
+        return false;
+    }
+
+    out << "run";
+    for (const auto& key : header.keys) {
+        out << "," << key;
+    }
+    out << ",active_fraction,bumps,period,steps" << std::endl;
+
+    std::vector<SweepResult> results;
+    while (ReadBlock(in, header.keys.size(), results)) {
+        for (const auto& r : results) {
+            out << r.run;
+            for (double v : r.values) {
+                out << "," << v;
+            }
+            out << "," << r.activeFraction << "," << r.bumps << "," << r.period << "," << r.steps << std::endl;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+/*****************************************************************************
+ * SweepResultsFile - append-only columnar file with results of a sweep
+ *
+ * File starts with a header that identifies the sweep, results follow in
+ * blocks. Each block stores its rows column by column: run index, values of
+ * the swept keys, active fraction, bumps count, period and number of steps.
+ * Incomplete trailing block of an interrupted sweep is dropped on resume.
+ ****************************************************************************/
+struct SweepResult {
+    uint32_t run = 0;
+    std::vector<double> values;
+    float activeFraction = 0.f;
+    int32_t bumps = 0;
+    int32_t period = 0;
+    int32_t steps = 0;
+};
+
+class SweepResultsFile {
+public:
+    SweepResultsFile() = default;
+    ~SweepResultsFile();
+
+    // Creates new file or opens results of the same sweep and marks finished runs
+    bool Open(const std::string& fileName, const SweepConfig& config, uint64_t hash,
+        std::vector<bool>& finishedRuns);
+    void Close();
+
+    void Append(const SweepResult& result);
+    bool Flush();
+
+    // Writes results as CSV
+    static bool Dump(const std::string& fileName, std::ostream& out);
+
+private:
+    struct Header {
+        uint64_t hash = 0;
+        uint32_t runsCount = 0;
+        std::vector<std::string> keys;
+    };
+
+    static bool ReadHeader(std::istream& in, Header& header);
+    static bool ReadBlock(std::istream& in, size_t keysCount, std::vector<SweepResult>& results);
+
+    bool WriteHeader(const Header& header);
+
+private:
+    std::ofstream file;
+    size_t keysCount = 0;
+    std::vector<SweepResult> pending;
+};
@@ -0,0 +1,251 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "NeuralFieldModel.h"
+#include "NeuralFieldEnsemble.h"
+#include "FieldObservables.h"
+#include "SweepConfig.h"
+#include "SweepResultsFile.h"
+#include "SweepRunner.h"
+
+SweepRunner::SweepRunner(const SweepConfig& config, const NeuralFieldModelParams& baseParams, size_t batchSize)
+    : config(config), baseParams(baseParams), batchSize(std::max<size_t>(1, batchSize)) {
+}
+
+bool SweepRunner::Run(SweepResultsFile& results, const std::vector<bool>& finishedRuns,
+    int jobs, int threads, const std::atomic<bool>& stopRequested) {
+    std::vector<size_t> runs;
+    for (size_t run = 0; run < finishedRuns.size(); run++) {
+        if (!finishedRuns[run]) {
+            runs.push_back(run);
+        }
+    }
+
+    std::vector<std::vector<size_t>> batches = GetBatches(runs);
+
+    LOGI << "Starting " << runs.size() << " runs in " << batches.size() << " batches with " <<
+        jobs << " jobs on " << threads << " threads";
+
+    std::atomic<size_t> nextBatch{0};
+    std::mutex resultsMutex;
+    size_t finishedCount = finishedRuns.size() - runs.size();
+    size_t failedCount = 0;
+
+    auto worker = [&]() {
+        while (!stopRequested) {
+            size_t i = nextBatch++;
+            if (i >= batches.size()) {
+                break;
+            }
+
+            // Share the cores between the batches that are left
+            size_t running = std::min(static_cast<size_t>(jobs), batches.size() - i);
+            int runThreads = std::max(1, threads / static_cast<int>(running));
+
+            std::vector<SweepResult> batchResults(batches[i].size());
+            bool initialized = (batchSize > 1) ?
+                RunBatch(batches[i], runThreads, batchResults) :
+                RunSingle(batches[i].front(), runThreads, batchResults.front());
+
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            if (!initialized) {
+                std::ostringstream ids;
+                for (size_t run : batches[i]) {
+                    ids << " " << run;
+                }
+                LOGE << "Failed to init model of runs" << ids.str();
+                failedCount += batches[i].size();
+                continue;
+            }
+
+            for (const auto& result : batchResults) {
+                results.Append(result);
+                finishedCount++;
+                stepsCount += result.steps;
+
+                LOGI << "Run " << result.run << " (" << finishedCount << "/" << finishedRuns.size() << ")" <<
+                    " : steps = " << result.steps << ", period = " << result.period <<
+                    ", active = " << result.activeFraction << ", bumps = " << result.bumps;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int j = 0; j < jobs; j++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    results.Flush();
+
+    if (failedCount > 0) {
+        LOGE << failedCount << " runs failed";
+    }
+
+    return (nextBatch >= batches.size()) && (failedCount == 0) && !stopRequested;
+}
+
+bool SweepRunner::RunSingle(size_t run, int threads, SweepResult& result) const {
+#ifdef USE_OPENMP
+    omp_set_num_threads(threads);
+#else
+    (void)threads;
+#endif
+
+    NeuralFieldModelParams params = config.GetRunParams(run, baseParams);
+
+    NeuralFieldModel model;
+    {
+        std::lock_guard<std::mutex> lock(initMutex);
+        if (!model.Init(params)) {
+            return false;
+        }
+    }
+
+    FillStimulus(run, model.h, model.stimulus->data, model.stimulus->dataSize, 1);
+
+    model.SetActivity(model.size / 2, model.size / 2, 1.f);
+
+    FieldPeriodDetector detector(config.history);
+
+    int steps = 0;
+    int period = 0;
+    while (steps < config.steps && period == 0) {
+        model.Stimulate();
+        steps++;
+        period = detector.Push(field_active_hash(model.GetActivity()));
+    }
+
+    result = GetResult(run, params, model.GetActivity(), model.mode);
+    result.steps = steps;
+    result.period = period;
+
+    return true;
+}
+
+std::vector<std::vector<size_t>> SweepRunner::GetBatches(const std::vector<size_t>& runs) const {
+    std::vector<std::vector<size_t>> batches;
+    if (batchSize <= 1) {
+        for (size_t run : runs) {
+            batches.push_back({ run });
+        }
+        return batches;
+    }
+
+    // Members of an ensemble share size and mode
+    std::map<std::pair<size_t, int>, std::vector<size_t>> groups;
+    for (size_t run : runs) {
+        NeuralFieldModelParams params = config.GetRunParams(run, baseParams);
+        auto key = std::make_pair(static_cast<size_t>(params["size"]), static_cast<int>(params["mode"]));
+        groups[key].push_back(run);
+    }
+
+    for (const auto& group : groups) {
+        const auto& groupRuns = group.second;
+        for (size_t first = 0; first < groupRuns.size(); first += batchSize) {
+            size_t last = std::min(groupRuns.size(), first + batchSize);
+            batches.emplace_back(groupRuns.begin() + first, groupRuns.begin() + last);
+        }
+    }
+
+    return batches;
+}
+
+bool SweepRunner::RunBatch(const std::vector<size_t>& runs, int threads, std::vector<SweepResult>& results) const {
+#ifdef USE_OPENMP
+    omp_set_num_threads(threads);
+#else
+    (void)threads;
+#endif
+
+    const size_t count = runs.size();
+
+    std::vector<NeuralFieldModelParams> params;
+    for (size_t run : runs) {
+        params.push_back(config.GetRunParams(run, baseParams));
+    }
+
+    NeuralFieldEnsemble ensemble;
+    {
+        std::lock_guard<std::mutex> lock(initMutex);
+        if (!ensemble.Init(params.front(), params)) {
+            return false;
+        }
+    }
+
+    for (size_t b = 0; b < count; b++) {
+        FillStimulus(runs[b], ensemble.h[b], ensemble.stimulus->data + b, ensemble.size * ensemble.size, count);
+        ensemble.SetActivity(b, ensemble.size / 2, ensemble.size / 2, 1.f);
+    }
+
+    std::vector<FieldPeriodDetector> detectors(count, FieldPeriodDetector(config.history));
+    std::vector<int> steps(count, 0);
+    std::vector<int> periods(count, 0);
+
+    results.resize(count);
+    std::vector<bool> finished(count, false);
+    size_t finishedCount = 0;
+
+    MatrixGuard_t activity(matrix_allocate(ensemble.size, ensemble.size), matrix_free);
+
+    // Finished members are still advanced with the batch, their results are kept
+    // from the step where they have finished
+    auto finish = [&](size_t b) {
+        results[b] = GetResult(runs[b], params[b], activity.get(), ensemble.mode);
+        results[b].steps = steps[b];
+        results[b].period = periods[b];
+        finished[b] = true;
+        finishedCount++;
+    };
+
+    for (int step = 0; step < config.steps && finishedCount < count; step++) {
+        ensemble.Stimulate();
+        for (size_t b = 0; b < count; b++) {
+            if (finished[b]) {
+                continue;
+            }
+            steps[b]++;
+            ensemble.GetActivity(b, activity.get());
+            periods[b] = detectors[b].Push(field_active_hash(activity.get()));
+            if (periods[b] != 0) {
+                finish(b);
+            }
+        }
+    }
+
+    for (size_t b = 0; b < count; b++) {
+        if (!finished[b]) {
+            ensemble.GetActivity(b, activity.get());
+            finish(b);
+        }
+    }
+
+    return true;
+}
+
+void SweepRunner::FillStimulus(size_t run, double h, float* data, size_t count, size_t stride) const {
+    // Own generator keeps the stimulus of a run independent of the order of runs
+    std::mt19937 generator(static_cast<uint32_t>(config.seed + run));
+    std::uniform_real_distribution<float> distribution(0.f, 1.f);
+    for (size_t idx = 0; idx < count; idx++) {
+        float s = distribution(generator);
+        s *= -h;
+        data[idx * stride] = s;
+    }
+}
+
+SweepResult SweepRunner::GetResult(size_t run, const NeuralFieldModelParams& params,
+    const matrix_t* activity, KernelMode mode) const {
+    SweepResult result;
+    result.run = static_cast<uint32_t>(run);
+    result.activeFraction = static_cast<float>(field_active_fraction(activity));
+    result.bumps = field_bumps_count(activity, mode);
+
+    for (const auto& axis : config.axes) {
+        result.values.push_back(params.at(axis.key));
+    }
+
+    return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+/*****************************************************************************
+ * SweepRunner - runs unfinished points of a sweep on a pool of threads
+ *
+ * Each run advances a CPU model until it repeats one of its recent states
+ * or the step budget is exhausted. When fewer runs than jobs are left, the
+ * idle cores are given to OpenMP inside the remaining runs. Runs of the same
+ * size and mode may be grouped into batches that are advanced together in
+ * one NeuralFieldEnsemble.
+ ****************************************************************************/
+class SweepRunner {
+public:
+    SweepRunner(const SweepConfig& config, const NeuralFieldModelParams& baseParams, size_t batchSize = 1);
+
+    // Returns false if the sweep was stopped before all runs were finished or some runs
+    // failed. Failed runs aren't written to the results
+    bool Run(SweepResultsFile& results, const std::vector<bool>& finishedRuns,
+        int jobs, int threads, const std::atomic<bool>& stopRequested);
+
+    // Total number of model steps of the finished runs
+    uint64_t GetStepsCount() const { return stepsCount; }
+
+private:
+    std::vector<std::vector<size_t>> GetBatches(const std::vector<size_t>& runs) const;
+
+    // Return false if the model of the runs can't be initialized
+    bool RunSingle(size_t run, int threads, SweepResult& result) const;
+    bool RunBatch(const std::vector<size_t>& runs, int threads, std::vector<SweepResult>& results) const;
+
+    void FillStimulus(size_t run, double h, float* data, size_t count, size_t stride) const;
+    SweepResult GetResult(size_t run, const NeuralFieldModelParams& params,
+        const matrix_t* activity, KernelMode mode) const;
+
+private:
+    const SweepConfig& config;
+    NeuralFieldModelParams baseParams;
+    size_t batchSize = 1;
+
+    uint64_t stepsCount = 0;
+
+    // NeuralFieldModel::Init and NeuralFieldEnsemble::Init use global state of drand48
+    mutable std::mutex initMutex;
+};
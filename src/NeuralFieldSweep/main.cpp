@@ -0,0 +1,154 @@
+#include "stdafx.h"
+#include "Matrix.h"
+#include "Gauss.h"
+#include "NeuralFieldModel.h"
+#include "ModelConfig.h"
+#include "SweepConfig.h"
+#include "SweepResultsFile.h"
+#include "SweepRunner.h"
+#include "LogFormatter.h"
+#include "ResourceFinder.h"
+
+const std::filesystem::path g_configFile = "amari.conf";
+const std::filesystem::path g_sweepFile = "sweep.conf";
+
+static std::atomic<bool> g_StopRequested{false};
+
+struct SweepOptions {
+    std::string configFile;
+    std::string sweepFile;
+    std::string outputFile = "sweep.nfs";
+    std::string dumpFile;
+    int jobs = 0;
+    int threads = 0;
+    int batch = 1;
+};
+
+static void OnSignal(int) {
+    g_StopRequested = true;
+}
+
+static int ShowUsage(const std::string& cmd) {
+    std::cout << "Usage: " << cmd << " <option(s)>" << std::endl
+        << "Options:" << std::endl
+        << "\t-h,--help\t\tShow this help message" << std::endl
+        << "\t-c,--config FILE\tBase model config (default: data/amari.conf)" << std::endl
+        << "\t-s,--sweep FILE\t\tSweep config (default: data/sweep.conf)" << std::endl
+        << "\t-o,--output FILE\tResults file, existing results are resumed (default: sweep.nfs)" << std::endl
+        << "\t-j,--jobs NUM\t\tNumber of concurrent runs (default: number of cores)" << std::endl
+        << "\t-t,--threads NUM\tTotal number of threads (default: number of cores)" << std::endl
+        << "\t-b,--batch NUM\t\tAdvance up to NUM runs of the same size and mode in one ensemble (default: 1)" << std::endl
+        << "\t--dump FILE\t\tPrint results file as CSV and exit" << std::endl;
+    return EXIT_FAILURE;
+}
+
+static int ParseArgs(int argc, char* argv[], SweepOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-h" || arg == "--help") {
+            return ShowUsage(argv[0]);
+        }
+        else if ((arg == "-c" || arg == "--config") && hasValue) {
+            options.configFile = argv[++i];
+        }
+        else if ((arg == "-s" || arg == "--sweep") && hasValue) {
+            options.sweepFile = argv[++i];
+        }
+        else if ((arg == "-o" || arg == "--output") && hasValue) {
+            options.outputFile = argv[++i];
+        }
+        else if ((arg == "-j" || arg == "--jobs") && hasValue) {
+            options.jobs = atoi(argv[++i]);
+        }
+        else if ((arg == "-t" || arg == "--threads") && hasValue) {
+            options.threads = atoi(argv[++i]);
+        }
+        else if ((arg == "-b" || arg == "--batch") && hasValue) {
+            options.batch = atoi(argv[++i]);
+        }
+        else if (arg == "--dump" && hasValue) {
+            options.dumpFile = argv[++i];
+        }
+        else {
+            LOGE << "Unknown option or missing argument : " << arg;
+            return ShowUsage(argv[0]);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static NeuralFieldModelParams LoadParams(const std::string& configFilePath) {
+    NeuralFieldModelParams params;
+    if (!LoadModelParams(configFilePath, params)) {
+        LOGI << "Unable to load model config, will use default params instead";
+    }
+    return params;
+}
+
+int main(int argc, char* argv[]) {
+    plog::ConsoleAppender<plog::LogFormatter> logger;
+    plog::init(plog::info, &logger);
+
+    SweepOptions options;
+    if (ParseArgs(argc, argv, options) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    if (!options.dumpFile.empty()) {
+        return SweepResultsFile::Dump(options.dumpFile, std::cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::filesystem::path moduleDataDir;
+    if (Utils::ResourceFinder::GetDataDirectory(argv[0], moduleDataDir)) {
+        if (options.configFile.empty()) {
+            options.configFile = (moduleDataDir / g_configFile).string();
+        }
+        if (options.sweepFile.empty()) {
+            options.sweepFile = (moduleDataDir / g_sweepFile).string();
+        }
+    }
+
+    NeuralFieldModelParams baseParams = LoadParams(options.configFile);
+
+    SweepConfig config;
+    if (!config.Load(options.sweepFile)) {
+        return EXIT_FAILURE;
+    }
+
+    int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    int threads = (options.threads > 0) ? options.threads : cores;
+    int jobs = (options.jobs > 0) ? options.jobs : threads;
+
+    SweepResultsFile results;
+    std::vector<bool> finishedRuns;
+    if (!results.Open(options.outputFile, config, config.GetHash(baseParams), finishedRuns)) {
+        return EXIT_FAILURE;
+    }
+
+    // Interrupted sweep keeps finished runs and continues on the next start
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+
+    SweepRunner runner(config, baseParams, static_cast<size_t>(std::max(1, options.batch)));
+    auto startTime = std::chrono::steady_clock::now();
+    bool finished = runner.Run(results, finishedRuns, jobs, threads, g_StopRequested);
+    auto endTime = std::chrono::steady_clock::now();
+
+    results.Close();
+
+    double sweepTime = std::chrono::duration<double>(endTime - startTime).count();
+    LOGI << "Sweep time (s) = " << sweepTime;
+    if (sweepTime > 0.0) {
+        LOGI << "Sweep throughput (steps/s) = " << static_cast<double>(runner.GetStepsCount()) / sweepTime;
+    }
+    if (!finished) {
+        if (g_StopRequested) {
+            LOGI << "Sweep was stopped, run again with the same options to resume";
+        }
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#include "stdafx.h"
+#include "ParallelUtils.h"
+#include "KernelProfiler.h"
+
+#ifdef USE_OPENCL
+
+KernelProfiler::~KernelProfiler() {
+    Release();
+}
+
+bool KernelProfiler::Init(cl_command_queue commandQueue) {
+    Release();
+
+    cl_command_queue_properties properties = 0;
+    cl_int status = clGetCommandQueueInfo(commandQueue, CL_QUEUE_PROPERTIES,
+        sizeof(properties), &properties, NULL);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to get OpenCL command queue properties : " << ParallelUtils::GetOpenCLError(status);
+        return false;
+    }
+
+    isEnabled_ = (properties & CL_QUEUE_PROFILING_ENABLE) != 0;
+    if (isEnabled_) {
+        LOGI << "OpenCL profiling is enabled";
+    }
+
+    return true;
+}
+
+void KernelProfiler::Release() {
+    for (auto& command : pending_) {
+        if (command.second) {
+            clReleaseEvent(command.second);
+        }
+    }
+    pending_.clear();
+    stats_.clear();
+
+    isEnabled_ = false;
+}
+
+cl_event* KernelProfiler::NextEvent(const std::string& name) {
+    if (!isEnabled_) {
+        return nullptr;
+    }
+
+    pending_.emplace_back(name, cl_event(0));
+    return &pending_.back().second;
+}
+
+void KernelProfiler::Collect(bool wait) {
+    // Commands of the main and the aux queue finish in any order relative to each
+    // other, so running commands are kept and the later ones are still checked
+    size_t running = 0;
+
+    for (size_t i = 0; i < pending_.size(); i++) {
+        const std::string& name = pending_[i].first;
+        cl_event event = pending_[i].second;
+
+        // Event is not set when the command failed to enqueue
+        if (event) {
+            cl_int status;
+
+            if (wait) {
+                clWaitForEvents(1, &event);
+            }
+
+            cl_int executionStatus = CL_QUEUED;
+            status = clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                sizeof(executionStatus), &executionStatus, NULL);
+
+            if (status == CL_SUCCESS && executionStatus > CL_COMPLETE) {
+                pending_[running++] = pending_[i];
+                continue;
+            }
+
+            cl_ulong queued = 0, submit = 0, start = 0, end = 0;
+            if (status == CL_SUCCESS && executionStatus == CL_COMPLETE) {
+                status |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, NULL);
+                status |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submit, NULL);
+                status |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+                status |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+
+                if (status == CL_SUCCESS) {
+                    KernelProfileStats& s = stats_[name];
+                    s.name = name;
+                    s.count++;
+                    s.queuedNs += (submit > queued) ? (submit - queued) : 0;
+                    s.submitNs += (start > submit) ? (start - submit) : 0;
+                    s.executionNs += (end > start) ? (end - start) : 0;
+                }
+            }
+
+            clReleaseEvent(event);
+        }
+    }
+
+    pending_.resize(running);
+}
+
+void KernelProfiler::Reset() {
+    stats_.clear();
+}
+
+std::vector<KernelProfileStats> KernelProfiler::GetStats() const {
+    std::vector<KernelProfileStats> stats;
+    stats.reserve(stats_.size());
+    for (const auto& s : stats_) {
+        stats.push_back(s.second);
+    }
+
+    // Most expensive commands first
+    std::sort(stats.begin(), stats.end(), [](const KernelProfileStats& a, const KernelProfileStats& b) {
+        return a.executionNs > b.executionNs;
+    });
+
+    return stats;
+}
+
+#endif /* USE_OPENCL */
@@ -0,0 +1,57 @@
+#pragma once
+
+#ifdef USE_OPENCL
+
+struct KernelProfileStats {
+    std::string name;
+    uint64_t count = 0;
+
+    // Total times of all commands in nanoseconds
+    uint64_t queuedNs = 0; // From enqueue to submission to the device
+    uint64_t submitNs = 0; // From submission to start of execution
+    uint64_t executionNs = 0; // From start to end of execution
+};
+
+/*****************************************************************************
+ * KernelProfiler
+ *
+ * Keeps events of commands enqueued to a profiling command queue and
+ * aggregates their timings by command name
+ ****************************************************************************/
+class KernelProfiler {
+public:
+    KernelProfiler() = default;
+    ~KernelProfiler();
+
+    KernelProfiler(const KernelProfiler&) = delete;
+    KernelProfiler& operator=(const KernelProfiler&) = delete;
+
+    // Profiling is enabled only if the queue has CL_QUEUE_PROFILING_ENABLE property
+    bool Init(cl_command_queue commandQueue);
+    void Release();
+
+    bool IsEnabled() const { return isEnabled_; }
+
+    // Event for the clEnqueue* call of the command. Returns nullptr when
+    // profiling is disabled, so the result can be passed to OpenCL as is
+    cl_event* NextEvent(const std::string& name);
+
+    // Aggregates timings of finished commands of any of the queues that share
+    // the profiler. With wait it blocks until all pending commands are finished
+    void Collect(bool wait = false);
+
+    void Reset();
+
+    std::vector<KernelProfileStats> GetStats() const;
+
+private:
+    bool isEnabled_ = false;
+
+    // Deque keeps addresses of events valid while new ones are added. Running
+    // commands are moved to the front by Collect, after their events are set
+    std::deque<std::pair<std::string, cl_event>> pending_;
+
+    std::map<std::string, KernelProfileStats> stats_;
+};
+
+#endif /* USE_OPENCL */
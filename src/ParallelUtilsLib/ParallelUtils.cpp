@@ -1,25 +1,74 @@
 #include "stdafx.h"
 #include "ParallelUtils.h"
 
-static std::string GetDeviceInfoString(cl_device_id device, cl_device_info paramName) {
-    cl_int status;
-    size_t retSize = 0;
-    status = clGetDeviceInfo(device, paramName, 0, nullptr, &retSize);
-    if (status != CL_SUCCESS || retSize == 0) {
+uint64_t ParallelUtils::Hash(const void* data, size_t size, uint64_t hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t ParallelUtils::Hash(const std::string& str, uint64_t hash) {
+    return Hash(str.data(), str.size(), hash);
+}
+
+std::string ParallelUtils::GetHashString(uint64_t hash) {
+    std::stringstream s;
+    s << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return s.str();
+}
+
+// --------------------------------------------------------
+// Directory of caches
+
+static const char CacheEnvVar[] = "NEURALFIELD_CACHE";
+static const std::filesystem::path CacheDirName = "NeuralField-cache";
+
+static std::filesystem::path GetDefaultCacheDir() {
+    const char* envDir = std::getenv(CacheEnvVar);
+    if (envDir) {
+        // Empty variable disables the caches
+        return std::filesystem::path(envDir);
+    }
+
+    std::error_code ec;
+    std::filesystem::path tempDir = std::filesystem::temp_directory_path(ec);
+    if (ec) {
         return {};
     }
 
-    std::vector<char> buf(retSize);
-    status = clGetDeviceInfo(device, paramName, sizeof(buf[0]) * buf.size(), buf.data(), nullptr);
-    if (status != CL_SUCCESS) {
+    return tempDir / CacheDirName;
+}
+
+static std::filesystem::path g_CacheDir = GetDefaultCacheDir();
+
+void ParallelUtils::SetCacheDir(const std::filesystem::path& dir) {
+    g_CacheDir = dir;
+}
+
+std::filesystem::path ParallelUtils::GetCacheDir() {
+    return g_CacheDir;
+}
+
+#ifdef USE_OPENCL
+
+std::string ParallelUtils::GetDeviceInfoString(cl_device_id device, cl_device_info paramName) {
+    size_t size = 0;
+    if (clGetDeviceInfo(device, paramName, 0, nullptr, &size) != CL_SUCCESS || size == 0) {
         return {};
     }
 
-    std::string str(buf.begin(), buf.end());
+    std::string value(size, '\0');
+    if (clGetDeviceInfo(device, paramName, size, value.data(), nullptr) != CL_SUCCESS) {
+        return {};
+    }
 
-    // Use .c_str() to return string null-character at the end.
-    // Null-terminated string will break the stringstream
-    return str;
+    // Null character would break streams the string is written to
+    value.resize(size - 1);
+
+    return value;
 }
 
 static std::string GetPlatformInfoString(cl_platform_id platform, cl_platform_info paramName) {
@@ -59,7 +108,7 @@ std::string ParallelUtils::GetDeviceInfo(cl_device_id device) {
         std::tie(infoId, paramName) = info;
 
         s << "  " << paramName <<
-            ": " << GetDeviceInfoString(device, infoId).c_str() << std::endl;
+            ": " << GetDeviceInfoString(device, infoId) << std::endl;
     }
 
     cl_bool imageSupport;
@@ -165,6 +214,156 @@ std::string ParallelUtils::GetOpenCLError(cl_int error) {
     }
 }
 
+std::vector<ParallelUtils::DeviceDesc> ParallelUtils::GetDevices() {
+    std::vector<DeviceDesc> devices;
+
+    cl_uint numPlatforms{ 0 };
+    if (clGetPlatformIDs(0, nullptr, &numPlatforms) != CL_SUCCESS || numPlatforms == 0) {
+        return devices;
+    }
+
+    std::vector<cl_platform_id> platformIds(numPlatforms);
+    if (clGetPlatformIDs(numPlatforms, platformIds.data(), nullptr) != CL_SUCCESS) {
+        return devices;
+    }
+
+    for (size_t p = 0; p < platformIds.size(); p++) {
+        cl_uint numDevices{ 0 };
+        if (clGetDeviceIDs(platformIds[p], CL_DEVICE_TYPE_ALL, 0, nullptr, &numDevices) != CL_SUCCESS) {
+            continue;
+        }
+
+        std::vector<cl_device_id> deviceIds(numDevices);
+        if (clGetDeviceIDs(platformIds[p], CL_DEVICE_TYPE_ALL, numDevices, deviceIds.data(), nullptr) != CL_SUCCESS) {
+            continue;
+        }
+
+        for (size_t d = 0; d < deviceIds.size(); d++) {
+            DeviceDesc desc;
+            desc.platformNum = p + 1;
+            desc.deviceNum = d + 1;
+            desc.name = GetDeviceInfoString(deviceIds[d], CL_DEVICE_NAME);
+            devices.push_back(desc);
+        }
+    }
+
+    return devices;
+}
+
+bool ParallelUtils::CreateContext(size_t platformNum, size_t deviceNum,
+    cl_platform_id* platformId, cl_device_id* device,
+    cl_context* context, cl_command_queue* commandQueue,
+    bool profiling) {
+    // --------------------------------------------------------
+    // Variables
+
+    cl_int status{ 0 };
+
+    // --------------------------------------------------------
+    // Get all platforms
+    cl_uint numPlatforms{ 0 };
+    status = clGetPlatformIDs(0, nullptr, &numPlatforms);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to get number of platforms : " << GetOpenCLError(status);
+        return false;
+    }
+
+    LOGI << "This system provides " << numPlatforms << " platforms";
+
+    std::vector<cl_platform_id> platformIds(numPlatforms);
+    status = clGetPlatformIDs(numPlatforms, platformIds.data(), nullptr);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to get platform ids : " << GetOpenCLError(status);
+        return false;
+    }
+
+    // --------------------------------------------------------
+    // Check that selected platform exists
+    if (platformNum < 1 || platformNum > platformIds.size()) {
+        LOGE << "Platform " << platformNum << " was not found in this system";
+        return false;
+    }
+
+    cl_platform_id newPlatformId = platformIds[platformNum - 1];
+
+    // --------------------------------------------------------
+    // Get all devices
+    cl_uint numDevices{ 0 };
+    status = clGetDeviceIDs(newPlatformId, CL_DEVICE_TYPE_ALL, 0, nullptr, &numDevices);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to get number of OpenCL deivces : " << GetOpenCLError(status);
+        return false;
+    }
+
+    LOGI << "Platform " << platformNum << " provides " << numDevices << " devices";
+
+    std::vector<cl_device_id> deviceIds(numDevices);
+    status = clGetDeviceIDs(newPlatformId, CL_DEVICE_TYPE_ALL, numDevices, deviceIds.data(), nullptr);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to get deivce ids : " << GetOpenCLError(status);
+        return false;
+    }
+
+    // --------------------------------------------------------
+    // Check that selected device exists
+    if (deviceNum < 1 || deviceNum > deviceIds.size()) {
+        LOGE << "OpenCL device " << deviceNum << " is not found in this system";
+        return false;
+    }
+
+    cl_device_id newDevice = deviceIds[deviceNum - 1];
+
+    // Create the context
+    cl_context newContext = clCreateContext(0, 1, &newDevice, NULL, NULL, &status);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to create OpenCL context : " << GetOpenCLError(status);
+        return false;
+    }
+
+    // Create a command-queue
+    cl_command_queue_properties properties = profiling ? CL_QUEUE_PROFILING_ENABLE : 0;
+    cl_command_queue newCommandQueue = clCreateCommandQueue(newContext, newDevice, properties, &status);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to create OpenCL command queue : " << GetOpenCLError(status);
+        clReleaseContext(newContext);
+        return false;
+    }
+
+    *platformId = newPlatformId;
+    *device = newDevice;
+    *context = newContext;
+    *commandQueue = newCommandQueue;
+
+    return true;
+}
+
+bool ParallelUtils::EnqueueWaitForQueue(cl_command_queue queue, cl_command_queue otherQueue) {
+    if (queue == otherQueue) {
+        return true;
+    }
+
+    cl_event event = 0;
+    cl_int status = clEnqueueMarkerWithWaitList(otherQueue, 0, NULL, &event);
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to enqueue OpenCL marker : " << GetOpenCLError(status);
+        return false;
+    }
+
+    // Commands of the other queue have to be submitted before the queue waits for them
+    status = clFlush(otherQueue);
+    if (status == CL_SUCCESS) {
+        status = clEnqueueBarrierWithWaitList(queue, 1, &event, NULL);
+    }
+    clReleaseEvent(event);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to enqueue OpenCL barrier : " << GetOpenCLError(status);
+        return false;
+    }
+
+    return true;
+}
+
 static std::string GetOpenCLProgramBuildLog(cl_program program, cl_device_id device) {
     cl_int status;
     size_t buildLogLen;
@@ -183,32 +382,217 @@ static std::string GetOpenCLProgramBuildLog(cl_program program, cl_device_id dev
     return buildLog;
 }
 
-bool ParallelUtils::CreateProgram(cl_context context, cl_device_id device,
-    const std::string& kernelName,
-    const std::string& kernelSource,
-    cl_program* program, cl_kernel* kernel) {
+// --------------------------------------------------------
+// Cache of compiled program binaries
+
+// FNV-1a hash of everything that affects the compiled binary
+static uint64_t GetProgramHash(cl_device_id device, const std::string& kernelSource,
+    const std::string& buildOptions) {
+    const std::vector<std::string> keys = {
+        kernelSource,
+        buildOptions,
+        ParallelUtils::GetDeviceInfoString(device, CL_DEVICE_NAME),
+        ParallelUtils::GetDeviceInfoString(device, CL_DRIVER_VERSION),
+    };
+
+    uint64_t hash = ParallelUtils::HashOffsetBasis;
+    for (const auto& key : keys) {
+        hash = ParallelUtils::Hash(key, hash);
+
+        // Separator so that keys can't run into each other
+        const uint8_t separator = 0xFF;
+        hash = ParallelUtils::Hash(&separator, sizeof(separator), hash);
+    }
+
+    return hash;
+}
+
+static std::filesystem::path GetProgramCachePath(uint64_t hash) {
+    return ParallelUtils::GetCacheDir() / (ParallelUtils::GetHashString(hash) + ".bin");
+}
 
+static bool LoadProgramBinary(const std::filesystem::path& path, std::vector<unsigned char>& binary) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        return false;
+    }
+
+    std::streamoff size = f.tellg();
+    if (size <= 0) {
+        return false;
+    }
+
+    binary.resize(static_cast<size_t>(size));
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(binary.data()), size);
+
+    return static_cast<bool>(f);
+}
+
+static void SaveProgramBinary(const std::filesystem::path& path, cl_program program, cl_device_id device) {
+    cl_int status;
+
+    // Program may be built for several devices of the context
+    cl_uint numDevices = 0;
+    status = clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(numDevices), &numDevices, NULL);
+    if (status != CL_SUCCESS || numDevices == 0) {
+        return;
+    }
+
+    std::vector<cl_device_id> devices(numDevices);
+    status = clGetProgramInfo(program, CL_PROGRAM_DEVICES, sizeof(cl_device_id) * numDevices, devices.data(), NULL);
+    if (status != CL_SUCCESS) {
+        return;
+    }
+
+    auto it = std::find(devices.begin(), devices.end(), device);
+    if (it == devices.end()) {
+        return;
+    }
+    size_t deviceIdx = static_cast<size_t>(std::distance(devices.begin(), it));
+
+    std::vector<size_t> sizes(numDevices);
+    status = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * numDevices, sizes.data(), NULL);
+    if (status != CL_SUCCESS || sizes[deviceIdx] == 0) {
+        return;
+    }
+
+    std::vector<std::vector<unsigned char>> binaries(numDevices);
+    std::vector<unsigned char*> binaryPtrs(numDevices);
+    for (size_t i = 0; i < numDevices; i++) {
+        binaries[i].resize(sizes[i]);
+        binaryPtrs[i] = binaries[i].data();
+    }
+
+    status = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*) * numDevices, binaryPtrs.data(), NULL);
+    if (status != CL_SUCCESS) {
+        LOGW << "Failed to get OpenCL program binary : " << ParallelUtils::GetOpenCLError(status);
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec) {
+        LOGW << "Failed to create OpenCL program cache directory " << path.parent_path() << " : " << ec.message();
+        return;
+    }
+
+    // Write to a temporary file first so that concurrent jobs never read a partial binary
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp" + std::to_string(reinterpret_cast<uintptr_t>(program));
+    {
+        std::ofstream f(tempPath, std::ios::binary | std::ios::trunc);
+        f.write(reinterpret_cast<const char*>(binaries[deviceIdx].data()), binaries[deviceIdx].size());
+        if (!f) {
+            LOGW << "Failed to write OpenCL program binary " << tempPath;
+            f.close();
+            std::filesystem::remove(tempPath, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        LOGW << "Failed to store OpenCL program binary " << path << " : " << ec.message();
+        std::filesystem::remove(tempPath, ec);
+        return;
+    }
+
+    LOGD << "Stored OpenCL program binary " << path;
+}
+
+static cl_program CreateProgramFromBinary(cl_context context, cl_device_id device,
+    const std::vector<unsigned char>& binary, const std::string& buildOptions) {
+    cl_int status, binaryStatus;
+
+    const unsigned char* binaryPtr = binary.data();
+    const size_t binarySize = binary.size();
+
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, &binarySize, &binaryPtr,
+        &binaryStatus, &status);
+    if (status != CL_SUCCESS || binaryStatus != CL_SUCCESS) {
+        LOGD << "Cached OpenCL program binary is rejected : " << ParallelUtils::GetOpenCLError(
+            status != CL_SUCCESS ? status : binaryStatus);
+        if (program) {
+            clReleaseProgram(program);
+        }
+        return 0;
+    }
+
+    // Binaries still have to be built before kernels can be created
+    status = clBuildProgram(program, 1, &device, buildOptions.c_str(), NULL, NULL);
+    if (status != CL_SUCCESS) {
+        LOGD << "Failed to build cached OpenCL program binary : " << ParallelUtils::GetOpenCLError(status);
+        clReleaseProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+static cl_program CreateProgramFromSource(cl_context context, cl_device_id device,
+    const std::string& kernelSource, const std::string& buildOptions) {
     cl_int status;
 
     const char* sourcePtr = kernelSource.c_str();
-    cl_program newProgram = clCreateProgramWithSource(context, 1, &sourcePtr, NULL, &status);
+    cl_program program = clCreateProgramWithSource(context, 1, &sourcePtr, NULL, &status);
     if (status != CL_SUCCESS) {
-        LOGE << "Failed to create OpenCL program : " << GetOpenCLError(status);
-        return false;
+        LOGE << "Failed to create OpenCL program : " << ParallelUtils::GetOpenCLError(status);
+        return 0;
     }
 
     // Build the program
-    status = clBuildProgram(newProgram, 0, NULL, NULL, NULL, NULL);
+    status = clBuildProgram(program, 1, &device, buildOptions.c_str(), NULL, NULL);
     if (status != CL_SUCCESS) {
-        LOGE << "Failed to build OpenCL program : " << GetOpenCLError(status);
-        LOGE << "OpenCL Build Log : " << std::endl << GetOpenCLProgramBuildLog(newProgram, device);
-        return false;
+        LOGE << "Failed to build OpenCL program : " << ParallelUtils::GetOpenCLError(status);
+        LOGE << "OpenCL Build Log : " << std::endl << GetOpenCLProgramBuildLog(program, device);
+        clReleaseProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+bool ParallelUtils::CreateProgram(cl_context context, cl_device_id device,
+    const std::string& kernelName,
+    const std::string& kernelSource,
+    cl_program* program, cl_kernel* kernel,
+    const std::string& buildOptions) {
+
+    cl_int status;
+
+    const bool useCache = !ParallelUtils::GetCacheDir().empty();
+    std::filesystem::path cachePath;
+
+    cl_program newProgram = 0;
+    if (useCache) {
+        cachePath = GetProgramCachePath(GetProgramHash(device, kernelSource, buildOptions));
+
+        std::vector<unsigned char> binary;
+        if (LoadProgramBinary(cachePath, binary)) {
+            newProgram = CreateProgramFromBinary(context, device, binary, buildOptions);
+            if (newProgram) {
+                LOGD << "Loaded OpenCL program " << kernelName << " from cache " << cachePath;
+            }
+        }
+    }
+
+    if (!newProgram) {
+        newProgram = CreateProgramFromSource(context, device, kernelSource, buildOptions);
+        if (!newProgram) {
+            return false;
+        }
+
+        if (useCache) {
+            SaveProgramBinary(cachePath, newProgram, device);
+        }
     }
 
     // Create the kernel
     cl_kernel newKernel = clCreateKernel(newProgram, kernelName.c_str(), &status);
     if (status != CL_SUCCESS) {
         LOGE << "Failed to create OpenCL kernel : " << GetOpenCLError(status);
+        clReleaseProgram(newProgram);
         return false;
     }
 
@@ -217,3 +601,68 @@ bool ParallelUtils::CreateProgram(cl_context context, cl_device_id device,
 
     return true;
 }
+
+std::string ParallelUtils::GetBuildOptions(const std::vector<std::pair<std::string, std::string>>& defines) {
+    std::stringstream s;
+    for (const auto& define : defines) {
+        if (s.tellp() > 0) {
+            s << " ";
+        }
+        s << "-D" << define.first;
+        if (!define.second.empty()) {
+            s << "=" << define.second;
+        }
+    }
+    return s.str();
+}
+
+std::string ParallelUtils::GetFloatListLiteral(const float* data, size_t size) {
+    std::stringstream s;
+    s << std::hexfloat;
+    for (size_t i = 0; i < size; i++) {
+        if (i > 0) {
+            s << ",";
+        }
+        s << static_cast<double>(data[i]) << "f";
+    }
+    return s.str();
+}
+
+ParallelUtils::ProgramVariants::ProgramVariants(const std::string& kernelName, const std::string& kernelSource)
+    : kernelName_(kernelName)
+    , kernelSource_(kernelSource) {
+}
+
+ParallelUtils::ProgramVariants::~ProgramVariants() {
+    Release();
+}
+
+cl_kernel ParallelUtils::ProgramVariants::GetKernel(cl_context context, cl_device_id device,
+    const std::string& buildOptions) {
+    auto it = variants_.find(buildOptions);
+    if (it != variants_.end()) {
+        return it->second.second;
+    }
+
+    cl_program program = 0;
+    cl_kernel kernel = 0;
+    if (!CreateProgram(context, device, kernelName_, kernelSource_, &program, &kernel, buildOptions)) {
+        LOGE << "Failed to create variant of OpenCL kernel " << kernelName_;
+        return 0;
+    }
+
+    LOGD << "Created variant of OpenCL kernel " << kernelName_;
+
+    variants_[buildOptions] = std::make_pair(program, kernel);
+    return kernel;
+}
+
+void ParallelUtils::ProgramVariants::Release() {
+    for (auto& variant : variants_) {
+        clReleaseKernel(variant.second.second);
+        clReleaseProgram(variant.second.first);
+    }
+    variants_.clear();
+}
+
+#endif /* USE_OPENCL */
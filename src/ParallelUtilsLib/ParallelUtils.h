@@ -1,12 +1,84 @@
 #pragma once
 
 namespace ParallelUtils {
+    // FNV-1a hash of the data, parts of the data are added to the hash of the previous parts
+    constexpr uint64_t HashOffsetBasis = 14695981039346656037ULL;
+    uint64_t Hash(const void* data, size_t size, uint64_t hash = HashOffsetBasis);
+    uint64_t Hash(const std::string& str, uint64_t hash = HashOffsetBasis);
+
+    // Hash as 16 hexadecimal digits for keys and names of cache files
+    std::string GetHashString(uint64_t hash);
+
+    // Directory of files kept between launches: compiled programs, work-group sizes
+    // and the choice of compute backend. Empty path disables the caches.
+    // Defaults to NEURALFIELD_CACHE or a directory in the system temp path
+    void SetCacheDir(const std::filesystem::path& dir);
+    std::filesystem::path GetCacheDir();
+
+#ifdef USE_OPENCL
+    struct DeviceDesc {
+        size_t platformNum = 0; // 1-based numbers as in CreateContext
+        size_t deviceNum = 0;
+        std::string name;
+    };
+
     std::string GetOpenCLError(cl_int error);
+    // String parameter of the device without the null character, empty on failure
+    std::string GetDeviceInfoString(cl_device_id device, cl_device_info paramName);
     std::string GetDeviceInfo(cl_device_id device);
     std::string GetPlatformInfo(cl_platform_id platform);
 
+    // All devices of all platforms in the system
+    std::vector<DeviceDesc> GetDevices();
+
+    // Creates context and command queue on the device with 1-based numbers of platform and device.
+    // With profiling the queue records timings of commands
+    bool CreateContext(size_t platformNum, size_t deviceNum,
+        cl_platform_id* platformId, cl_device_id* device,
+        cl_context* context, cl_command_queue* commandQueue,
+        bool profiling = false);
+
+    // Commands enqueued to the queue after the call start once all commands enqueued
+    // to the other queue so far are finished. Does nothing for the same queue
+    bool EnqueueWaitForQueue(cl_command_queue queue, cl_command_queue otherQueue);
+
+    // Builds the program or loads its binary from the cache
     bool CreateProgram(cl_context context, cl_device_id device,
         const std::string& kernelName,
         const std::string& kernelSource,
-        cl_program* program, cl_kernel* kernel);
+        cl_program* program, cl_kernel* kernel,
+        const std::string& buildOptions = {});
+
+    // Build options with -D definitions of names and values
+    std::string GetBuildOptions(const std::vector<std::pair<std::string, std::string>>& defines);
+
+    // Comma-separated list of exact hexadecimal float literals
+    std::string GetFloatListLiteral(const float* data, size_t size);
+
+    /*****************************************************************************
+     * ProgramVariants
+     *
+     * Variants of one kernel compiled with different build options. Variants are
+     * built on the first request and kept until Release()
+     ****************************************************************************/
+    class ProgramVariants {
+    public:
+        ProgramVariants(const std::string& kernelName, const std::string& kernelSource);
+        ~ProgramVariants();
+
+        ProgramVariants(const ProgramVariants&) = delete;
+        ProgramVariants& operator=(const ProgramVariants&) = delete;
+
+        // Returns 0 when the variant can't be built
+        cl_kernel GetKernel(cl_context context, cl_device_id device, const std::string& buildOptions);
+
+        void Release();
+
+    private:
+        std::string kernelName_;
+        std::string kernelSource_;
+
+        std::map<std::string, std::pair<cl_program, cl_kernel>> variants_;
+    };
+#endif /* USE_OPENCL */
 }
@@ -0,0 +1,188 @@
+#include "stdafx.h"
+#include "ParallelUtils.h"
+#include "WorkGroupTuner.h"
+
+#ifdef USE_OPENCL
+
+static const std::filesystem::path ResultsFileName = "workgroups.txt";
+
+// Launches of every candidate after the warm-up one
+static const int TimedLaunches = 5;
+
+// Hash of the device name and driver version
+static std::string GetDeviceKey(cl_device_id device) {
+    return ParallelUtils::GetHashString(ParallelUtils::Hash(
+        ParallelUtils::GetDeviceInfoString(device, CL_DEVICE_NAME) + ";" +
+        ParallelUtils::GetDeviceInfoString(device, CL_DRIVER_VERSION)));
+}
+
+bool WorkGroupTuner::Init(cl_device_id device, cl_command_queue commandQueue) {
+    device_ = device;
+    commandQueue_ = commandQueue;
+    deviceKey_ = GetDeviceKey(device);
+
+    LoadResults();
+
+    return true;
+}
+
+std::vector<size_t> WorkGroupTuner::GetCandidates(cl_kernel kernel, cl_uint dims) const {
+    cl_int status = CL_SUCCESS;
+
+    size_t kernelWorkGroupSize = 0;
+    status |= clGetKernelWorkGroupInfo(kernel, device_, CL_KERNEL_WORK_GROUP_SIZE,
+        sizeof(kernelWorkGroupSize), &kernelWorkGroupSize, nullptr);
+
+    size_t preferredMultiple = 0;
+    status |= clGetKernelWorkGroupInfo(kernel, device_, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+        sizeof(preferredMultiple), &preferredMultiple, nullptr);
+
+    size_t deviceWorkGroupSize = 0;
+    status |= clGetDeviceInfo(device_, CL_DEVICE_MAX_WORK_GROUP_SIZE,
+        sizeof(deviceWorkGroupSize), &deviceWorkGroupSize, nullptr);
+
+    size_t workItemSizes[3] = { 0, 0, 0 };
+    status |= clGetDeviceInfo(device_, CL_DEVICE_MAX_WORK_ITEM_SIZES,
+        sizeof(workItemSizes), workItemSizes, nullptr);
+
+    if (status != CL_SUCCESS) {
+        LOGE << "Failed to get OpenCL work-group limits : " << ParallelUtils::GetOpenCLError(status);
+        return { 1 };
+    }
+
+    const size_t maxSize = std::min(kernelWorkGroupSize, deviceWorkGroupSize);
+    const size_t multiple = std::max<size_t>(1, std::min(preferredMultiple, maxSize));
+
+    std::vector<size_t> candidates;
+    if (dims == 1) {
+        for (size_t size = multiple; size <= std::min(maxSize, workItemSizes[0]); size *= 2) {
+            candidates.push_back(size);
+        }
+    }
+    else {
+        // Square work-groups of at least the preferred multiple of items
+        const size_t maxSide = std::min(workItemSizes[0], workItemSizes[1]);
+        for (size_t side = 1; side <= maxSide && side * side <= maxSize; side *= 2) {
+            if (side * side >= multiple) {
+                candidates.push_back(side);
+            }
+        }
+    }
+
+    if (candidates.empty()) {
+        candidates.push_back(1);
+    }
+
+    return candidates;
+}
+
+size_t WorkGroupTuner::GetLocalSize(const std::string& name, size_t globalSize,
+    const std::vector<size_t>& candidates, const LaunchFunc& launch) {
+    return GetFastest("Work-group size of " + name, name, globalSize, candidates, launch);
+}
+
+size_t WorkGroupTuner::GetFastestVariant(const std::string& name, size_t globalSize,
+    const std::vector<size_t>& variants, const LaunchFunc& launch) {
+    return GetFastest("Variant of " + name, name, globalSize, variants, launch);
+}
+
+size_t WorkGroupTuner::GetFastest(const std::string& title, const std::string& name, size_t globalSize,
+    const std::vector<size_t>& candidates, const LaunchFunc& launch) {
+    const std::string key = deviceKey_ + ":" + name + ":" + std::to_string(globalSize);
+
+    auto result = results_.find(key);
+    if (result != results_.end() &&
+        std::find(candidates.begin(), candidates.end(), result->second) != candidates.end()) {
+        return result->second;
+    }
+
+    size_t bestSize = candidates.front();
+    double bestTime = -1.0;
+
+    for (size_t localSize : candidates) {
+        // The first launch includes lazy initialization in the driver
+        if (!launch(localSize) || clFinish(commandQueue_) != CL_SUCCESS) {
+            continue;
+        }
+
+        bool isLaunched = true;
+        auto startTime = std::chrono::steady_clock::now();
+        for (int i = 0; i < TimedLaunches && isLaunched; i++) {
+            isLaunched = launch(localSize);
+        }
+        isLaunched = (clFinish(commandQueue_) == CL_SUCCESS) && isLaunched;
+        auto endTime = std::chrono::steady_clock::now();
+
+        if (!isLaunched) {
+            continue;
+        }
+
+        double time = std::chrono::duration<double, std::micro>(endTime - startTime).count() / TimedLaunches;
+        LOGD << title << " " << localSize << " : " << time << " us";
+
+        if (bestTime < 0.0 || time < bestTime) {
+            bestTime = time;
+            bestSize = localSize;
+        }
+    }
+
+    if (bestTime < 0.0) {
+        LOGW << "Unable to time candidates of " << name << ", use " << bestSize;
+        return bestSize;
+    }
+
+    LOGI << title << " for global size " << globalSize << " : " << bestSize;
+
+    results_[key] = bestSize;
+    SaveResult(key, bestSize);
+
+    return bestSize;
+}
+
+std::filesystem::path WorkGroupTuner::GetResultsPath() const {
+    std::filesystem::path cacheDir = ParallelUtils::GetCacheDir();
+    if (cacheDir.empty()) {
+        return {};
+    }
+    return cacheDir / ResultsFileName;
+}
+
+void WorkGroupTuner::LoadResults() {
+    results_.clear();
+
+    std::filesystem::path path = GetResultsPath();
+    if (path.empty()) {
+        return;
+    }
+
+    std::ifstream f(path);
+
+    // Lines of "<device>:<name>:<global size> <local size>", later lines win
+    std::string key;
+    size_t localSize = 0;
+    while (f >> key >> localSize) {
+        if (key.compare(0, deviceKey_.size(), deviceKey_) == 0) {
+            results_[key] = localSize;
+        }
+    }
+}
+
+void WorkGroupTuner::SaveResult(const std::string& key, size_t localSize) const {
+    std::filesystem::path path = GetResultsPath();
+    if (path.empty()) {
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    std::ofstream f(path, std::ios::app);
+    if (!f) {
+        LOGW << "Unable to store work-group size in " << path;
+        return;
+    }
+
+    f << key << " " << localSize << std::endl;
+}
+
+#endif /* USE_OPENCL */
@@ -0,0 +1,55 @@
+#pragma once
+
+#ifdef USE_OPENCL
+
+/*****************************************************************************
+ * WorkGroupTuner
+ *
+ * Picks local work sizes of kernels by timing candidates on the device. The
+ * best size is stored per device, kernel and global size in the cache
+ * directory, so every configuration is timed only once
+ ****************************************************************************/
+class WorkGroupTuner {
+public:
+    // Enqueues the kernel with the local size, 2D kernels get square work-groups
+    // of the side. Returns false if the kernel can't be launched
+    using LaunchFunc = std::function<bool(size_t localSize)>;
+
+    WorkGroupTuner() = default;
+
+    WorkGroupTuner(const WorkGroupTuner&) = delete;
+    WorkGroupTuner& operator=(const WorkGroupTuner&) = delete;
+
+    bool Init(cl_device_id device, cl_command_queue commandQueue);
+
+    // Powers of two times CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE within limits
+    // of the kernel and the device. For 2D kernels these are sides of square work-groups
+    std::vector<size_t> GetCandidates(cl_kernel kernel, cl_uint dims) const;
+
+    // Fastest of the candidates, timed on the first request for the name and global size
+    size_t GetLocalSize(const std::string& name, size_t globalSize,
+        const std::vector<size_t>& candidates, const LaunchFunc& launch);
+
+    // Fastest of alternative implementations of the same work, the launch gets
+    // the variant instead of the local size. Stored like local sizes
+    size_t GetFastestVariant(const std::string& name, size_t globalSize,
+        const std::vector<size_t>& variants, const LaunchFunc& launch);
+
+private:
+    size_t GetFastest(const std::string& title, const std::string& name, size_t globalSize,
+        const std::vector<size_t>& candidates, const LaunchFunc& launch);
+
+    std::filesystem::path GetResultsPath() const;
+    void LoadResults();
+    void SaveResult(const std::string& key, size_t localSize) const;
+
+    cl_device_id device_ = 0;
+    cl_command_queue commandQueue_ = 0;
+
+    // Hash of the device name and driver version
+    std::string deviceKey_;
+
+    std::map<std::string, size_t> results_;
+};
+
+#endif /* USE_OPENCL */
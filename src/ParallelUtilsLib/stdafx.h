@@ -1,5 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
 #include <string>
 #include <vector>
 #include <tuple>
@@ -7,8 +17,10 @@
 
 #include <plog/Log.h>
 
+#ifdef USE_OPENCL
 #ifdef __APPLE__
 #include <OpenCL/opencl.h>
 #else
 #include <CL/cl.h>
 #endif
+#endif